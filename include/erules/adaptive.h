@@ -0,0 +1,190 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+namespace erules {
+
+/// 'a and b and c' or 'a or b or c' over side effect free predicates.
+/// Some evaluations are sampled: the pass rate and the time of every
+/// operand are recorded, and the operands are periodically reordered so
+/// the cheap ones that decide the result most often run first.
+/// The order is one atomic word, so evaluation and reordering can
+/// happen on any number of threads.
+template <typename ContextT>
+class adaptive_chain {
+public:
+    using predicate_type = std::function<bool(ContextT&)>;
+
+    /// the order keeps 4 bits per operand
+    static constexpr std::size_t max_size = 16;
+    /// one evaluation of sample_rate is measured
+    static constexpr unsigned sample_rate = 64;
+    /// measured evaluations between two reorders
+    static constexpr std::uint64_t reorder_interval = 256;
+
+    struct statistics {
+        std::uint64_t evaluations = 0;
+        std::uint64_t passes = 0;
+        std::uint64_t nanoseconds = 0;
+    };
+
+    adaptive_chain(bool conjunction, std::vector<predicate_type> operands)
+        : conjunction_(conjunction)
+        , operands_(std::move(operands))
+        , counters_(new counters[operands_.size()])
+    {
+        std::vector<std::size_t> order(operands_.size());
+        std::iota(order.begin(), order.end(), 0);
+        order_.store(pack(order), std::memory_order_relaxed);
+    }
+
+    bool operator()(ContextT& ctx)
+    {
+        auto packed = order_.load(std::memory_order_relaxed);
+        if (sampled()) {
+            return call_measured(ctx, packed);
+        }
+        for (std::size_t i = 0; i < operands_.size(); ++i) {
+            if (operands_[index(packed, i)](ctx) != conjunction_) {
+                return !conjunction_;
+            }
+        }
+        return conjunction_;
+    }
+
+    bool conjunction() const
+    {
+        return conjunction_;
+    }
+
+    std::size_t size() const
+    {
+        return operands_.size();
+    }
+
+    /// operand indices in the order they run now
+    std::vector<std::size_t> order() const
+    {
+        auto packed = order_.load(std::memory_order_relaxed);
+        std::vector<std::size_t> res(operands_.size());
+        for (std::size_t i = 0; i < res.size(); ++i) {
+            res[i] = index(packed, i);
+        }
+        return res;
+    }
+
+    std::vector<statistics> get_statistics() const
+    {
+        std::vector<statistics> res(operands_.size());
+        for (std::size_t i = 0; i < res.size(); ++i) {
+            res[i].evaluations
+                = counters_[i].evaluations.load(std::memory_order_relaxed);
+            res[i].passes = counters_[i].passes.load(std::memory_order_relaxed);
+            res[i].nanoseconds
+                = counters_[i].nanoseconds.load(std::memory_order_relaxed);
+        }
+        return res;
+    }
+
+    /// replaces the statistics of one operand; call reorder() afterwards
+    void set_statistics(std::size_t operand, const statistics& value)
+    {
+        auto& dst = counters_[operand];
+        dst.evaluations.store(value.evaluations, std::memory_order_relaxed);
+        dst.passes.store(value.passes, std::memory_order_relaxed);
+        dst.nanoseconds.store(value.nanoseconds, std::memory_order_relaxed);
+    }
+
+    /// expected cost of an operand divided by the chance that it ends
+    /// the chain, lowest first. the pass rate is smoothed, so operands
+    /// that were never measured keep their place
+    void reorder()
+    {
+        auto stats = get_statistics();
+        std::vector<double> ranks(stats.size());
+        for (std::size_t i = 0; i < stats.size(); ++i) {
+            auto& s = stats[i];
+            auto pass = (s.passes + 1.0) / (s.evaluations + 2.0);
+            auto cost = s.evaluations
+                ? static_cast<double>(s.nanoseconds) / s.evaluations
+                : 1.0;
+            ranks[i] = cost / (conjunction_ ? 1.0 - pass : pass);
+        }
+        auto order = this->order();
+        std::stable_sort(order.begin(), order.end(),
+                         [&ranks](std::size_t l, std::size_t r) {
+                             return ranks[l] < ranks[r];
+                         });
+        order_.store(pack(order), std::memory_order_relaxed);
+    }
+
+private:
+    struct counters {
+        std::atomic<std::uint64_t> evaluations { 0 };
+        std::atomic<std::uint64_t> passes { 0 };
+        std::atomic<std::uint64_t> nanoseconds { 0 };
+    };
+
+    static bool sampled()
+    {
+        static thread_local unsigned tick = 0;
+        return (++tick % sample_rate) == 0;
+    }
+
+    static std::size_t index(std::uint64_t packed, std::size_t pos)
+    {
+        return static_cast<std::size_t>((packed >> (pos * 4)) & 0xF);
+    }
+
+    static std::uint64_t pack(const std::vector<std::size_t>& order)
+    {
+        std::uint64_t res = 0;
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            res |= static_cast<std::uint64_t>(order[i]) << (i * 4);
+        }
+        return res;
+    }
+
+    bool call_measured(ContextT& ctx, std::uint64_t packed)
+    {
+        using clock = std::chrono::steady_clock;
+        auto result = conjunction_;
+        for (std::size_t i = 0; i < operands_.size(); ++i) {
+            auto pos = index(packed, i);
+            auto start = clock::now();
+            auto pass = operands_[pos](ctx);
+            auto spent = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock::now() - start);
+            auto& cnt = counters_[pos];
+            cnt.evaluations.fetch_add(1, std::memory_order_relaxed);
+            cnt.passes.fetch_add(pass ? 1 : 0, std::memory_order_relaxed);
+            cnt.nanoseconds.fetch_add(
+                static_cast<std::uint64_t>(spent.count()),
+                std::memory_order_relaxed);
+            if (pass != conjunction_) {
+                result = !conjunction_;
+                break;
+            }
+        }
+        if (samples_.fetch_add(1, std::memory_order_relaxed)
+                % reorder_interval
+            == reorder_interval - 1) {
+            reorder();
+        }
+        return result;
+    }
+
+    bool conjunction_;
+    std::vector<predicate_type> operands_;
+    std::unique_ptr<counters[]> counters_;
+    std::atomic<std::uint64_t> order_ { 0 };
+    std::atomic<std::uint64_t> samples_ { 0 };
+};
+
+}
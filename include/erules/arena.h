@@ -0,0 +1,144 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace erules {
+
+/// monotonic allocator. memory is never given back one piece at a time,
+/// reset() releases everything at once and keeps the blocks for reuse
+class arena {
+public:
+    static constexpr std::size_t default_block_size = 4096;
+
+    explicit arena(std::size_t block_size = default_block_size)
+        : block_size_(block_size)
+    {
+    }
+
+    arena(arena&&) = default;
+    arena& operator=(arena&&) = default;
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+
+    void* allocate(std::size_t size,
+                   std::size_t align = alignof(std::max_align_t))
+    {
+        if (!blocks_.empty()) {
+            auto& last = blocks_.back();
+            auto pos = align_up(offset_, align);
+            if (pos + size <= last.size) {
+                offset_ = pos + size;
+                return last.data.get() + pos;
+            }
+        }
+        auto size_needed = size + align;
+        add_block(size_needed > block_size_ ? size_needed : block_size_);
+        auto pos = align_up(0, align);
+        offset_ = pos + size;
+        return blocks_.back().data.get() + pos;
+    }
+
+    /// if the last round needed more than one block,
+    /// the next one gets a single block of the total size
+    void reset()
+    {
+        if (blocks_.size() > 1) {
+            auto total = capacity();
+            blocks_.clear();
+            add_block(total);
+        }
+        offset_ = 0;
+    }
+
+    std::size_t capacity() const
+    {
+        std::size_t total = 0;
+        for (auto& b : blocks_) {
+            total += b.size;
+        }
+        return total;
+    }
+
+    std::size_t blocks() const
+    {
+        return blocks_.size();
+    }
+
+    /// whether p points into one of the blocks
+    bool owns(const void* p) const
+    {
+        auto pos = static_cast<const unsigned char*>(p);
+        for (auto& b : blocks_) {
+            if (b.data.get() <= pos && pos < b.data.get() + b.size) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// the arena that receives objects::base instances
+    /// created on this thread; nullptr means the heap
+    static arena* current()
+    {
+        auto top = top_ref();
+        return top ? top->owner_ : nullptr;
+    }
+
+    /// makes an arena current for the lifetime of the scope.
+    /// objects created inside must be destroyed before the next reset()
+    class scope {
+    public:
+        explicit scope(arena& owner)
+            : owner_(&owner)
+            , previous_(top_ref())
+        {
+            top_ref() = this;
+        }
+
+        ~scope()
+        {
+            top_ref() = previous_;
+        }
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+    private:
+        friend class arena;
+        arena* owner_;
+        scope* previous_;
+    };
+
+private:
+    struct block {
+        std::unique_ptr<unsigned char[]> data;
+        std::size_t size = 0;
+    };
+
+    static scope*& top_ref()
+    {
+        static thread_local scope* value = nullptr;
+        return value;
+    }
+
+    static std::size_t align_up(std::size_t value, std::size_t align)
+    {
+        return (value + align - 1) & ~(align - 1);
+    }
+
+    void add_block(std::size_t size)
+    {
+        blocks_.push_back(block { std::unique_ptr<unsigned char[]>(
+                                      new unsigned char[size]),
+                                  size });
+    }
+
+    std::vector<block> blocks_;
+    std::size_t offset_ = 0;
+    std::size_t block_size_;
+};
+
+}
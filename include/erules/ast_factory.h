@@ -0,0 +1,245 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+#include "erules/ast.h"
+
+namespace erules {
+
+/// Immutable node of a hash-consed tree.
+/// A factory keeps one node per structure, so two subtrees of the same
+/// factory are equal if and only if they are the same object. The
+/// position of the lexem is the one of the first equal node.
+template <typename LexemT>
+class interned_node
+    : public std::enable_shared_from_this<interned_node<LexemT>> {
+public:
+    using lexem_type = LexemT;
+    using handle = std::shared_ptr<const interned_node>;
+
+    enum class kind_type { IDENT, VALUE, PREFIX, BINARY };
+
+    interned_node(kind_type kind, lexem_type lexem, handle left = {},
+                  handle right = {})
+        : kind_(kind)
+        , lexem_(std::move(lexem))
+        , left_(std::move(left))
+        , right_(std::move(right))
+    {
+        using string_type = decltype(lexem_.value());
+        auto mix = [this](std::size_t value) {
+            hash_ ^= value + 0x9e3779b97f4a7c15ull + (hash_ << 6)
+                + (hash_ >> 2);
+        };
+        mix(static_cast<std::size_t>(kind_));
+        mix(static_cast<std::size_t>(lexem_.token()));
+        mix(std::hash<string_type>()(lexem_.value()));
+        mix(std::hash<const interned_node*>()(left_.get()));
+        mix(std::hash<const interned_node*>()(right_.get()));
+    }
+
+    kind_type kind() const
+    {
+        return kind_;
+    }
+
+    const lexem_type& lexem() const
+    {
+        return lexem_;
+    }
+
+    /// the operand of a prefix operation, the left one of a binary one
+    const handle& left() const
+    {
+        return left_;
+    }
+
+    const handle& right() const
+    {
+        return right_;
+    }
+
+    std::size_t hash() const
+    {
+        return hash_;
+    }
+
+    /// same kind, token and value over the same operand objects
+    bool equivalent(const interned_node& other) const
+    {
+        return hash_ == other.hash_ && kind_ == other.kind_
+            && lexem_.token() == other.lexem_.token()
+            && left_ == other.left_ && right_ == other.right_
+            && lexem_.value() == other.lexem_.value();
+    }
+
+private:
+    kind_type kind_;
+    lexem_type lexem_;
+    handle left_;
+    handle right_;
+    std::size_t hash_ = 0;
+};
+
+/// Builds interned trees: structurally equal subtrees of every tree made
+/// by one factory exist once in memory. Nodes are shared and counted by
+/// their handles; a node leaves the factory with its last handle.
+/// Comparing two rules of one factory is comparing two pointers.
+/// Not synchronized, like constant_pool.
+template <typename LexemT>
+class ast_factory {
+public:
+    using lexem_type = LexemT;
+    using interned_type = interned_node<lexem_type>;
+    using handle = typename interned_type::handle;
+    using kind_type = typename interned_type::kind_type;
+    using node_type = objects::ast::node<lexem_type>;
+    using node_uptr = typename node_type::uptr;
+
+    ast_factory()
+        : table_(std::make_shared<table_type>())
+    {
+    }
+
+    ast_factory(const ast_factory&) = delete;
+    ast_factory& operator=(const ast_factory&) = delete;
+
+    handle ident(lexem_type lexem)
+    {
+        return make(kind_type::IDENT, std::move(lexem), {}, {});
+    }
+
+    handle value(lexem_type lexem)
+    {
+        return make(kind_type::VALUE, std::move(lexem), {}, {});
+    }
+
+    handle prefix(lexem_type lexem, handle operand)
+    {
+        return make(kind_type::PREFIX, std::move(lexem), std::move(operand),
+                    {});
+    }
+
+    handle binary(lexem_type lexem, handle left, handle right)
+    {
+        return make(kind_type::BINARY, std::move(lexem), std::move(left),
+                    std::move(right));
+    }
+
+    /// the interned copy of a parsed tree
+    handle intern(const node_type* node)
+    {
+        using namespace objects;
+        if (!node) {
+            throw std::runtime_error("ast_factory: empty node");
+        } else if (base::is<ast::ident<lexem_type>>(node)) {
+            return ident(node->lexem());
+        } else if (base::is<ast::value<lexem_type>>(node)) {
+            return value(node->lexem());
+        } else if (base::is<ast::prefix_operation<lexem_type>>(node)) {
+            auto pref = base::cast<ast::prefix_operation<lexem_type>>(node);
+            return prefix(node->lexem(), intern(pref->value().get()));
+        } else if (base::is<ast::binary_operation<lexem_type>>(node)) {
+            auto bin = base::cast<ast::binary_operation<lexem_type>>(node);
+            auto left = intern(bin->left().get());
+            return binary(node->lexem(), std::move(left),
+                          intern(bin->right().get()));
+        }
+        throw std::runtime_error("ast_factory: unsupported node "
+                                 + std::string(node->type_name()));
+    }
+
+    handle intern(const node_uptr& node)
+    {
+        return intern(node.get());
+    }
+
+    /// a parsed tree again, for the compiler and the optimizer
+    static node_uptr expand(const interned_type* node)
+    {
+        using namespace objects;
+        if (!node) {
+            return nullptr;
+        }
+        switch (node->kind()) {
+        case kind_type::IDENT:
+            return std::make_unique<ast::ident<lexem_type>>(node->lexem());
+        case kind_type::VALUE:
+            return std::make_unique<ast::value<lexem_type>>(node->lexem());
+        case kind_type::PREFIX:
+            return std::make_unique<ast::prefix_operation<lexem_type>>(
+                node->lexem(), expand(node->left().get()));
+        default:
+            break;
+        }
+        return std::make_unique<ast::binary_operation<lexem_type>>(
+            node->lexem(), expand(node->left().get()),
+            expand(node->right().get()));
+    }
+
+    static node_uptr expand(const handle& node)
+    {
+        return expand(node.get());
+    }
+
+    /// distinct nodes alive
+    std::size_t size() const
+    {
+        return table_->size();
+    }
+
+    /// nodes asked for, the shared ones included
+    std::size_t requests() const
+    {
+        return requests_;
+    }
+
+private:
+    struct hasher {
+        std::size_t operator()(const interned_type* node) const
+        {
+            return node->hash();
+        }
+    };
+
+    struct equal {
+        bool operator()(const interned_type* l, const interned_type* r) const
+        {
+            return l->equivalent(*r);
+        }
+    };
+
+    using table_type = std::unordered_set<const interned_type*, hasher, equal>;
+
+    /// the last handle of a node removes it from the table, if the
+    /// factory is still there
+    handle make(kind_type kind, lexem_type lexem, handle left, handle right)
+    {
+        ++requests_;
+        std::unique_ptr<interned_type> node(new interned_type(
+            kind, std::move(lexem), std::move(left), std::move(right)));
+        auto found = table_->find(node.get());
+        if (found != table_->end()) {
+            return (*found)->shared_from_this();
+        }
+        std::weak_ptr<table_type> table = table_;
+        auto raw = node.release();
+        handle res(raw, [table](const interned_type* item) {
+            if (auto owner = table.lock()) {
+                owner->erase(item);
+            }
+            delete item;
+        });
+        table_->insert(raw);
+        return res;
+    }
+
+    std::shared_ptr<table_type> table_;
+    std::size_t requests_ = 0;
+};
+
+}
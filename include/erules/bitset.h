@@ -0,0 +1,220 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace erules {
+
+/// Set of dense ids, rules of a rule set or rows of a batch, one bit per
+/// id in 64 bit words.
+/// The combinators run word by word over plain loops the compiler can
+/// vectorize; iteration skips to the next set bit with a count of
+/// trailing zeros.
+class rule_bitset {
+public:
+    using word_type = std::uint64_t;
+    static constexpr std::size_t word_bits = 64;
+
+    rule_bitset() = default;
+
+    explicit rule_bitset(std::size_t size)
+    {
+        resize(size);
+    }
+
+    /// new bits are clear
+    void resize(std::size_t size)
+    {
+        size_ = size;
+        words_.resize((size + word_bits - 1) / word_bits, 0);
+        trim();
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    void set(std::size_t pos)
+    {
+        words_[pos / word_bits] |= word_type(1) << (pos % word_bits);
+    }
+
+    void reset(std::size_t pos)
+    {
+        words_[pos / word_bits] &= ~(word_type(1) << (pos % word_bits));
+    }
+
+    bool test(std::size_t pos) const
+    {
+        return (words_[pos / word_bits] >> (pos % word_bits)) & 1;
+    }
+
+    /// clears every bit, the size stays
+    void clear()
+    {
+        std::fill(words_.begin(), words_.end(), 0);
+    }
+
+    /// sets every bit
+    void fill()
+    {
+        std::fill(words_.begin(), words_.end(), ~word_type(0));
+        trim();
+    }
+
+    /// inverts every bit below size()
+    void flip()
+    {
+        for (auto& w : words_) {
+            w = ~w;
+        }
+        trim();
+    }
+
+    /// bit i becomes pred(i) for every i below size(), a word at a time
+    template <typename PredT>
+    void assign(PredT&& pred)
+    {
+        std::size_t pos = 0;
+        for (auto& w : words_) {
+            auto end = std::min(size_ - pos, word_bits);
+            word_type bits = 0;
+            for (std::size_t i = 0; i < end; ++i) {
+                bits |= word_type(pred(pos + i) ? 1 : 0) << i;
+            }
+            w = bits;
+            pos += word_bits;
+        }
+    }
+
+    bool any() const
+    {
+        word_type acc = 0;
+        for (auto w : words_) {
+            acc |= w;
+        }
+        return acc != 0;
+    }
+
+    std::size_t count() const
+    {
+        std::size_t res = 0;
+        for (auto w : words_) {
+            res += popcount(w);
+        }
+        return res;
+    }
+
+    /// the combinators work on the common prefix of the two sets
+    rule_bitset& operator&=(const rule_bitset& other)
+    {
+        auto common = std::min(words_.size(), other.words_.size());
+        for (std::size_t i = 0; i < common; ++i) {
+            words_[i] &= other.words_[i];
+        }
+        std::fill(words_.begin() + common, words_.end(), 0);
+        return *this;
+    }
+
+    rule_bitset& operator|=(const rule_bitset& other)
+    {
+        auto common = std::min(words_.size(), other.words_.size());
+        for (std::size_t i = 0; i < common; ++i) {
+            words_[i] |= other.words_[i];
+        }
+        trim();
+        return *this;
+    }
+
+    /// removes the bits set in other
+    rule_bitset& and_not(const rule_bitset& other)
+    {
+        auto common = std::min(words_.size(), other.words_.size());
+        for (std::size_t i = 0; i < common; ++i) {
+            words_[i] &= ~other.words_[i];
+        }
+        return *this;
+    }
+
+    /// calls call(pos) for every set bit, ascending
+    template <typename CallT>
+    void for_each(CallT&& call) const
+    {
+        for (std::size_t i = 0; i < words_.size(); ++i) {
+            for (auto w = words_[i]; w != 0; w &= w - 1) {
+                call(i * word_bits + ctz(w));
+            }
+        }
+    }
+
+    template <typename T>
+    void append_to(std::vector<T>& out) const
+    {
+        for_each([&out](std::size_t pos) { out.emplace_back(pos); });
+    }
+
+    const std::vector<word_type>& words() const
+    {
+        return words_;
+    }
+
+    friend bool operator==(const rule_bitset& l, const rule_bitset& r)
+    {
+        return l.size_ == r.size_ && l.words_ == r.words_;
+    }
+
+    friend bool operator!=(const rule_bitset& l, const rule_bitset& r)
+    {
+        return !(l == r);
+    }
+
+private:
+    /// bits past size() are always clear
+    void trim()
+    {
+        if (size_ % word_bits) {
+            words_.back() &= (word_type(1) << (size_ % word_bits)) - 1;
+        }
+    }
+
+    static std::size_t ctz(word_type w)
+    {
+#if defined(_MSC_VER)
+        unsigned long res;
+        _BitScanForward64(&res, w);
+        return res;
+#else
+        return static_cast<std::size_t>(__builtin_ctzll(w));
+#endif
+    }
+
+    static std::size_t popcount(word_type w)
+    {
+#if defined(_MSC_VER)
+        return static_cast<std::size_t>(__popcnt64(w));
+#else
+        return static_cast<std::size_t>(__builtin_popcountll(w));
+#endif
+    }
+
+    std::vector<word_type> words_;
+    std::size_t size_ = 0;
+};
+
+inline rule_bitset operator&(rule_bitset l, const rule_bitset& r)
+{
+    return l &= r;
+}
+
+inline rule_bitset operator|(rule_bitset l, const rule_bitset& r)
+{
+    return l |= r;
+}
+
+}
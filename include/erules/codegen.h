@@ -0,0 +1,531 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "erules/compiler.h"
+
+namespace erules {
+
+/// C++ source for a set of rules, ahead of time.
+/// Each rule becomes a function template over a fields type: identifiers
+/// are read as fields.read(slot), with the slots of names[] in the
+/// generated code, so a record_environment over a record_binding, a
+/// slot_environment or any struct with such a read() will do. Rules are
+/// optimized first and then written out as the compiler would build
+/// them: comparisons with a literal, ranges, lists and starts with are
+/// expanded inline, everything else calls the rule_runtime.
+template <typename LexemT>
+class rule_codegen {
+public:
+    using lexem_type = LexemT;
+    using compiler_type = compiler<lexem_type>;
+    using char_type = typename compiler_type::char_type;
+    using string_type = typename compiler_type::string_type;
+    using node_type = typename compiler_type::node_type;
+    using symbol_table_type = typename compiler_type::symbol_table_type;
+
+    static_assert(std::is_same<char_type, char>::value,
+                  "rule_codegen writes rules over char");
+
+    rule_codegen()
+        : compiler_(std::make_shared<symbol_table_type>())
+    {
+    }
+
+    const std::shared_ptr<symbol_table_type>& symbols() const
+    {
+        return compiler_.symbols();
+    }
+
+    /// ids are dense, in the order the rules are added. text is kept
+    /// for the generated texts[]
+    std::size_t add(const node_type* root, const string_type& text)
+    {
+        if (!root) {
+            throw std::runtime_error("rule_codegen: empty rule");
+        }
+        auto optimized = compiler_.optimize(root);
+        resolve(optimized.get());
+        locals_ = 0;
+        bodies_.emplace_back(predicate(optimized.get()));
+        texts_.emplace_back(text);
+        return bodies_.size() - 1;
+    }
+
+    std::size_t add(const typename node_type::uptr& root,
+                    const string_type& text)
+    {
+        return add(root.get(), text);
+    }
+
+    std::size_t size() const
+    {
+        return bodies_.size();
+    }
+
+    /// the C++ expression of one rule
+    const std::string& expression(std::size_t id) const
+    {
+        return bodies_[id];
+    }
+
+    /// a header with everything in namespace space
+    void write(std::ostream& out, const std::string& space,
+               const std::string& source = "rules") const
+    {
+        auto& names = *symbols();
+        out << "// Generated by erules_codegen from " << source
+            << ". Do not edit.\n"
+            << "#pragma once\n"
+            << "#include <cstddef>\n"
+            << "#include <cstdint>\n"
+            << "#include <functional>\n"
+            << "#include <limits>\n"
+            << "#include <memory>\n"
+            << "#include <string_view>\n\n"
+            << "#include \"erules/rule_runtime.h\"\n\n"
+            << "namespace " << space << " {\n\n"
+            << "using runtime_type = erules::rule_runtime<char>;\n"
+            << "using scalar_type = runtime_type::scalar_type;\n"
+            << "using symbol_table_type = erules::symbol_table<char>;\n\n"
+            << "constexpr std::size_t rule_count = " << size() << ";\n"
+            << "constexpr std::size_t field_count = " << names.size()
+            << ";\n\n"
+            << "/// identifiers by slot, then nullptr\n"
+            << "constexpr const char* names[] = {\n";
+        for (std::size_t slot = 0; slot < names.size(); ++slot) {
+            out << "    " << quote(names.name(slot)) << ",\n";
+        }
+        out << "    nullptr,\n};\n\n"
+            << "/// the rules as they were read, then nullptr\n"
+            << "constexpr const char* texts[] = {\n";
+        for (auto& text : texts_) {
+            out << "    " << quote(text) << ",\n";
+        }
+        out << "    nullptr,\n};\n\n"
+            << "/// a table with the slots of names[]\n"
+            << "inline std::shared_ptr<symbol_table_type> make_symbols()\n"
+            << "{\n"
+            << "    auto res = std::make_shared<symbol_table_type>();\n"
+            << "    for (auto name = names; *name; ++name) {\n"
+            << "        res->resolve(*name);\n"
+            << "    }\n"
+            << "    return res;\n"
+            << "}\n\n"
+            << "constexpr runtime_type::id_type op(int id)\n"
+            << "{\n"
+            << "    return static_cast<runtime_type::id_type>(id);\n"
+            << "}\n\n";
+        for (std::size_t id = 0; id < size(); ++id) {
+            out << "/// texts[" << id << "]\n"
+                << "template <typename FieldsT>\n"
+                << "inline bool rule_" << id
+                << "([[maybe_unused]] const FieldsT& fields,\n"
+                << "    [[maybe_unused]] runtime_type& rt)\n"
+                << "{\n"
+                << "    return " << bodies_[id] << ";\n"
+                << "}\n\n";
+        }
+        out << "/// one rule by id\n"
+            << "template <typename FieldsT>\n"
+            << "bool test(std::size_t id, [[maybe_unused]] const FieldsT& "
+               "fields,\n"
+            << "    runtime_type& rt)\n"
+            << "{\n"
+            << "    bool res = false;\n"
+            << "    switch (id) {\n";
+        for (std::size_t id = 0; id < size(); ++id) {
+            out << "    case " << id << ":\n"
+                << "        res = rule_" << id << "(fields, rt);\n"
+                << "        break;\n";
+        }
+        out << "    default:\n"
+            << "        break;\n"
+            << "    }\n"
+            << "    rt.reset();\n"
+            << "    return res;\n"
+            << "}\n\n"
+            << "/// the matching rules as the bits of a set of rule_count "
+               "bits\n"
+            << "template <typename FieldsT>\n"
+            << "void match([[maybe_unused]] const FieldsT& fields,\n"
+            << "    [[maybe_unused]] runtime_type& rt, "
+               "erules::rule_bitset& out)\n"
+            << "{\n"
+            << "    out.resize(rule_count);\n"
+            << "    out.clear();\n";
+        for (std::size_t id = 0; id < size(); ++id) {
+            out << "    if (rule_" << id << "(fields, rt)) {\n"
+                << "        out.set(" << id << ");\n"
+                << "    }\n"
+                << "    rt.reset();\n";
+        }
+        out << "}\n\n"
+            << "}\n";
+    }
+
+    /// a C++ string literal; every character outside of printable ASCII
+    /// is escaped
+    static std::string quote(const std::string& value)
+    {
+        std::string res = "\"";
+        for (unsigned char c : value) {
+            if (c >= 0x20 && c < 0x7F && c != '"' && c != '\\' && c != '?') {
+                res += static_cast<char>(c);
+            } else {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\%03o", c);
+                res += buf;
+            }
+        }
+        return res + "\"";
+    }
+
+private:
+    using id_type = typename lexem_type::id_type;
+    using literals_type = typename compiler_type::literals_type;
+    using value_node = objects::ast::value<lexem_type>;
+    using ident_node = objects::ast::ident<lexem_type>;
+    using binary_node = objects::ast::binary_operation<lexem_type>;
+    using prefix_node = objects::ast::prefix_operation<lexem_type>;
+
+    static bool is_logical(id_type token)
+    {
+        switch (token) {
+        case constants::token_type::AND:
+        case constants::token_type::OR:
+        case constants::token_type::IN:
+        case constants::token_type::EQ:
+        case constants::token_type::NOTEQ:
+        case constants::token_type::LT:
+        case constants::token_type::GT:
+        case constants::token_type::LEQ:
+        case constants::token_type::GEQ:
+        case constants::token_type::STARTSWITH:
+            return true;
+        default:
+            break;
+        }
+        return false;
+    }
+
+    static std::string op(id_type token)
+    {
+        return "op(" + std::to_string(static_cast<int>(token)) + ")";
+    }
+
+    static const binary_node* as_binary(const node_type* node)
+    {
+        return objects::base::is<binary_node>(node)
+            ? objects::base::cast<binary_node>(node)
+            : nullptr;
+    }
+
+    static bool is_literal(const node_type* node)
+    {
+        return objects::base::is<value_node>(node);
+    }
+
+    static bool is_range(const node_type* node)
+    {
+        auto bin = as_binary(node);
+        return bin
+            && (bin->lexem().token() == constants::token_type::DOTDOT
+                || bin->lexem().token() == constants::token_type::DOTDOTDOT);
+    }
+
+    static bool is_numeric(const node_type* node)
+    {
+        using namespace objects;
+        if (!is_literal(node)) {
+            return false;
+        }
+        auto literal = literals_type::to_object(node->lexem());
+        return base::is<number>(literal.get())
+            || base::is<floating>(literal.get());
+    }
+
+    /// a range with numeric literals at both ends
+    static bool literal_range(const node_type* node)
+    {
+        return is_range(node) && is_numeric(as_binary(node)->left().get())
+            && is_numeric(as_binary(node)->right().get());
+    }
+
+    static std::string integer(std::int64_t value)
+    {
+        if (value == std::numeric_limits<std::int64_t>::min()) {
+            return "std::numeric_limits<std::int64_t>::min()";
+        }
+        return "std::int64_t(" + std::to_string(value) + "LL)";
+    }
+
+    /// exact, as a hexadecimal literal
+    static std::string real(double value)
+    {
+        if (std::isnan(value)) {
+            return "std::numeric_limits<double>::quiet_NaN()";
+        } else if (std::isinf(value)) {
+            return value < 0 ? "-std::numeric_limits<double>::infinity()"
+                             : "std::numeric_limits<double>::infinity()";
+        }
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "%a", value);
+        return buf;
+    }
+
+    /// the literal as a scalar_type expression
+    static std::string literal(const node_type* node)
+    {
+        using namespace objects;
+        using string_object = objects::string<char_type>;
+        auto value = literals_type::to_object(node->lexem());
+        if (base::is<number>(value.get())) {
+            return "scalar_type::make_integer("
+                + integer(base::cast<number>(value.get())->value()) + ")";
+        } else if (base::is<floating>(value.get())) {
+            return "scalar_type::make_floating("
+                + real(base::cast<floating>(value.get())->value()) + ")";
+        } else if (base::is<boolean>(value.get())) {
+            return base::cast<boolean>(value.get())->value()
+                ? "scalar_type::make_boolean(true)"
+                : "scalar_type::make_boolean(false)";
+        } else if (base::is<string_object>(value.get())) {
+            auto& text = base::cast<string_object>(value.get())->value();
+            return "scalar_type::make_string(std::string_view(" + quote(text)
+                + ", " + std::to_string(text.size()) + "))";
+        }
+        throw std::runtime_error("rule_codegen: bad literal");
+    }
+
+    static std::string interval(const binary_node* range)
+    {
+        using namespace objects;
+        auto low = literals_type::to_object(range->left()->lexem());
+        auto high = literals_type::to_object(range->right()->lexem());
+        auto exclusive
+            = range->lexem().token() == constants::token_type::DOTDOTDOT
+            ? "true"
+            : "false";
+        if (base::is<number>(low.get()) && base::is<number>(high.get())) {
+            return "erules::numeric_interval<std::int64_t> { "
+                + integer(base::cast<number>(low.get())->value()) + ", "
+                + integer(base::cast<number>(high.get())->value()) + ", "
+                + exclusive + " }";
+        }
+        return "erules::numeric_interval<double> { " + real(to_double(low))
+            + ", " + real(to_double(high)) + ", " + exclusive + " }";
+    }
+
+    static double to_double(const objects::base::uptr& value)
+    {
+        using namespace objects;
+        return base::is<number>(value.get())
+            ? static_cast<double>(base::cast<number>(value.get())->value())
+            : base::cast<floating>(value.get())->value();
+    }
+
+    static const char* comparator(id_type op)
+    {
+        switch (op) {
+        case constants::token_type::EQ:
+            return "std::equal_to<>";
+        case constants::token_type::NOTEQ:
+            return "std::not_equal_to<>";
+        case constants::token_type::LT:
+            return "std::less<>";
+        case constants::token_type::GT:
+            return "std::greater<>";
+        case constants::token_type::LEQ:
+            return "std::less_equal<>";
+        default:
+            break;
+        }
+        return "std::greater_equal<>";
+    }
+
+    static id_type flip(id_type op)
+    {
+        switch (op) {
+        case constants::token_type::LT:
+            return constants::token_type::GT;
+        case constants::token_type::GT:
+            return constants::token_type::LT;
+        case constants::token_type::LEQ:
+            return constants::token_type::GEQ;
+        case constants::token_type::GEQ:
+            return constants::token_type::LEQ;
+        default:
+            break;
+        }
+        return op;
+    }
+
+    /// slots in the order the identifiers appear
+    void resolve(const node_type* node)
+    {
+        using namespace objects;
+        if (base::is<ident_node>(node)) {
+            symbols()->resolve(node->lexem().value());
+        } else if (base::is<prefix_node>(node)) {
+            resolve(base::cast<prefix_node>(node)->value().get());
+        } else if (auto bin = as_binary(node)) {
+            resolve(bin->left().get());
+            resolve(bin->right().get());
+        }
+    }
+
+    std::string predicate(const node_type* node)
+    {
+        using namespace objects;
+        if (base::is<prefix_node>(node)
+            && node->lexem().token() == constants::token_type::NOT) {
+            auto pref = base::cast<prefix_node>(node);
+            return "!(" + predicate(pref->value().get()) + ")";
+        } else if (auto bin = as_binary(node)) {
+            switch (bin->lexem().token()) {
+            case constants::token_type::AND:
+                return "(" + predicate(bin->left().get()) + " && "
+                    + predicate(bin->right().get()) + ")";
+            case constants::token_type::OR:
+                return "(" + predicate(bin->left().get()) + " || "
+                    + predicate(bin->right().get()) + ")";
+            case constants::token_type::IN:
+                return contains(bin);
+            case constants::token_type::EQ:
+            case constants::token_type::NOTEQ:
+            case constants::token_type::LT:
+            case constants::token_type::GT:
+            case constants::token_type::LEQ:
+            case constants::token_type::GEQ:
+                return compare(bin);
+            case constants::token_type::STARTSWITH:
+                return starts_with(bin);
+            default:
+                break;
+            }
+        }
+        return "runtime_type::truth(" + value(node) + ")";
+    }
+
+    std::string value(const node_type* node)
+    {
+        using namespace objects;
+        if (base::is<ident_node>(node)) {
+            auto slot = symbols()->resolve(node->lexem().value());
+            return "fields.read(" + std::to_string(slot) + ")";
+        } else if (is_literal(node)) {
+            return literal(node);
+        } else if (base::is<prefix_node>(node)) {
+            auto pref = base::cast<prefix_node>(node);
+            if (node->lexem().token() == constants::token_type::NOT) {
+                return "scalar_type::make_boolean(" + predicate(node) + ")";
+            }
+            return "rt.unary(" + op(node->lexem().token()) + ", "
+                + value(pref->value().get()) + ")";
+        } else if (auto bin = as_binary(node)) {
+            if (is_logical(bin->lexem().token())) {
+                return "scalar_type::make_boolean(" + predicate(node) + ")";
+            }
+            return "rt.binary(" + op(bin->lexem().token()) + ", "
+                + value(bin->left().get()) + ", " + value(bin->right().get())
+                + ")";
+        }
+        throw std::runtime_error(
+            std::string("rule_codegen: unsupported node ")
+            + (node ? node->type_name() : "null"));
+    }
+
+    /// with a literal on either side the kinds are compared as the
+    /// compiled rules compare them
+    std::string compare(const binary_node* node)
+    {
+        auto op = node->lexem().token();
+        auto other = node->left().get();
+        auto lit = node->right().get();
+        if (!is_literal(lit) && is_literal(other)) {
+            std::swap(other, lit);
+            op = flip(op);
+        }
+        if (!is_literal(lit)) {
+            return "runtime_type::truth(rt.binary(" + this->op(op) + ", "
+                + value(node->left().get()) + ", "
+                + value(node->right().get()) + "))";
+        }
+        return std::string("runtime_type::compare<") + comparator(op) + ">("
+            + value(other) + ", " + literal(lit) + ")";
+    }
+
+    std::string starts_with(const binary_node* node)
+    {
+        using namespace objects;
+        using string_object = objects::string<char_type>;
+        auto prefix = node->right().get();
+        if (is_literal(prefix)) {
+            auto lit = literals_type::to_object(prefix->lexem());
+            if (base::is<string_object>(lit.get())) {
+                auto& text = base::cast<string_object>(lit.get())->value();
+                return "runtime_type::starts_with(" + value(node->left().get())
+                    + ", std::string_view(" + quote(text) + ", "
+                    + std::to_string(text.size()) + "))";
+            }
+        }
+        return "runtime_type::truth(rt.binary(" + op(node->lexem().token())
+            + ", " + value(node->left().get()) + ", " + value(prefix) + "))";
+    }
+
+    /// 'value in a..b' and 'value in (x, y, ...)'; a list keeps its
+    /// value in a local of a lambda
+    std::string contains(const binary_node* node)
+    {
+        auto container = node->right().get();
+        if (literal_range(container)) {
+            return "runtime_type::inside(" + interval(as_binary(container))
+                + ", " + value(node->left().get()) + ")";
+        } else if (auto range = is_range(container) ? as_binary(container)
+                                                    : nullptr) {
+            auto exclusive
+                = range->lexem().token() == constants::token_type::DOTDOTDOT;
+            return "rt.in_range(" + value(node->left().get()) + ", "
+                + value(range->left().get()) + ", "
+                + value(range->right().get()) + ", "
+                + (exclusive ? "true" : "false") + ")";
+        }
+        auto local = "v" + std::to_string(locals_++);
+        return "[&] { auto " + local + " = " + value(node->left().get())
+            + "; return !" + local + ".empty() && "
+            + in_list(container, local) + "; }()";
+    }
+
+    std::string in_list(const node_type* node, const std::string& local)
+    {
+        auto bin = as_binary(node);
+        if (bin && bin->lexem().token() == constants::token_type::COMMA) {
+            return "(" + in_list(bin->left().get(), local) + " || "
+                + in_list(bin->right().get(), local) + ")";
+        } else if (literal_range(node)) {
+            return "runtime_type::inside(" + interval(bin) + ", " + local
+                + ")";
+        } else if (is_literal(node)) {
+            return "runtime_type::compare<std::equal_to<>>(" + local + ", "
+                + literal(node) + ")";
+        }
+        return "rt.contains(" + local + ", " + value(node) + ")";
+    }
+
+    compiler_type compiler_;
+    std::vector<std::string> texts_;
+    std::vector<std::string> bodies_;
+    std::size_t locals_ = 0;
+};
+
+}
@@ -0,0 +1,984 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "erules/bitset.h"
+#include "erules/compiler.h"
+#include "erules/environment.h"
+#include "erules/scalar.h"
+
+namespace erules {
+
+/// Records of one batch as columns, one column per identifier.
+/// The batch doesn't own the data; integers are int64, floating values
+/// double, strings an offset array of rows + 1 entries over one buffer
+template <typename CharT, typename LessT = std::less<CharT>>
+class column_batch {
+public:
+    using string_type = std::basic_string<CharT>;
+    using string_view_type = std::basic_string_view<CharT>;
+    using symbol_table_type = symbol_table<CharT, LessT>;
+    using scalar_type = scalar<CharT>;
+    using kind_type = typename scalar_type::kind_type;
+
+    struct column {
+        kind_type kind = kind_type::NONE;
+        const std::int64_t* integers = nullptr;
+        const double* floats = nullptr;
+        const bool* booleans = nullptr;
+        /// string i is data[offsets[i] .. offsets[i + 1])
+        const std::uint32_t* offsets = nullptr;
+        const CharT* data = nullptr;
+
+        string_view_type string(std::size_t row) const
+        {
+            return string_view_type(data + offsets[row],
+                                    offsets[row + 1] - offsets[row]);
+        }
+
+        scalar_type read(std::size_t row) const
+        {
+            switch (kind) {
+            case kind_type::INTEGER:
+                return scalar_type::make_integer(integers[row]);
+            case kind_type::FLOATING:
+                return scalar_type::make_floating(floats[row]);
+            case kind_type::BOOLEAN:
+                return scalar_type::make_boolean(booleans[row]);
+            case kind_type::STRING:
+                return scalar_type::make_string(string(row));
+            default:
+                break;
+            }
+            return {};
+        }
+    };
+
+    column_batch(std::shared_ptr<symbol_table_type> symbols, std::size_t rows)
+        : symbols_(std::move(symbols))
+        , rows_(rows)
+    {
+    }
+
+    column_batch& add_integers(const string_type& name,
+                               const std::int64_t* values)
+    {
+        column col;
+        col.kind = kind_type::INTEGER;
+        col.integers = values;
+        return add(name, col);
+    }
+
+    column_batch& add_floats(const string_type& name, const double* values)
+    {
+        column col;
+        col.kind = kind_type::FLOATING;
+        col.floats = values;
+        return add(name, col);
+    }
+
+    column_batch& add_booleans(const string_type& name, const bool* values)
+    {
+        column col;
+        col.kind = kind_type::BOOLEAN;
+        col.booleans = values;
+        return add(name, col);
+    }
+
+    column_batch& add_strings(const string_type& name,
+                              const std::uint32_t* offsets, const CharT* data)
+    {
+        column col;
+        col.kind = kind_type::STRING;
+        col.offsets = offsets;
+        col.data = data;
+        return add(name, col);
+    }
+
+    /// nullptr for identifiers without a column
+    const column* get(std::size_t slot) const
+    {
+        if (slot < columns_.size()
+            && columns_[slot].kind != kind_type::NONE) {
+            return &columns_[slot];
+        }
+        return nullptr;
+    }
+
+    std::size_t rows() const
+    {
+        return rows_;
+    }
+
+    /// rows [begin, begin + count) over the same data
+    column_batch slice(std::size_t begin, std::size_t count) const
+    {
+        column_batch res(symbols_, count);
+        res.columns_ = columns_;
+        for (auto& col : res.columns_) {
+            col.integers = col.integers ? col.integers + begin : nullptr;
+            col.floats = col.floats ? col.floats + begin : nullptr;
+            col.booleans = col.booleans ? col.booleans + begin : nullptr;
+            col.offsets = col.offsets ? col.offsets + begin : nullptr;
+        }
+        return res;
+    }
+
+    /// bytes of one row over every column, strings by their mean length
+    std::size_t row_bytes() const
+    {
+        std::size_t res = 0;
+        for (auto& col : columns_) {
+            switch (col.kind) {
+            case kind_type::INTEGER:
+            case kind_type::FLOATING:
+                res += 8;
+                break;
+            case kind_type::BOOLEAN:
+                res += 1;
+                break;
+            case kind_type::STRING:
+                res += sizeof(std::uint32_t);
+                if (rows_) {
+                    res += sizeof(CharT) * (col.offsets[rows_] - col.offsets[0])
+                        / rows_;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        return res;
+    }
+
+    const std::shared_ptr<symbol_table_type>& symbols() const
+    {
+        return symbols_;
+    }
+
+private:
+    column_batch& add(const string_type& name, const column& col)
+    {
+        auto slot = symbols_->resolve(name);
+        if (slot >= columns_.size()) {
+            columns_.resize(slot + 1);
+        }
+        columns_[slot] = col;
+        return *this;
+    }
+
+    std::shared_ptr<symbol_table_type> symbols_;
+    std::vector<column> columns_;
+    std::size_t rows_;
+};
+
+/// Environment over one row of a batch, for the parts of a rule that
+/// run record by record. get() boxes a copy of the value
+template <typename CharT, typename LessT = std::less<CharT>>
+class batch_environment : public environment<CharT, LessT> {
+public:
+    using super_type = environment<CharT, LessT>;
+    using scalar_type = typename super_type::scalar_type;
+    using batch_type = column_batch<CharT, LessT>;
+
+    batch_environment(const batch_type& batch)
+        : batch_(&batch)
+    {
+    }
+
+    void set_row(std::size_t row)
+    {
+        row_ = row;
+    }
+
+    scalar_type read(std::size_t slot) const override
+    {
+        auto col = batch_->get(slot);
+        return col ? col->read(row_) : scalar_type {};
+    }
+
+    objects::base::cptr get(std::size_t slot) const override
+    {
+        if (slot >= boxes_.size()) {
+            boxes_.resize(slot + 1);
+        }
+        boxes_[slot] = read(slot).to_object();
+        return boxes_[slot].get();
+    }
+
+private:
+    const batch_type* batch_;
+    std::size_t row_ = 0;
+    mutable std::vector<objects::base::uptr> boxes_;
+};
+
+/// Rows of a batch that are still candidates: every row, a bitmap, or
+/// the ascending list of the row indices once few rows are left
+class row_selection {
+public:
+    /// the list is used below one candidate in sparse_ratio rows
+    static constexpr std::size_t sparse_ratio = 32;
+
+    /// every row
+    explicit row_selection(std::size_t rows)
+        : rows_(rows)
+        , count_(rows)
+    {
+    }
+
+    explicit row_selection(const rule_bitset& bits)
+    {
+        assign(bits);
+    }
+
+    /// the set bits of bits, as a list or a bitmap by their count
+    void assign(const rule_bitset& bits)
+    {
+        all_ = false;
+        rows_ = bits.size();
+        count_ = bits.count();
+        sparse_ = count_ * sparse_ratio < rows_;
+        indices_.clear();
+        if (sparse_) {
+            bits.append_to(indices_);
+        } else {
+            bits_ = bits;
+        }
+    }
+
+    std::size_t rows() const
+    {
+        return rows_;
+    }
+
+    std::size_t count() const
+    {
+        return count_;
+    }
+
+    bool empty() const
+    {
+        return count_ == 0;
+    }
+
+    bool sparse() const
+    {
+        return sparse_;
+    }
+
+    /// calls call(row) for every candidate, ascending
+    template <typename CallT>
+    void for_each(CallT&& call) const
+    {
+        if (all_) {
+            for (std::size_t row = 0; row < rows_; ++row) {
+                call(row);
+            }
+        } else if (sparse_) {
+            for (auto row : indices_) {
+                call(row);
+            }
+        } else {
+            bits_.for_each(call);
+        }
+    }
+
+    /// clears the bits of out outside the selection
+    void restrict(rule_bitset& out) const
+    {
+        if (all_) {
+            return;
+        } else if (!sparse_) {
+            out &= bits_;
+            return;
+        }
+        rule_bitset kept(out.size());
+        for (auto row : indices_) {
+            if (out.test(row)) {
+                kept.set(row);
+            }
+        }
+        out = std::move(kept);
+    }
+
+    void to_bits(rule_bitset& out) const
+    {
+        out.resize(rows_);
+        if (all_) {
+            out.fill();
+        } else if (sparse_) {
+            out.clear();
+            for (auto row : indices_) {
+                out.set(row);
+            }
+        } else {
+            out = bits_;
+        }
+    }
+
+private:
+    std::size_t rows_ = 0;
+    std::size_t count_ = 0;
+    bool all_ = true;
+    bool sparse_ = false;
+    rule_bitset bits_;
+    std::vector<std::uint32_t> indices_;
+};
+
+/// A rule compiled for batches. select() writes one bit per row
+template <typename CharT, typename LessT = std::less<CharT>>
+class batch_rule {
+public:
+    using batch_type = column_batch<CharT, LessT>;
+    /// writes the bits of the rows of the selection, clears the others
+    using select_type = std::function<void(
+        const batch_type&, const row_selection&, rule_bitset&)>;
+    using constant_pool_type = constant_pool<CharT>;
+
+    batch_rule(select_type select,
+               std::shared_ptr<const constant_pool_type> constants)
+        : select_(std::move(select))
+        , constants_(std::move(constants))
+    {
+    }
+
+    void select(const batch_type& batch, rule_bitset& out) const
+    {
+        out.resize(batch.rows());
+        select_(batch, row_selection(batch.rows()), out);
+    }
+
+    /// only the rows set in candidates are evaluated
+    void select(const batch_type& batch, const rule_bitset& candidates,
+                rule_bitset& out) const
+    {
+        out.resize(batch.rows());
+        select_(batch, row_selection(candidates), out);
+    }
+
+    rule_bitset select(const batch_type& batch) const
+    {
+        rule_bitset out;
+        select(batch, out);
+        return out;
+    }
+
+private:
+    select_type select_;
+    std::shared_ptr<const constant_pool_type> constants_;
+};
+
+/// Compiles rules into column kernels.
+/// Comparisons, arithmetic, 'and', 'or' and 'not' over numbers, booleans
+/// and strings run once per batch as loops over whole columns; the kinds
+/// are checked once per batch. The rest of the rule, and any part whose
+/// columns have other kinds, runs the regular compiled rule row by row,
+/// so the results are always the ones of compiler<LexemT>.
+/// Operands of 'and' run only on the rows that passed the ones before,
+/// operands of 'or' only on the rows that didn't; few rows are visited
+/// by index, many by the loops over the whole column.
+template <typename LexemT>
+class batch_compiler {
+public:
+    using lexem_type = LexemT;
+    using compiler_type = compiler<lexem_type>;
+    using char_type = typename compiler_type::char_type;
+    using less_type = typename compiler_type::less_type;
+    using node_type = typename compiler_type::node_type;
+    using symbol_table_type = typename compiler_type::symbol_table_type;
+    using batch_type = column_batch<char_type, less_type>;
+    using rule_type = batch_rule<char_type, less_type>;
+    using select_type = typename rule_type::select_type;
+
+    batch_compiler()
+        : batch_compiler(std::make_shared<symbol_table_type>())
+    {
+    }
+
+    batch_compiler(std::shared_ptr<symbol_table_type> symbols)
+        : compiler_(std::move(symbols))
+    {
+    }
+
+    compiler_type& rule_compiler()
+    {
+        return compiler_;
+    }
+
+    const std::shared_ptr<symbol_table_type>& symbols() const
+    {
+        return compiler_.symbols();
+    }
+
+    rule_type compile(const node_type* root)
+    {
+        if (!root) {
+            throw std::runtime_error("batch_compiler: empty rule");
+        }
+        auto optimized = compiler_.optimize(root);
+        return rule_type(compile_select(optimized.get()),
+                         compiler_.constants());
+    }
+
+    rule_type compile(const typename node_type::uptr& root)
+    {
+        return compile(root.get());
+    }
+
+private:
+    using id_type = typename lexem_type::id_type;
+    using scalar_type = typename compiler_type::scalar_type;
+    using kind_type = typename scalar_type::kind_type;
+    using string_view_type = typename scalar_type::string_view_type;
+    using column_type = typename batch_type::column;
+    using literals_type = typename compiler_type::literals_type;
+    using value_node = objects::ast::value<lexem_type>;
+    using ident_node = objects::ast::ident<lexem_type>;
+    using binary_node = objects::ast::binary_operation<lexem_type>;
+    using prefix_node = objects::ast::prefix_operation<lexem_type>;
+
+    /// a column or a constant for every row of the batch
+    struct vector_value {
+        kind_type kind = kind_type::NONE;
+        bool constant = false;
+        scalar_type value;
+        const std::int64_t* integers = nullptr;
+        const double* floats = nullptr;
+        const bool* booleans = nullptr;
+        const column_type* strings = nullptr;
+        std::vector<std::int64_t> own_integers;
+        std::vector<double> own_floats;
+    };
+
+    /// false if the value has no column form for this batch.
+    /// only the rows of the selection are computed
+    using vector_call = std::function<bool(
+        const batch_type&, const row_selection&, vector_value&)>;
+
+    template <typename T>
+    struct column_reader {
+        using value_type = T;
+        const T* data;
+        T operator()(std::size_t row) const
+        {
+            return data[row];
+        }
+    };
+
+    template <typename T>
+    struct constant_reader {
+        using value_type = T;
+        T value;
+        T operator()(std::size_t) const
+        {
+            return value;
+        }
+    };
+
+    struct string_reader {
+        using value_type = string_view_type;
+        const column_type* col;
+        string_view_type operator()(std::size_t row) const
+        {
+            return col->string(row);
+        }
+    };
+
+    template <typename ReaderT>
+    using value_of = typename std::decay_t<ReaderT>::value_type;
+
+    template <typename T>
+    static constexpr bool is_number = std::is_same<T, std::int64_t>::value
+        || std::is_same<T, double>::value;
+
+    static bool is_compare(id_type token)
+    {
+        switch (token) {
+        case constants::token_type::EQ:
+        case constants::token_type::NOTEQ:
+        case constants::token_type::LT:
+        case constants::token_type::GT:
+        case constants::token_type::LEQ:
+        case constants::token_type::GEQ:
+            return true;
+        default:
+            break;
+        }
+        return false;
+    }
+
+    static bool is_arithmetic(id_type token)
+    {
+        switch (token) {
+        case constants::token_type::PLUS:
+        case constants::token_type::MINUS:
+        case constants::token_type::MUL:
+        case constants::token_type::DIV:
+        case constants::token_type::MOD:
+            return true;
+        default:
+            break;
+        }
+        return false;
+    }
+
+    /// identifiers, literals and arithmetic over them
+    static bool is_vector_value(const node_type* node)
+    {
+        using namespace objects;
+        if (base::is<ident_node>(node) || base::is<value_node>(node)) {
+            return true;
+        } else if (base::is<prefix_node>(node)) {
+            auto token = node->lexem().token();
+            auto value = base::cast<prefix_node>(node)->value().get();
+            return (token == constants::token_type::MINUS
+                    || token == constants::token_type::PLUS)
+                && is_vector_value(value);
+        } else if (base::is<binary_node>(node)) {
+            auto bin = base::cast<binary_node>(node);
+            return is_arithmetic(node->lexem().token())
+                && is_vector_value(bin->left().get())
+                && is_vector_value(bin->right().get());
+        }
+        return false;
+    }
+
+    /// a comparison of vector values somewhere under 'and', 'or', 'not'
+    static bool is_vector_select(const node_type* node)
+    {
+        using namespace objects;
+        if (base::is<prefix_node>(node)) {
+            auto value = base::cast<prefix_node>(node)->value().get();
+            return node->lexem().token() == constants::token_type::NOT
+                && is_vector_select(value);
+        } else if (!base::is<binary_node>(node)) {
+            return false;
+        }
+        auto bin = base::cast<binary_node>(node);
+        auto token = node->lexem().token();
+        if (token == constants::token_type::AND
+            || token == constants::token_type::OR) {
+            return is_vector_select(bin->left().get())
+                || is_vector_select(bin->right().get());
+        }
+        return is_compare(token) && is_vector_value(bin->left().get())
+            && is_vector_value(bin->right().get());
+    }
+
+    static void flatten(const node_type* node, id_type token,
+                        std::vector<const node_type*>& out)
+    {
+        using namespace objects;
+        if (base::is<binary_node>(node) && node->lexem().token() == token) {
+            auto bin = base::cast<binary_node>(node);
+            flatten(bin->left().get(), token, out);
+            flatten(bin->right().get(), token, out);
+        } else {
+            out.emplace_back(node);
+        }
+    }
+
+    select_type compile_select(const node_type* node)
+    {
+        using namespace objects;
+        if (!is_vector_select(node)) {
+            return compile_rows(node);
+        }
+        auto token = node->lexem().token();
+        if (base::is<prefix_node>(node)) {
+            auto value
+                = compile_select(base::cast<prefix_node>(node)->value().get());
+            return [value](const batch_type& batch, const row_selection& in,
+                           rule_bitset& out) {
+                value(batch, in, out);
+                out.flip();
+                in.restrict(out);
+            };
+        } else if (token == constants::token_type::AND
+                   || token == constants::token_type::OR) {
+            std::vector<const node_type*> nodes;
+            flatten(node, token, nodes);
+            std::vector<select_type> operands;
+            for (auto operand : nodes) {
+                operands.emplace_back(compile_select(operand));
+            }
+            if (token == constants::token_type::AND) {
+                return [operands](const batch_type& batch,
+                                  const row_selection& in, rule_bitset& out) {
+                    operands.front()(batch, in, out);
+                    for (std::size_t i = 1; i < operands.size(); ++i) {
+                        row_selection passed(out);
+                        if (passed.empty()) {
+                            break;
+                        }
+                        operands[i](batch, passed, out);
+                    }
+                };
+            }
+            return [operands](const batch_type& batch, const row_selection& in,
+                              rule_bitset& out) {
+                operands.front()(batch, in, out);
+                rule_bitset failed;
+                in.to_bits(failed);
+                failed.and_not(out);
+                rule_bitset part(out.size());
+                for (std::size_t i = 1; i < operands.size(); ++i) {
+                    row_selection rest(failed);
+                    if (rest.empty()) {
+                        break;
+                    }
+                    operands[i](batch, rest, part);
+                    out |= part;
+                    failed.and_not(part);
+                }
+            };
+        }
+        auto bin = base::cast<binary_node>(node);
+        auto left = compile_vector(bin->left().get());
+        auto right = compile_vector(bin->right().get());
+        auto rows = compile_rows(node);
+        return [token, left, right, rows](const batch_type& batch,
+                                          const row_selection& in,
+                                          rule_bitset& out) {
+            vector_value lval;
+            vector_value rval;
+            if (left(batch, in, lval) && right(batch, in, rval)
+                && compare(token, in, lval, rval, out)) {
+                return;
+            }
+            rows(batch, in, out);
+        };
+    }
+
+    /// the regular compiled rule, row by row
+    select_type compile_rows(const node_type* node)
+    {
+        auto rule = compiler_.compile_conjunction({ node });
+        return [rule](const batch_type& batch, const row_selection& in,
+                      rule_bitset& out) {
+            batch_environment<char_type, less_type> env(batch);
+            typename compiler_type::context_type ctx(env);
+            out.clear();
+            in.for_each([&](std::size_t row) {
+                env.set_row(row);
+                if (rule.match(ctx)) {
+                    out.set(row);
+                }
+            });
+        };
+    }
+
+    vector_call compile_vector(const node_type* node)
+    {
+        using namespace objects;
+        if (base::is<ident_node>(node)) {
+            auto slot = symbols()->resolve(node->lexem().value());
+            return [slot](const batch_type& batch, const row_selection&,
+                          vector_value& out) {
+                return read_column(batch.get(slot), out);
+            };
+        } else if (base::is<value_node>(node)) {
+            auto literal = literals_type::to_object(node->lexem());
+            scalar_type value;
+            if (literal) {
+                value = scalar_type::from_object(
+                    compiler_.intern_constant(std::move(literal)));
+            }
+            return [value](const batch_type&, const row_selection&,
+                           vector_value& out) {
+                out.kind = value.kind;
+                out.constant = true;
+                out.value = value;
+                return !value.empty();
+            };
+        } else if (base::is<prefix_node>(node)) {
+            auto negate
+                = (node->lexem().token() == constants::token_type::MINUS);
+            auto value
+                = compile_vector(base::cast<prefix_node>(node)->value().get());
+            return [negate, value](const batch_type& batch,
+                                   const row_selection& in,
+                                   vector_value& out) {
+                vector_value val;
+                return value(batch, in, val) && sign(negate, val, in, out);
+            };
+        }
+        auto bin = base::cast<binary_node>(node);
+        auto op = node->lexem().token();
+        auto left = compile_vector(bin->left().get());
+        auto right = compile_vector(bin->right().get());
+        return [op, left, right](const batch_type& batch,
+                                 const row_selection& in, vector_value& out) {
+            vector_value lval;
+            vector_value rval;
+            return left(batch, in, lval) && right(batch, in, rval)
+                && arithmetic(op, lval, rval, in, out);
+        };
+    }
+
+    static bool read_column(const column_type* col, vector_value& out)
+    {
+        if (!col) {
+            return false;
+        }
+        out.kind = col->kind;
+        out.integers = col->integers;
+        out.floats = col->floats;
+        out.booleans = col->booleans;
+        out.strings = col;
+        return true;
+    }
+
+    /// calls call(reader) with the reader of the kind of the value
+    template <typename CallT>
+    static bool visit(const vector_value& val, CallT&& call)
+    {
+        switch (val.kind) {
+        case kind_type::INTEGER:
+            if (val.constant) {
+                return call(
+                    constant_reader<std::int64_t> { val.value.integer });
+            }
+            return call(column_reader<std::int64_t> { val.integers });
+        case kind_type::FLOATING:
+            if (val.constant) {
+                return call(constant_reader<double> { val.value.floating });
+            }
+            return call(column_reader<double> { val.floats });
+        case kind_type::BOOLEAN:
+            if (val.constant) {
+                return call(constant_reader<bool> { val.value.boolean });
+            }
+            return call(column_reader<bool> { val.booleans });
+        case kind_type::STRING:
+            if (val.constant) {
+                return call(
+                    constant_reader<string_view_type> { val.value.string });
+            }
+            return call(string_reader { val.strings });
+        default:
+            break;
+        }
+        return false;
+    }
+
+    template <typename CallT>
+    static bool with_compare(id_type op, CallT&& call)
+    {
+        switch (op) {
+        case constants::token_type::EQ:
+            return call(std::equal_to<> {});
+        case constants::token_type::NOTEQ:
+            return call(std::not_equal_to<> {});
+        case constants::token_type::LT:
+            return call(std::less<> {});
+        case constants::token_type::GT:
+            return call(std::greater<> {});
+        case constants::token_type::LEQ:
+            return call(std::less_equal<> {});
+        case constants::token_type::GEQ:
+            return call(std::greater_equal<> {});
+        default:
+            break;
+        }
+        return false;
+    }
+
+    /// same kinds compare as they are, integers and floating values as
+    /// doubles; other pairs are left to the rows
+    static bool compare(id_type op, const row_selection& in,
+                        const vector_value& left, const vector_value& right,
+                        rule_bitset& out)
+    {
+        return with_compare(op, [&](auto cmp) {
+            return visit(left, [&](auto lread) {
+                return visit(right, [&](auto rread) {
+                    using ltype = value_of<decltype(lread)>;
+                    using rtype = value_of<decltype(rread)>;
+                    if constexpr (std::is_same<ltype, rtype>::value) {
+                        write(in, out, [&](std::size_t row) {
+                            return cmp(lread(row), rread(row));
+                        });
+                        return true;
+                    } else if constexpr (is_number<ltype> && is_number<rtype>) {
+                        write(in, out, [&](std::size_t row) {
+                            return cmp(static_cast<double>(lread(row)),
+                                       static_cast<double>(rread(row)));
+                        });
+                        return true;
+                    } else {
+                        return false;
+                    }
+                });
+            });
+        });
+    }
+
+    /// a sparse selection is visited row by row, a dense one is
+    /// computed for every row and masked
+    template <typename PredT>
+    static void write(const row_selection& in, rule_bitset& out,
+                      PredT&& pred)
+    {
+        if (in.sparse()) {
+            out.clear();
+            in.for_each([&](std::size_t row) {
+                if (pred(row)) {
+                    out.set(row);
+                }
+            });
+            return;
+        }
+        out.assign(pred);
+        in.restrict(out);
+    }
+
+    /// rows outside a sparse selection are left undefined
+    template <typename T, typename CallT>
+    static void fill(std::vector<T>& dst, const row_selection& in,
+                     CallT&& call)
+    {
+        dst.resize(in.rows());
+        if (in.sparse()) {
+            in.for_each([&](std::size_t row) { dst[row] = call(row); });
+            return;
+        }
+        for (std::size_t row = 0; row < dst.size(); ++row) {
+            dst[row] = call(row);
+        }
+    }
+
+    /// integers wrap around as in operations::integers. integer division
+    /// needs a constant divisor that is not zero, a zero gives no value;
+    /// -1 negates. 'mod' is for integers only
+    static bool arithmetic(id_type op, const vector_value& left,
+                           const vector_value& right, const row_selection& in,
+                           vector_value& out)
+    {
+        namespace integers = operations::integers;
+        auto divisor = right.constant && right.kind == kind_type::INTEGER
+            && right.value.integer != 0;
+        auto minus_one = divisor && right.value.integer == -1;
+        return visit(left, [&](auto lread) {
+            return visit(right, [&](auto rread) {
+                using ltype = value_of<decltype(lread)>;
+                using rtype = value_of<decltype(rread)>;
+                if constexpr (std::is_same<ltype, std::int64_t>::value
+                              && std::is_same<rtype, std::int64_t>::value) {
+                    auto& dst = out.own_integers;
+                    switch (op) {
+                    case constants::token_type::PLUS:
+                        fill(dst, in, [&](auto i) {
+                            return integers::add(lread(i), rread(i));
+                        });
+                        break;
+                    case constants::token_type::MINUS:
+                        fill(dst, in, [&](auto i) {
+                            return integers::sub(lread(i), rread(i));
+                        });
+                        break;
+                    case constants::token_type::MUL:
+                        fill(dst, in, [&](auto i) {
+                            return integers::mul(lread(i), rread(i));
+                        });
+                        break;
+                    case constants::token_type::DIV:
+                        if (!divisor) {
+                            return false;
+                        } else if (minus_one) {
+                            fill(dst, in, [&](auto i) {
+                                return integers::neg(lread(i));
+                            });
+                            break;
+                        }
+                        fill(dst, in,
+                             [&](auto i) { return lread(i) / rread(i); });
+                        break;
+                    case constants::token_type::MOD:
+                        if (!divisor) {
+                            return false;
+                        } else if (minus_one) {
+                            fill(dst, in, [](auto) { return std::int64_t(0); });
+                            break;
+                        }
+                        fill(dst, in,
+                             [&](auto i) { return lread(i) % rread(i); });
+                        break;
+                    default:
+                        return false;
+                    }
+                    out.kind = kind_type::INTEGER;
+                    out.integers = dst.data();
+                    return true;
+                } else if constexpr (is_number<ltype> && is_number<rtype>) {
+                    auto& dst = out.own_floats;
+                    auto l = [&](std::size_t i) {
+                        return static_cast<double>(lread(i));
+                    };
+                    auto r = [&](std::size_t i) {
+                        return static_cast<double>(rread(i));
+                    };
+                    switch (op) {
+                    case constants::token_type::PLUS:
+                        fill(dst, in, [&](auto i) { return l(i) + r(i); });
+                        break;
+                    case constants::token_type::MINUS:
+                        fill(dst, in, [&](auto i) { return l(i) - r(i); });
+                        break;
+                    case constants::token_type::MUL:
+                        fill(dst, in, [&](auto i) { return l(i) * r(i); });
+                        break;
+                    case constants::token_type::DIV:
+                        fill(dst, in, [&](auto i) { return l(i) / r(i); });
+                        break;
+                    default:
+                        return false;
+                    }
+                    out.kind = kind_type::FLOATING;
+                    out.floats = dst.data();
+                    return true;
+                } else {
+                    return false;
+                }
+            });
+        });
+    }
+
+    static bool sign(bool negate, vector_value& val, const row_selection& in,
+                     vector_value& out)
+    {
+        if (val.kind != kind_type::INTEGER && val.kind != kind_type::FLOATING) {
+            return false;
+        } else if (!negate) {
+            out = std::move(val);
+            return true;
+        }
+        return visit(val, [&](auto read) {
+            using type = value_of<decltype(read)>;
+            if constexpr (std::is_same<type, std::int64_t>::value) {
+                fill(out.own_integers, in, [&](auto i) {
+                    return operations::integers::neg(read(i));
+                });
+                out.kind = kind_type::INTEGER;
+                out.integers = out.own_integers.data();
+                return true;
+            } else if constexpr (std::is_same<type, double>::value) {
+                fill(out.own_floats, in, [&](auto i) { return -read(i); });
+                out.kind = kind_type::FLOATING;
+                out.floats = out.own_floats.data();
+                return true;
+            } else {
+                return false;
+            }
+        });
+    }
+
+    compiler_type compiler_;
+};
+
+}
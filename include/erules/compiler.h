@@ -0,0 +1,1283 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <unordered_map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "erules/adaptive.h"
+#include "erules/ast.h"
+#include "erules/constant_pool.h"
+#include "erules/environment.h"
+#include "erules/interval.h"
+#include "erules/literals.h"
+#include "erules/lookup.h"
+#include "erules/optimizer.h"
+#include "erules/rules_basic_operations.h"
+#include "erules/scalar.h"
+#include "erules/scan.h"
+
+namespace erules {
+
+template <typename CharT, typename LessT = std::less<CharT>>
+class compiled_rule {
+public:
+    using environment_type = environment<CharT, LessT>;
+    using context_type = context<CharT, LessT>;
+    using scalar_type = scalar<CharT>;
+    using call_type = std::function<scalar_type(context_type&)>;
+    using predicate_type = std::function<bool(context_type&)>;
+    using constant_pool_type = constant_pool<CharT>;
+    using chain_type = adaptive_chain<context_type>;
+    using chain_list = std::vector<std::shared_ptr<chain_type>>;
+
+    /// the closures refer to the constants, the rule keeps them alive
+    compiled_rule(call_type call, predicate_type predicate,
+                  std::shared_ptr<const constant_pool_type> constants = {},
+                  chain_list chains = {})
+        : call_(std::move(call))
+        , predicate_(std::move(predicate))
+        , constants_(std::move(constants))
+        , chains_(std::move(chains))
+    {
+    }
+
+    /// strings and objects of the result live in the context
+    /// (or the environment, or the rule)
+    scalar_type evaluate(context_type& ctx) const
+    {
+        return call_(ctx);
+    }
+
+    objects::base::uptr evaluate(const environment_type& env) const
+    {
+        context_type ctx(env);
+        return call_(ctx).to_object();
+    }
+
+    /// drops the temporaries of the context
+    bool match(context_type& ctx) const
+    {
+        auto result = predicate_(ctx);
+        ctx.reset();
+        return result;
+    }
+
+    bool match(const environment_type& env) const
+    {
+        context_type ctx(env);
+        return predicate_(ctx);
+    }
+
+    const std::shared_ptr<const constant_pool_type>& constants() const
+    {
+        return constants_;
+    }
+
+    /// adaptive 'and'/'or' chains, in a stable order for the same rule
+    const chain_list& chains() const
+    {
+        return chains_;
+    }
+
+    /// one line per operand:
+    /// chain operand chain_size evaluations passes nanoseconds
+    void save_statistics(std::ostream& out) const
+    {
+        for (std::size_t c = 0; c < chains_.size(); ++c) {
+            auto stats = chains_[c]->get_statistics();
+            for (std::size_t o = 0; o < stats.size(); ++o) {
+                out << c << " " << o << " " << stats.size() << " "
+                    << stats[o].evaluations << " " << stats[o].passes << " "
+                    << stats[o].nanoseconds << "\n";
+            }
+        }
+    }
+
+    /// lines for chains this rule doesn't have are skipped,
+    /// the chains are reordered afterwards
+    void load_statistics(std::istream& in)
+    {
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty()) {
+                continue;
+            }
+            std::istringstream fields(line);
+            std::size_t chain = 0;
+            std::size_t operand = 0;
+            std::size_t size = 0;
+            typename chain_type::statistics stats;
+            if (!(fields >> chain >> operand >> size >> stats.evaluations
+                  >> stats.passes >> stats.nanoseconds)) {
+                throw std::runtime_error("compiled_rule: bad statistics '"
+                                         + line + "'");
+            }
+            if (chain < chains_.size() && chains_[chain]->size() == size
+                && operand < size) {
+                chains_[chain]->set_statistics(operand, stats);
+            }
+        }
+        for (auto& chain : chains_) {
+            chain->reorder();
+        }
+    }
+
+private:
+    call_type call_;
+    predicate_type predicate_;
+    std::shared_ptr<const constant_pool_type> constants_;
+    chain_list chains_;
+};
+
+/// Predicates of many rules by the structure of their subtree.
+/// Structurally equal subtrees get one closure. Once a subtree occurs a
+/// second time its result is remembered in the context, so it runs at
+/// most once per record until context::forget()
+template <typename CharT, typename LessT = std::less<CharT>>
+class shared_predicates {
+public:
+    using context_type = context<CharT, LessT>;
+    using predicate_type = std::function<bool(context_type&)>;
+    using string_type = std::basic_string<CharT>;
+
+    /// the predicate of the subtree with key; make() builds it the first
+    /// time
+    template <typename MakeT>
+    predicate_type get(const string_type& key, MakeT&& make)
+    {
+        ++occurrences_;
+        auto found = entries_.find(key);
+        if (found != entries_.end()) {
+            auto& value = *found->second;
+            if (!value.remembered) {
+                value.remembered = true;
+                value.slot = slots_++;
+            }
+            return wrap(found->second);
+        }
+        auto value = std::make_shared<entry>();
+        value->predicate = make();
+        entries_.emplace(key, value);
+        return wrap(std::move(value));
+    }
+
+    /// predicate subtrees compiled, with repetitions
+    std::size_t occurrences() const
+    {
+        return occurrences_;
+    }
+
+    /// distinct predicate subtrees
+    std::size_t distinct() const
+    {
+        return entries_.size();
+    }
+
+    /// distinct subtrees that occur more than once
+    std::size_t shared() const
+    {
+        return slots_;
+    }
+
+    /// occurrences per distinct subtree, 1 is no sharing at all
+    double ratio() const
+    {
+        return entries_.empty()
+            ? 1.0
+            : static_cast<double>(occurrences_) / entries_.size();
+    }
+
+private:
+    struct entry {
+        predicate_type predicate;
+        std::size_t slot = 0;
+        bool remembered = false;
+    };
+
+    static predicate_type wrap(std::shared_ptr<const entry> value)
+    {
+        return [value](context_type& ctx) {
+            if (!value->remembered) {
+                return value->predicate(ctx);
+            }
+            bool res = false;
+            if (!ctx.recall(value->slot, res)) {
+                res = value->predicate(ctx);
+                ctx.remember(value->slot, res);
+            }
+            return res;
+        };
+    }
+
+    std::unordered_map<string_type, std::shared_ptr<entry>> entries_;
+    std::size_t occurrences_ = 0;
+    std::size_t slots_ = 0;
+};
+
+/// Turns a parsed rule into a tree of closures.
+/// The tree is optimized first, and membership tests with constant
+/// operands get dedicated predicates that don't touch the operation maps.
+/// Closures pass unboxed scalars; numbers, booleans and string
+/// comparisons never allocate, string + and * write to the arena of the
+/// context. Anything else is boxed and goes through the operation maps.
+/// 'and'/'or' chains reorder themselves by the measured cost and
+/// selectivity of their operands unless disabled.
+template <typename LexemT>
+class compiler {
+public:
+    using lexem_type = LexemT;
+    using char_type = typename lexem_type::char_type;
+    using less_type = typename lexem_type::less_type;
+    using id_type = typename lexem_type::id_type;
+    using string_type = std::basic_string<char_type>;
+    using node_type = objects::ast::node<lexem_type>;
+    using node_uptr = typename node_type::uptr;
+    using rule_type = compiled_rule<char_type, less_type>;
+    using environment_type = typename rule_type::environment_type;
+    using context_type = typename rule_type::context_type;
+    using symbol_table_type = typename environment_type::symbol_table_type;
+    using call_type = typename rule_type::call_type;
+    using predicate_type = typename rule_type::predicate_type;
+    using constant_pool_type = typename rule_type::constant_pool_type;
+    using chain_type = typename rule_type::chain_type;
+    using binary_type = objects::oprerations::binary<id_type>;
+    using unary_type = objects::oprerations::unary<id_type>;
+    using literals_type = literals<lexem_type>;
+    using scalar_type = typename rule_type::scalar_type;
+    using scalar_operations_type
+        = operations::scalar_operations<char_type, less_type>;
+    using shared_type = shared_predicates<char_type, less_type>;
+
+    compiler()
+        : compiler(std::make_shared<symbol_table_type>())
+    {
+    }
+
+    compiler(std::shared_ptr<symbol_table_type> symbols)
+        : compiler(operations::binary_operations<char_type, less_type>::get(),
+                   operations::unary_operations<char_type, less_type>::get(),
+                   std::move(symbols))
+    {
+    }
+
+    compiler(binary_type binops, unary_type unops,
+             std::shared_ptr<symbol_table_type> symbols)
+        : binary_(std::make_shared<binary_type>(std::move(binops)))
+        , unary_(std::make_shared<unary_type>(std::move(unops)))
+        , symbols_(std::move(symbols))
+        , constants_(std::make_shared<constant_pool_type>())
+        , optimizer_(*binary_, *unary_)
+    {
+    }
+
+    /// identifiers of every compiled rule, by slot
+    const std::shared_ptr<symbol_table_type>& symbols() const
+    {
+        return symbols_;
+    }
+
+    /// literals of every rule compiled since the last reset_constants()
+    std::shared_ptr<const constant_pool_type> constants() const
+    {
+        return constants_;
+    }
+
+    /// rules compiled from now on intern into a new pool. the rules
+    /// compiled before keep the old one alive for as long as they live
+    void reset_constants()
+    {
+        constants_ = std::make_shared<constant_pool_type>();
+    }
+
+    /// adds a literal to the constants, see constant_pool::intern
+    objects::base::cptr intern_constant(objects::base::uptr value)
+    {
+        return constants_->intern(std::move(value));
+    }
+
+    void set_adaptive(bool value)
+    {
+        adaptive_ = value;
+    }
+
+    bool adaptive() const
+    {
+        return adaptive_;
+    }
+
+    rule_type compile(const node_type* root)
+    {
+        if (!root) {
+            throw std::runtime_error("compiler: empty rule");
+        }
+        auto optimized = optimizer_.optimize(root);
+        chains_.clear();
+        /// one of the two is compiled, the other wraps it
+        if (is_logical(optimized.get())) {
+            auto predicate = compile_predicate(optimized.get());
+            return rule_type(to_call(predicate), std::move(predicate),
+                             constants_, std::move(chains_));
+        }
+        auto call = compile_call(optimized.get());
+        return rule_type(call, to_predicate(call), constants_,
+                         std::move(chains_));
+    }
+
+    rule_type compile(const node_uptr& root)
+    {
+        return compile(root.get());
+    }
+
+    node_uptr optimize(const node_type* root)
+    {
+        return optimizer_.optimize(root);
+    }
+
+    /// 'a and b and ...' over nodes that are already optimized.
+    /// an empty list is always true
+    rule_type compile_conjunction(const std::vector<const node_type*>& nodes)
+    {
+        chains_.clear();
+        std::vector<predicate_type> operands;
+        for (auto node : nodes) {
+            operands.emplace_back(compile_predicate(node));
+        }
+        auto predicate = combine(true, std::move(operands));
+        return rule_type(to_call(predicate), predicate, constants_,
+                         std::move(chains_));
+    }
+
+    /// as above, the predicates go through shared: subtrees equal to
+    /// those of other rules compiled with it are reused
+    rule_type compile_conjunction(const std::vector<const node_type*>& nodes,
+                                  shared_type& shared)
+    {
+        sharing_ = &shared;
+        try {
+            auto res = compile_conjunction(nodes);
+            sharing_ = nullptr;
+            return res;
+        } catch (...) {
+            sharing_ = nullptr;
+            throw;
+        }
+    }
+
+    call_type compile_call(const node_type* node)
+    {
+        using namespace objects;
+        if (base::is<value_node>(node)) {
+            return compile_value(node);
+        } else if (base::is<ident_node>(node)) {
+            auto slot = symbols_->resolve(node->lexem().value());
+            return [slot](context_type& ctx) { return ctx.read(slot); };
+        } else if (is_logical(node)) {
+            return to_call(compile_predicate(node));
+        } else if (base::is<binary_node>(node)) {
+            return compile_binary(base::cast<binary_node>(node));
+        } else if (base::is<prefix_node>(node)) {
+            return compile_prefix(base::cast<prefix_node>(node));
+        }
+        throw std::runtime_error(std::string("compiler: unsupported node ")
+                                 + (node ? node->type_name() : "null"));
+    }
+
+    /// nodes whose value is always a boolean
+    static bool is_logical(const node_type* node)
+    {
+        using namespace objects;
+        if (base::is<prefix_node>(node)) {
+            return node->lexem().token() == constants::token_type::NOT;
+        } else if (!base::is<binary_node>(node)) {
+            return false;
+        }
+        switch (node->lexem().token()) {
+        case constants::token_type::AND:
+        case constants::token_type::OR:
+        case constants::token_type::IN:
+        case constants::token_type::EQ:
+        case constants::token_type::NOTEQ:
+        case constants::token_type::LT:
+        case constants::token_type::GT:
+        case constants::token_type::LEQ:
+        case constants::token_type::GEQ:
+        case constants::token_type::STARTSWITH:
+            return true;
+        default:
+            break;
+        }
+        return false;
+    }
+
+    predicate_type compile_predicate(const node_type* node)
+    {
+        string_type key;
+        if (sharing_ && structure(node, key)) {
+            return sharing_->get(key, [this, node] { return build(node); });
+        }
+        return build(node);
+    }
+
+    /// boolean is itself, numbers are true if not zero, strings if not empty
+    static bool to_bool(const scalar_type& value)
+    {
+        switch (value.kind) {
+        case scalar_type::kind_type::BOOLEAN:
+            return value.boolean;
+        case scalar_type::kind_type::INTEGER:
+            return value.integer != 0;
+        case scalar_type::kind_type::FLOATING:
+            return value.floating != 0.0;
+        case scalar_type::kind_type::STRING:
+            return !value.string.empty();
+        case scalar_type::kind_type::OBJECT:
+            return to_bool(value.object);
+        default:
+            break;
+        }
+        return false;
+    }
+
+    static bool to_bool(objects::base::cptr value)
+    {
+        using namespace objects;
+        if (base::is<boolean>(value)) {
+            return base::cast<boolean>(value)->value();
+        } else if (base::is<number>(value)) {
+            return base::cast<number>(value)->value() != 0;
+        } else if (base::is<floating>(value)) {
+            return base::cast<floating>(value)->value() != 0.0;
+        } else if (base::is<string_object>(value)) {
+            return !base::cast<string_object>(value)->value().empty();
+        }
+        return false;
+    }
+
+    /// unboxed when the kinds allow it, otherwise the operands are boxed
+    /// in the arena of the context and the result is kept there.
+    /// no operand, no value
+    static scalar_type call_binary(const binary_type& binops, id_type op,
+                                   const scalar_type& left,
+                                   const scalar_type& right,
+                                   context_type& ctx)
+    {
+        scalar_type res;
+        if (left.empty() || right.empty()
+            || scalar_operations_type::binary(op, left, right, res)
+            || string_call(op, left, right, ctx, res)) {
+            return res;
+        }
+        arena::scope scope(ctx.storage());
+        objects::base::uptr lholder;
+        objects::base::uptr rholder;
+        return scalar_type::from_object(ctx.keep(
+            binops.call(op, box(left, lholder), box(right, rholder))));
+    }
+
+    /// string + string and string * count as the operation maps do them,
+    /// written to the arena of the context. the result views the arena
+    static bool string_call(id_type op, const scalar_type& left,
+                            const scalar_type& right, context_type& ctx,
+                            scalar_type& out)
+    {
+        using kind_type = typename scalar_type::kind_type;
+        if (op == constants::token_type::PLUS && left.kind == kind_type::STRING
+            && right.kind == kind_type::STRING) {
+            auto size = left.string.size() + right.string.size();
+            auto data = allocate_string(ctx, size);
+            std::copy(left.string.begin(), left.string.end(), data);
+            std::copy(right.string.begin(), right.string.end(),
+                      data + left.string.size());
+            out = scalar_type::make_string(string_view_type(data, size));
+            return true;
+        } else if (op != constants::token_type::MUL) {
+            return false;
+        }
+        auto str = &left;
+        auto count = &right;
+        if (left.kind == kind_type::INTEGER) {
+            std::swap(str, count);
+        }
+        if (str->kind != kind_type::STRING
+            || count->kind != kind_type::INTEGER) {
+            return false;
+        }
+        auto part = str->string.size();
+        std::size_t times = count->integer > 0
+            ? static_cast<std::size_t>(count->integer)
+            : 0;
+        auto most = static_cast<std::size_t>(-1) / sizeof(char_type);
+        if (part != 0 && times > most / part) {
+            return false;
+        }
+        auto data = allocate_string(ctx, part * times);
+        for (std::size_t i = 0; i < times; ++i) {
+            std::copy(str->string.begin(), str->string.end(),
+                      data + i * part);
+        }
+        out = scalar_type::make_string(string_view_type(data, part * times));
+        return true;
+    }
+
+    static char_type* allocate_string(context_type& ctx, std::size_t size)
+    {
+        return static_cast<char_type*>(ctx.storage().allocate(
+            size * sizeof(char_type), alignof(char_type)));
+    }
+
+    static objects::base::cptr box(const scalar_type& value,
+                                   objects::base::uptr& holder)
+    {
+        if (value.kind == scalar_type::kind_type::OBJECT) {
+            return value.object;
+        }
+        holder = value.to_object();
+        return holder.get();
+    }
+
+    static bool is_array(const scalar_type& value)
+    {
+        using namespace objects;
+        if (value.kind != scalar_type::kind_type::OBJECT) {
+            return false;
+        }
+        return base::is<number_array>(value.object)
+            || base::is<floating_array>(value.object)
+            || base::is<boolean_array>(value.object)
+            || base::is<string_array_type>(value.object)
+            || base::is<array>(value.object);
+    }
+
+    static bool is_interval(const scalar_type& value)
+    {
+        using namespace objects;
+        return value.kind == scalar_type::kind_type::OBJECT
+            && (base::is<interval<number>>(value.object)
+                || base::is<interval<floating>>(value.object));
+    }
+
+    /// 'value in r' with r an interval object; numbers of both kinds
+    /// are compared with the inline endpoints
+    static bool interval_contains(const scalar_type& value,
+                                  objects::base::cptr range)
+    {
+        using namespace objects;
+        using kind_type = typename scalar_type::kind_type;
+        if (value.kind != kind_type::INTEGER
+            && value.kind != kind_type::FLOATING) {
+            return false;
+        }
+        if (base::is<interval<number>>(range)) {
+            auto inter = base::cast<interval<number>>(range);
+            return value.kind == kind_type::INTEGER
+                ? inter->contains(value.integer)
+                : inter->contains(value.floating);
+        }
+        auto inter = base::cast<interval<floating>>(range);
+        return value.kind == kind_type::INTEGER
+            ? inter->contains(value.integer)
+            : inter->contains(value.floating);
+    }
+
+    /// typed arrays are scanned in place,
+    /// elements of the heterogeneous array are compared one by one
+    static bool array_contains(const binary_type& binops,
+                               const scalar_type& value,
+                               objects::base::cptr arr, context_type& ctx)
+    {
+        using namespace objects;
+        using kind_type = typename scalar_type::kind_type;
+        if (base::is<number_array>(arr)) {
+            auto& data = base::cast<number_array>(arr)->value();
+            if (value.kind == kind_type::FLOATING
+                && constant_list::is_integral(value.floating)) {
+                return scan::contains(
+                    data.data(), data.size(),
+                    static_cast<std::int64_t>(value.floating));
+            }
+            return value.kind == kind_type::INTEGER
+                && scan::contains(data.data(), data.size(), value.integer);
+        } else if (base::is<floating_array>(arr)) {
+            auto& data = base::cast<floating_array>(arr)->value();
+            if (value.kind == kind_type::INTEGER) {
+                return scan::contains(data.data(), data.size(),
+                                      static_cast<double>(value.integer));
+            }
+            return value.kind == kind_type::FLOATING
+                && scan::contains(data.data(), data.size(), value.floating);
+        } else if (base::is<boolean_array>(arr)) {
+            auto& data = base::cast<boolean_array>(arr)->value();
+            return value.kind == kind_type::BOOLEAN
+                && scan::contains(data.data(), data.size(),
+                                  static_cast<std::uint8_t>(value.boolean));
+        } else if (base::is<string_array_type>(arr)) {
+            auto strings = base::cast<string_array_type>(arr);
+            if (value.kind != kind_type::STRING) {
+                return false;
+            }
+            for (std::size_t i = 0; i < strings->size(); ++i) {
+                if ((*strings)[i] == value.string) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        for (auto& element : base::cast<array>(arr)->value()) {
+            auto eval = scalar_type::from_object(element.get());
+            if (to_bool(call_binary(binops, constants::token_type::EQ, value,
+                                    eval, ctx))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    using value_node = objects::ast::value<lexem_type>;
+    using ident_node = objects::ast::ident<lexem_type>;
+    using binary_node = objects::ast::binary_operation<lexem_type>;
+    using prefix_node = objects::ast::prefix_operation<lexem_type>;
+    using string_object = typename literals_type::string_object;
+    using string_array_type = objects::string_array<char_type>;
+
+    using string_view_type = typename scalar_type::string_view_type;
+
+    /// appends a key that is equal for structurally equal subtrees: the
+    /// node kind, the token, the value after its length, then the
+    /// operands. false for nodes that are never shared
+    static bool structure(const node_type* node, string_type& key)
+    {
+        using namespace objects;
+        auto append = [&key](char kind, const node_type* item) {
+            auto value = item->lexem().value();
+            key += static_cast<char_type>(kind);
+            append_number(key, static_cast<std::size_t>(item->lexem().token()));
+            append_number(key, value.size());
+            key += value;
+        };
+        if (!node) {
+            return false;
+        } else if (base::is<ident_node>(node)) {
+            append('i', node);
+            return true;
+        } else if (base::is<value_node>(node)) {
+            append('v', node);
+            return true;
+        } else if (base::is<binary_node>(node)) {
+            auto bin = base::cast<binary_node>(node);
+            append('b', node);
+            return structure(bin->left().get(), key)
+                && structure(bin->right().get(), key);
+        } else if (base::is<prefix_node>(node)) {
+            append('p', node);
+            return structure(base::cast<prefix_node>(node)->value().get(),
+                             key);
+        }
+        return false;
+    }
+
+    static void append_number(string_type& key, std::size_t value)
+    {
+        for (auto c : std::to_string(value)) {
+            key += static_cast<char_type>(c);
+        }
+        key += static_cast<char_type>(':');
+    }
+
+    predicate_type build(const node_type* node)
+    {
+        using namespace objects;
+        if (base::is<binary_node>(node)) {
+            auto bin = base::cast<binary_node>(node);
+            switch (bin->lexem().token()) {
+            case constants::token_type::AND:
+                return compile_logic(bin);
+            case constants::token_type::OR:
+                if (auto ranges = compile_range_union(bin)) {
+                    return ranges;
+                }
+                return compile_logic(bin);
+            case constants::token_type::IN:
+                return compile_in(bin);
+            case constants::token_type::EQ:
+            case constants::token_type::NOTEQ:
+            case constants::token_type::LT:
+            case constants::token_type::GT:
+            case constants::token_type::LEQ:
+            case constants::token_type::GEQ:
+                return compile_compare(bin);
+            case constants::token_type::STARTSWITH:
+                return compile_starts_with(bin);
+            default:
+                break;
+            }
+        } else if (base::is<prefix_node>(node)) {
+            auto pref = base::cast<prefix_node>(node);
+            if (pref->lexem().token() == constants::token_type::NOT) {
+                auto value = compile_predicate(pref->value().get());
+                return [value](context_type& ctx) { return !value(ctx); };
+            }
+        }
+        return to_predicate(compile_call(node));
+    }
+
+    struct constant_list {
+        lookup::membership<std::int64_t> numbers;
+        lookup::membership<double> floats;
+        lookup::membership<string_view_type> strings;
+        interval_set<std::int64_t> integer_ranges;
+        interval_set<double> floating_ranges;
+        bool booleans[2] = { false, false };
+
+        bool contains(const scalar_type& value) const
+        {
+            switch (value.kind) {
+            case scalar_type::kind_type::INTEGER:
+                return numbers.contains(value.integer)
+                    || (!floats.empty()
+                        && floats.contains(static_cast<double>(value.integer)))
+                    || in_ranges(value.integer);
+            case scalar_type::kind_type::FLOATING:
+                return floats.contains(value.floating)
+                    || (!numbers.empty() && is_integral(value.floating)
+                        && numbers.contains(
+                            static_cast<std::int64_t>(value.floating)))
+                    || in_ranges(value.floating);
+            case scalar_type::kind_type::STRING:
+                return strings.contains(value.string);
+            case scalar_type::kind_type::BOOLEAN:
+                return booleans[value.boolean];
+            default:
+                break;
+            }
+            return false;
+        }
+
+        template <typename T>
+        bool in_ranges(T value) const
+        {
+            return integer_ranges.contains(value)
+                || floating_ranges.contains(value);
+        }
+
+        static bool is_integral(double num)
+        {
+            return num >= -9.2e18 && num <= 9.2e18 && std::trunc(num) == num;
+        }
+    };
+
+    /// bounds of a range with literal numeric ends
+    struct range_constant {
+        bool integral = false;
+        numeric_interval<std::int64_t> integers;
+        numeric_interval<double> floats;
+    };
+
+    /// the whole chain of one operator is a single adaptive_chain;
+    /// without adaptation, or for very long chains, nested closures
+    predicate_type compile_logic(const binary_node* node)
+    {
+        auto token = node->lexem().token();
+        auto conjunction = (token == constants::token_type::AND);
+        std::vector<const node_type*> nodes;
+        flatten(node, token, nodes);
+        std::vector<predicate_type> operands;
+        for (auto operand : nodes) {
+            operands.emplace_back(compile_predicate(operand));
+        }
+        return combine(conjunction, std::move(operands));
+    }
+
+    predicate_type combine(bool conjunction,
+                           std::vector<predicate_type> operands)
+    {
+        if (operands.empty()) {
+            return [conjunction](context_type&) { return conjunction; };
+        } else if (operands.size() == 1) {
+            return operands.front();
+        } else if (adaptive_ && operands.size() <= chain_type::max_size) {
+            auto chain = std::make_shared<chain_type>(conjunction,
+                                                      std::move(operands));
+            chains_.emplace_back(chain);
+            return [chain](context_type& ctx) { return (*chain)(ctx); };
+        }
+        auto result = operands.front();
+        for (std::size_t i = 1; i < operands.size(); ++i) {
+            auto left = std::move(result);
+            auto right = operands[i];
+            if (conjunction) {
+                result = [left, right](context_type& ctx) {
+                    return left(ctx) && right(ctx);
+                };
+            } else {
+                result = [left, right](context_type& ctx) {
+                    return left(ctx) || right(ctx);
+                };
+            }
+        }
+        return result;
+    }
+
+    static call_type to_call(predicate_type predicate)
+    {
+        return [predicate](context_type& ctx) {
+            return scalar_type::make_boolean(predicate(ctx));
+        };
+    }
+
+    static predicate_type to_predicate(call_type call)
+    {
+        return [call](context_type& ctx) { return to_bool(call(ctx)); };
+    }
+
+    /// strings are viewed in the constant pool
+    call_type compile_value(const node_type* node)
+    {
+        auto val = constants_->intern_scalar(
+            literals_type::to_object(node->lexem()));
+        if (val.empty()) {
+            throw std::runtime_error("compiler: bad literal");
+        }
+        return [val](context_type&) { return val; };
+    }
+
+    call_type compile_binary(const binary_node* node)
+    {
+        auto op = node->lexem().token();
+        auto left = compile_call(node->left().get());
+        auto right = compile_call(node->right().get());
+        auto binops = binary_;
+        return [binops, op, left, right](context_type& ctx) {
+            auto lval = left(ctx);
+            auto rval = right(ctx);
+            return call_binary(*binops, op, lval, rval, ctx);
+        };
+    }
+
+    call_type compile_prefix(const prefix_node* node)
+    {
+        auto op = node->lexem().token();
+        auto value = compile_call(node->value().get());
+        auto unops = unary_;
+        return [unops, op, value](context_type& ctx) {
+            auto val = value(ctx);
+            scalar_type res;
+            if (val.empty() || scalar_operations_type::unary(op, val, res)) {
+                return res;
+            }
+            arena::scope scope(ctx.storage());
+            objects::base::uptr holder;
+            return scalar_type::from_object(
+                ctx.keep(unops->call(op, box(val, holder))));
+        };
+    }
+
+    static id_type flip(id_type op)
+    {
+        switch (op) {
+        case constants::token_type::LT:
+            return constants::token_type::GT;
+        case constants::token_type::GT:
+            return constants::token_type::LT;
+        case constants::token_type::LEQ:
+            return constants::token_type::GEQ;
+        case constants::token_type::GEQ:
+            return constants::token_type::LEQ;
+        default:
+            break;
+        }
+        return op;
+    }
+
+    /// comparison with a literal is specialized on the literal kind
+    predicate_type compile_compare(const binary_node* node)
+    {
+        auto op = node->lexem().token();
+        auto other = node->left().get();
+        auto literal = literal_of(node->right().get());
+        if (!literal) {
+            literal = literal_of(node->left().get());
+            other = node->right().get();
+            op = flip(op);
+        }
+        if (literal) {
+            auto constant = constants_->intern(std::move(literal));
+            auto value = compile_call(other);
+            switch (op) {
+            case constants::token_type::EQ:
+                return make_compare<std::equal_to<>>(value, constant);
+            case constants::token_type::NOTEQ:
+                return make_compare<std::not_equal_to<>>(value, constant);
+            case constants::token_type::LT:
+                return make_compare<std::less<>>(value, constant);
+            case constants::token_type::GT:
+                return make_compare<std::greater<>>(value, constant);
+            case constants::token_type::LEQ:
+                return make_compare<std::less_equal<>>(value, constant);
+            case constants::token_type::GEQ:
+                return make_compare<std::greater_equal<>>(value, constant);
+            default:
+                break;
+            }
+        }
+
+        op = node->lexem().token();
+        auto left = compile_call(node->left().get());
+        auto right = compile_call(node->right().get());
+        auto binops = binary_;
+        return [binops, op, left, right](context_type& ctx) {
+            auto lval = left(ctx);
+            auto rval = right(ctx);
+            return to_bool(call_binary(*binops, op, lval, rval, ctx));
+        };
+    }
+
+    /// a literal prefix is a view into the pool
+    predicate_type compile_starts_with(const binary_node* node)
+    {
+        using namespace objects;
+        using kind_type = typename scalar_type::kind_type;
+        auto value = compile_call(node->left().get());
+        auto literal = literal_of(node->right().get());
+        if (base::is<string_object>(literal.get())) {
+            auto constant = constants_->intern(std::move(literal));
+            string_view_type prefix
+                = base::cast<string_object>(constant)->value();
+            return [value, prefix](context_type& ctx) {
+                auto val = value(ctx);
+                return val.kind == kind_type::STRING
+                    && operations::starts_with(val.string, prefix);
+            };
+        }
+        auto op = node->lexem().token();
+        auto prefix = compile_call(node->right().get());
+        auto binops = binary_;
+        return [binops, op, value, prefix](context_type& ctx) {
+            auto lval = value(ctx);
+            auto rval = prefix(ctx);
+            return to_bool(call_binary(*binops, op, lval, rval, ctx));
+        };
+    }
+
+    template <typename CmpT>
+    static predicate_type make_compare(call_type value,
+                                       objects::base::cptr literal)
+    {
+        using namespace objects;
+        using kind_type = typename scalar_type::kind_type;
+        if (base::is<number>(literal)) {
+            auto num = base::cast<number>(literal)->value();
+            return [value, num](context_type& ctx) {
+                auto val = value(ctx);
+                switch (val.kind) {
+                case kind_type::INTEGER:
+                    return CmpT {}(val.integer, num);
+                case kind_type::FLOATING:
+                    return CmpT {}(val.floating, static_cast<double>(num));
+                default:
+                    break;
+                }
+                return false;
+            };
+        } else if (base::is<floating>(literal)) {
+            auto num = base::cast<floating>(literal)->value();
+            return [value, num](context_type& ctx) {
+                auto val = value(ctx);
+                switch (val.kind) {
+                case kind_type::INTEGER:
+                    return CmpT {}(static_cast<double>(val.integer), num);
+                case kind_type::FLOATING:
+                    return CmpT {}(val.floating, num);
+                default:
+                    break;
+                }
+                return false;
+            };
+        } else if (base::is<boolean>(literal)) {
+            auto flag = base::cast<boolean>(literal)->value();
+            return [value, flag](context_type& ctx) {
+                auto val = value(ctx);
+                return val.kind == kind_type::BOOLEAN
+                    && CmpT {}(val.boolean, flag);
+            };
+        }
+        string_view_type str = base::cast<string_object>(literal)->value();
+        return [value, str](context_type& ctx) {
+            auto val = value(ctx);
+            return val.kind == kind_type::STRING && CmpT {}(val.string, str);
+        };
+    }
+
+    static bool is_range(const node_type* node)
+    {
+        if (!objects::base::is<binary_node>(node)) {
+            return false;
+        }
+        auto token = node->lexem().token();
+        return token == constants::token_type::DOTDOT
+            || token == constants::token_type::DOTDOTDOT;
+    }
+
+    static bool literal_range(const node_type* node, range_constant& out)
+    {
+        using namespace objects;
+        if (!is_range(node)) {
+            return false;
+        }
+        auto range = base::cast<binary_node>(node);
+        auto exclusive
+            = (range->lexem().token() == constants::token_type::DOTDOTDOT);
+        auto low = literal_of(range->left().get());
+        auto high = literal_of(range->right().get());
+        if (!is_numeric(low.get()) || !is_numeric(high.get())) {
+            return false;
+        }
+        out.integral = base::is<number>(low.get())
+            && base::is<number>(high.get());
+        if (out.integral) {
+            out.integers = { base::cast<number>(low.get())->value(),
+                             base::cast<number>(high.get())->value(),
+                             exclusive };
+        }
+        out.floats
+            = { to_double(low.get()), to_double(high.get()), exclusive };
+        return true;
+    }
+
+    predicate_type compile_in(const binary_node* node)
+    {
+        auto container = node->right().get();
+        range_constant range;
+        if (literal_range(container, range)) {
+            auto value = compile_call(node->left().get());
+            return range.integral ? make_range(std::move(value), range.integers)
+                                  : make_range(std::move(value), range.floats);
+        } else if (is_range(container)) {
+            auto dynamic = objects::base::cast<binary_node>(container);
+            auto exclusive = (dynamic->lexem().token()
+                              == constants::token_type::DOTDOTDOT);
+            return compile_dynamic_range(compile_call(node->left().get()),
+                                         dynamic, exclusive);
+        }
+        return compile_list(node->left().get(), container);
+    }
+
+    template <typename T>
+    static predicate_type make_range(call_type value,
+                                     numeric_interval<T> range)
+    {
+        return [value, range](context_type& ctx) {
+            auto val = value(ctx);
+            switch (val.kind) {
+            case scalar_type::kind_type::INTEGER:
+                return range.contains(val.integer);
+            case scalar_type::kind_type::FLOATING:
+                return range.contains(val.floating);
+            default:
+                break;
+            }
+            return false;
+        };
+    }
+
+    /// 'x in 1..5 or x in 10..20 or ...' over one identifier
+    /// is a single search in a set of disjoint intervals.
+    /// returns an empty predicate for any other 'or'
+    predicate_type compile_range_union(const binary_node* node)
+    {
+        using namespace objects;
+        std::vector<const node_type*> leaves;
+        flatten(node, constants::token_type::OR, leaves);
+        auto literal_set = std::make_shared<constant_list>();
+        string_type name;
+        for (auto leaf : leaves) {
+            range_constant range;
+            if (!base::is<binary_node>(leaf)
+                || leaf->lexem().token() != constants::token_type::IN) {
+                return {};
+            }
+            auto in = base::cast<binary_node>(leaf);
+            if (!base::is<ident_node>(in->left().get())
+                || !literal_range(in->right().get(), range)) {
+                return {};
+            }
+            auto ident = in->left()->lexem().value();
+            if (!name.empty() && name != ident) {
+                return {};
+            }
+            name = ident;
+            if (range.integral) {
+                literal_set->integer_ranges.add(range.integers);
+            } else {
+                literal_set->floating_ranges.add(range.floats);
+            }
+        }
+        literal_set->integer_ranges.build();
+        literal_set->floating_ranges.build();
+        auto slot = symbols_->resolve(name);
+        return [slot, literal_set](context_type& ctx) {
+            return literal_set->contains(ctx.read(slot));
+        };
+    }
+
+    /// bounds are not constant: 'low <= value <= high' as two comparisons
+    predicate_type compile_dynamic_range(call_type value,
+                                         const binary_node* range,
+                                         bool exclusive)
+    {
+        auto low = compile_call(range->left().get());
+        auto high = compile_call(range->right().get());
+        auto binops = binary_;
+        auto high_op = exclusive ? constants::token_type::LT
+                                 : constants::token_type::LEQ;
+        return [binops, value, low, high, high_op](context_type& ctx) {
+            auto val = value(ctx);
+            auto lval = low(ctx);
+            auto hval = high(ctx);
+            return to_bool(call_binary(*binops, constants::token_type::GEQ,
+                                       val, lval, ctx))
+                && to_bool(call_binary(*binops, high_op, val, hval, ctx));
+        };
+    }
+
+    /// 'value in (a, b, c)'. literal elements go to typed lookup sets,
+    /// the rest is compared one by one. arrays are searched,
+    /// interval objects are asked whether they contain the value
+    predicate_type compile_list(const node_type* value_node,
+                                const node_type* list)
+    {
+        std::vector<const node_type*> nodes;
+        flatten(list, constants::token_type::COMMA, nodes);
+
+        std::vector<std::int64_t> numbers;
+        std::vector<double> floats;
+        std::vector<string_view_type> strings;
+        auto literal_set = std::make_shared<constant_list>();
+        std::vector<call_type> elements;
+
+        for (auto node : nodes) {
+            using namespace objects;
+            range_constant range;
+            if (literal_range(node, range)) {
+                if (range.integral) {
+                    literal_set->integer_ranges.add(range.integers);
+                } else {
+                    literal_set->floating_ranges.add(range.floats);
+                }
+                continue;
+            }
+            auto literal = literal_of(node);
+            if (base::is<number>(literal.get())) {
+                numbers.emplace_back(
+                    base::cast<number>(literal.get())->value());
+            } else if (base::is<floating>(literal.get())) {
+                floats.emplace_back(
+                    base::cast<floating>(literal.get())->value());
+            } else if (base::is<string_object>(literal.get())) {
+                auto str = constants_->intern(std::move(literal));
+                strings.emplace_back(base::cast<string_object>(str)->value());
+            } else if (base::is<boolean>(literal.get())) {
+                auto flag = base::cast<boolean>(literal.get())->value();
+                literal_set->booleans[flag] = true;
+            } else {
+                elements.emplace_back(compile_call(node));
+            }
+        }
+        literal_set->numbers = lookup::membership<std::int64_t>(numbers);
+        literal_set->floats = lookup::membership<double>(floats);
+        literal_set->strings
+            = lookup::membership<string_view_type>(std::move(strings));
+        literal_set->integer_ranges.build();
+        literal_set->floating_ranges.build();
+
+        auto value = compile_call(value_node);
+        if (elements.empty()) {
+            return [value, literal_set](context_type& ctx) {
+                return literal_set->contains(value(ctx));
+            };
+        }
+
+        auto binops = binary_;
+        return [binops, value, literal_set, elements](context_type& ctx) {
+            auto val = value(ctx);
+            if (val.empty()) {
+                return false;
+            }
+            if (literal_set->contains(val)) {
+                return true;
+            }
+            for (auto& element : elements) {
+                auto eval = element(ctx);
+                if (is_array(eval)) {
+                    if (array_contains(*binops, val, eval.object, ctx)) {
+                        return true;
+                    }
+                } else if (is_interval(eval)) {
+                    if (interval_contains(val, eval.object)) {
+                        return true;
+                    }
+                } else if (to_bool(call_binary(*binops,
+                                               constants::token_type::EQ, val,
+                                               eval, ctx))) {
+                    return true;
+                }
+            }
+            return false;
+        };
+    }
+
+    /// operands of a chain of one binary operator, left to right
+    static void flatten(const node_type* node, id_type token,
+                        std::vector<const node_type*>& out)
+    {
+        if (objects::base::is<binary_node>(node)
+            && node->lexem().token() == token) {
+            auto bin = objects::base::cast<binary_node>(node);
+            flatten(bin->left().get(), token, out);
+            flatten(bin->right().get(), token, out);
+        } else {
+            out.emplace_back(node);
+        }
+    }
+
+    static objects::base::uptr literal_of(const node_type* node)
+    {
+        if (objects::base::is<value_node>(node)) {
+            return literals_type::to_object(node->lexem());
+        }
+        return {};
+    }
+
+    static bool is_numeric(objects::base::cptr value)
+    {
+        return objects::base::is<objects::number>(value)
+            || objects::base::is<objects::floating>(value);
+    }
+
+    static double to_double(objects::base::cptr value)
+    {
+        using namespace objects;
+        if (base::is<number>(value)) {
+            return static_cast<double>(base::cast<number>(value)->value());
+        }
+        return base::cast<floating>(value)->value();
+    }
+
+    std::shared_ptr<binary_type> binary_;
+    std::shared_ptr<unary_type> unary_;
+    std::shared_ptr<symbol_table_type> symbols_;
+    std::shared_ptr<constant_pool_type> constants_;
+    optimizer<lexem_type> optimizer_;
+    bool adaptive_ = true;
+    typename rule_type::chain_list chains_;
+    shared_type* sharing_ = nullptr;
+};
+
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "erules/objects.h"
+#include "erules/scalar.h"
+
+namespace erules {
+
+/// Literals of compiled rules. Equal constants share one object, and
+/// objects never move or change once they are in the pool, so rules
+/// refer to them by plain pointers and views.
+/// Interning is not synchronized: compile from one thread at a time.
+/// Evaluation only reads the objects and can run on any number of threads.
+template <typename CharT>
+class constant_pool {
+public:
+    using string_type = std::basic_string<CharT>;
+    using string_object = objects::string<CharT>;
+    using scalar_type = scalar<CharT>;
+
+    /// returns the pooled object equal to value
+    objects::base::cptr intern(objects::base::uptr value)
+    {
+        using namespace objects;
+        if (base::is<number>(value.get())) {
+            auto key = base::cast<number>(value.get())->value();
+            return intern_in(numbers_, key, std::move(value));
+        } else if (base::is<floating>(value.get())) {
+            auto bits = bits_of(base::cast<floating>(value.get())->value());
+            return intern_in(floats_, bits, std::move(value));
+        } else if (base::is<boolean>(value.get())) {
+            auto flag = base::cast<boolean>(value.get())->value();
+            if (!booleans_[flag]) {
+                booleans_[flag] = keep(std::move(value));
+            }
+            return booleans_[flag];
+        } else if (base::is<string_object>(value.get())) {
+            auto key = base::cast<string_object>(value.get())->value();
+            return intern_in(strings_, key, std::move(value));
+        }
+        return value ? keep(std::move(value)) : nullptr;
+    }
+
+    /// the pooled copy of a string; the reference stays valid
+    const string_type& intern_string(const string_type& value)
+    {
+        auto obj = intern(std::make_unique<string_object>(value));
+        return objects::base::cast<string_object>(obj)->value();
+    }
+
+    /// unboxed view of a pooled object
+    scalar_type intern_scalar(objects::base::uptr value)
+    {
+        return scalar_type::from_object(intern(std::move(value)));
+    }
+
+    std::size_t size() const
+    {
+        return objects_.size();
+    }
+
+private:
+    /// -0.0 and 0.0 stay apart
+    static std::uint64_t bits_of(double value)
+    {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    template <typename MapT, typename KeyT>
+    objects::base::cptr intern_in(MapT& map, const KeyT& key,
+                                  objects::base::uptr value)
+    {
+        auto find = map.find(key);
+        if (find != map.end()) {
+            return find->second;
+        }
+        auto obj = keep(std::move(value));
+        map.emplace(key, obj);
+        return obj;
+    }
+
+    objects::base::cptr keep(objects::base::uptr value)
+    {
+        objects_.emplace_back(std::move(value));
+        return objects_.back().get();
+    }
+
+    std::vector<objects::base::uptr> objects_;
+    std::map<std::int64_t, objects::base::cptr> numbers_;
+    std::map<std::uint64_t, objects::base::cptr> floats_;
+    std::map<string_type, objects::base::cptr> strings_;
+    objects::base::cptr booleans_[2] = { nullptr, nullptr };
+};
+
+}
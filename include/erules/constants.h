@@ -15,6 +15,7 @@ enum class token_type : int {
     GEQ,
     NOT,
     IN,
+    STARTSWITH,
     MINUS,
     PLUS,
     MUL,
@@ -86,6 +87,8 @@ inline std::basic_string<CharT> token_to_string(token_type t)
         return helpers::strings::to_string<CharT>("<>");
     case constants::token_type::IN:
         return helpers::strings::to_string<CharT>("in");
+    case constants::token_type::STARTSWITH:
+        return helpers::strings::to_string<CharT>("startswith");
     case constants::token_type::IDENT:
         return helpers::strings::to_string<CharT>("ident");
     case constants::token_type::NUMBER:
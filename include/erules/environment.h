@@ -1,14 +1,282 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <string>
+#include <vector>
 
+#include "erules/arena.h"
 #include "erules/objects.h"
+#include "erules/scalar.h"
 
 namespace erules {
+
+/// maps identifiers to dense slot indices.
+/// rules resolve their identifiers once, when they are compiled.
+/// the table can be shared between threads: one may resolve new names
+/// while others look names up. names stay where they are once added
+template <typename CharT, typename LessT = std::less<CharT>>
+class symbol_table {
+public:
+    using string_type = std::basic_string<CharT>;
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    std::size_t resolve(const string_type& name)
+    {
+        {
+            std::shared_lock<std::shared_mutex> guard(lock_);
+            auto find = slots_.find(name);
+            if (find != slots_.end()) {
+                return find->second;
+            }
+        }
+        std::unique_lock<std::shared_mutex> guard(lock_);
+        auto find = slots_.find(name);
+        if (find != slots_.end()) {
+            return find->second;
+        }
+        auto slot = names_.size();
+        slots_.emplace(name, slot);
+        names_.emplace_back(name);
+        return slot;
+    }
+
+    std::size_t find(const string_type& name) const
+    {
+        std::shared_lock<std::shared_mutex> guard(lock_);
+        auto find = slots_.find(name);
+        return (find == slots_.end()) ? npos : find->second;
+    }
+
+    const string_type& name(std::size_t slot) const
+    {
+        std::shared_lock<std::shared_mutex> guard(lock_);
+        return names_[slot];
+    }
+
+    std::size_t size() const
+    {
+        std::shared_lock<std::shared_mutex> guard(lock_);
+        return names_.size();
+    }
+
+private:
+    mutable std::shared_mutex lock_;
+    std::map<string_type, std::size_t> slots_;
+    std::deque<string_type> names_;
+};
+
 template <typename CharT, typename LessT = std::less<CharT>>
 class environment {
 public:
-    using string_type = std::basic_string<CHarT>;
+    using string_type = std::basic_string<CharT>;
+    using symbol_table_type = symbol_table<CharT, LessT>;
+    using scalar_type = scalar<CharT>;
     virtual ~environment() = default;
-    object::uptr get_ident(const string_type& name) = 0;
-    void set_ident(const string_type& name, object::uptr value) = 0;
+
+    /// returns nullptr for a slot without a value
+    /// or when the environment only read()s its values
+    virtual objects::base::cptr get(std::size_t slot) const = 0;
+
+    /// unboxed read. environments that don't keep objects override it
+    virtual scalar_type read(std::size_t slot) const
+    {
+        return scalar_type::from_object(get(slot));
+    }
+};
+
+/// values in a flat array indexed by slot.
+/// the environment doesn't own the values unless they are stored
+template <typename CharT, typename LessT = std::less<CharT>>
+class slot_environment : public environment<CharT, LessT> {
+public:
+    using super_type = environment<CharT, LessT>;
+    using string_type = typename super_type::string_type;
+    using symbol_table_type = typename super_type::symbol_table_type;
+
+    slot_environment(std::shared_ptr<symbol_table_type> symbols)
+        : symbols_(std::move(symbols))
+        , values_(symbols_->size(), nullptr)
+    {
+    }
+
+    objects::base::cptr get(std::size_t slot) const override
+    {
+        return (slot < values_.size()) ? values_[slot] : nullptr;
+    }
+
+    void set(std::size_t slot, objects::base::cptr value)
+    {
+        if (slot >= values_.size()) {
+            values_.resize(slot + 1, nullptr);
+        }
+        values_[slot] = value;
+    }
+
+    void set(const string_type& name, objects::base::cptr value)
+    {
+        set(symbols_->resolve(name), value);
+    }
+
+    void store(const string_type& name, objects::base::uptr value)
+    {
+        set(name, value.get());
+        storage_.emplace_back(std::move(value));
+    }
+
+    void clear()
+    {
+        std::fill(values_.begin(), values_.end(), nullptr);
+        storage_.clear();
+    }
+
+    const symbol_table_type& symbols() const
+    {
+        return *symbols_;
+    }
+
+private:
+    std::shared_ptr<symbol_table_type> symbols_;
+    std::vector<objects::base::cptr> values_;
+    std::vector<objects::base::uptr> storage_;
+};
+
+/// state of one evaluation: the environment and the temporary objects
+/// produced by operations. temporaries, the list that keeps them and the
+/// strings produced by + and * are created in the arena of the context
+/// and released together by reset(); results are valid until then.
+/// once the arena has grown to the size of an evaluation, evaluating
+/// does not allocate, except for operations on boxed strings: a string
+/// object keeps its characters in a std::basic_string
+template <typename CharT, typename LessT = std::less<CharT>>
+class context {
+public:
+    using environment_type = environment<CharT, LessT>;
+
+    context(const environment_type& env)
+        : env_(&env)
+    {
+    }
+
+    ~context()
+    {
+        release();
+    }
+
+    context(const context&) = delete;
+    context& operator=(const context&) = delete;
+
+    /// the object of the slot. a value the environment only read()s
+    /// is boxed in the arena and kept until reset()
+    objects::base::cptr get(std::size_t slot)
+    {
+        if (auto value = env_->get(slot)) {
+            return value;
+        }
+        auto value = env_->read(slot);
+        if (value.empty()) {
+            return nullptr;
+        }
+        arena::scope scope(storage_);
+        return keep(value.to_object());
+    }
+
+    scalar<CharT> read(std::size_t slot) const
+    {
+        return env_->read(slot);
+    }
+
+    objects::base::cptr keep(objects::base::uptr value)
+    {
+        if (!value) {
+            return nullptr;
+        }
+        auto mem = storage_.allocate(sizeof(temporary), alignof(temporary));
+        temporaries_ = ::new (mem) temporary { std::move(value), temporaries_ };
+        return temporaries_->value.get();
+    }
+
+    /// destroys the temporaries, then rewinds the arena
+    void reset()
+    {
+        release();
+        storage_.reset();
+    }
+
+    arena& storage()
+    {
+        return storage_;
+    }
+
+    void set_environment(const environment_type& env)
+    {
+        env_ = &env;
+    }
+
+    const environment_type& env() const
+    {
+        return *env_;
+    }
+
+    /// results of predicates shared between rules, by slot. they stay
+    /// until forget(), reset() keeps them
+    bool recall(std::size_t slot, bool& value) const
+    {
+        if (slot < memo_.size() && memo_[slot].epoch == epoch_) {
+            value = memo_[slot].value;
+            return true;
+        }
+        return false;
+    }
+
+    void remember(std::size_t slot, bool value)
+    {
+        if (slot >= memo_.size()) {
+            memo_.resize(slot + 1);
+        }
+        memo_[slot] = memo_entry { epoch_, value };
+    }
+
+    /// the next record: drops every remembered result at once
+    void forget()
+    {
+        if (++epoch_ == 0) {
+            std::fill(memo_.begin(), memo_.end(), memo_entry {});
+            epoch_ = 1;
+        }
+    }
+
+private:
+    struct memo_entry {
+        std::uint32_t epoch = 0;
+        bool value = false;
+    };
+
+    /// a node of the list of temporaries, in the arena
+    struct temporary {
+        objects::base::uptr value;
+        temporary* next;
+    };
+
+    /// newest first; the objects know they live in the arena
+    void release()
+    {
+        while (temporaries_) {
+            auto next = temporaries_->next;
+            temporaries_->~temporary();
+            temporaries_ = next;
+        }
+    }
+
+    const environment_type* env_;
+    arena storage_;
+    temporary* temporaries_ = nullptr;
+    std::vector<memo_entry> memo_;
+    std::uint32_t epoch_ = 1;
 };
 }
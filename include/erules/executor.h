@@ -0,0 +1,171 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace erules {
+
+/// Fixed pool of worker threads with work stealing.
+/// parallel_for() splits the task indices into one contiguous range per
+/// worker. A worker takes tasks from the front of its own range; when it
+/// runs dry it steals the back half of the range of another worker, so
+/// uneven tasks still keep every thread busy.
+class executor {
+public:
+    /// call(index, worker): worker is below size() and identifies the
+    /// thread, for per thread state
+    using job_type = std::function<void(std::size_t, std::size_t)>;
+
+    explicit executor(std::size_t threads = default_threads())
+        : queues_(new queue[std::max<std::size_t>(threads, 1)])
+        , size_(std::max<std::size_t>(threads, 1))
+    {
+        for (std::size_t i = 0; i < size_; ++i) {
+            threads_.emplace_back([this, i] { work(i); });
+        }
+    }
+
+    executor(const executor&) = delete;
+    executor& operator=(const executor&) = delete;
+
+    ~executor()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    static std::size_t default_threads()
+    {
+        return std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    /// runs call(index, worker) for every index below count and waits.
+    /// the first exception of a task is rethrown here
+    void parallel_for(std::size_t count, job_type call)
+    {
+        if (count == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> running(run_lock_);
+        std::unique_lock<std::mutex> guard(lock_);
+        for (std::size_t i = 0; i < size_; ++i) {
+            std::lock_guard<std::mutex> queue_guard(queues_[i].lock);
+            queues_[i].begin = count * i / size_;
+            queues_[i].end = count * (i + 1) / size_;
+        }
+        job_ = std::move(call);
+        error_ = nullptr;
+        active_ = size_;
+        ++generation_;
+        wake_.notify_all();
+        done_.wait(guard, [this] { return active_ == 0; });
+        job_ = nullptr;
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+private:
+    /// task indices [begin, end) left to a worker
+    struct queue {
+        std::mutex lock;
+        std::size_t begin = 0;
+        std::size_t end = 0;
+    };
+
+    void work(std::size_t worker)
+    {
+        std::uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> guard(lock_);
+                wake_.wait(guard,
+                           [&] { return stop_ || generation_ != seen; });
+                if (stop_) {
+                    return;
+                }
+                seen = generation_;
+            }
+            std::size_t index = 0;
+            while (next(worker, index)) {
+                try {
+                    job_(index, worker);
+                } catch (...) {
+                    std::lock_guard<std::mutex> guard(lock_);
+                    if (!error_) {
+                        error_ = std::current_exception();
+                    }
+                }
+            }
+            std::lock_guard<std::mutex> guard(lock_);
+            if (--active_ == 0) {
+                done_.notify_all();
+            }
+        }
+    }
+
+    bool next(std::size_t worker, std::size_t& index)
+    {
+        {
+            auto& own = queues_[worker];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (own.begin < own.end) {
+                index = own.begin++;
+                return true;
+            }
+        }
+        for (std::size_t i = 1; i < size_; ++i) {
+            auto& victim = queues_[(worker + i) % size_];
+            std::size_t begin = 0;
+            std::size_t end = 0;
+            {
+                std::lock_guard<std::mutex> guard(victim.lock);
+                if (victim.begin == victim.end) {
+                    continue;
+                }
+                begin = victim.begin + (victim.end - victim.begin) / 2;
+                end = victim.end;
+                victim.end = begin;
+            }
+            auto& own = queues_[worker];
+            std::lock_guard<std::mutex> guard(own.lock);
+            own.begin = begin + 1;
+            own.end = end;
+            index = begin;
+            return true;
+        }
+        return false;
+    }
+
+    std::unique_ptr<queue[]> queues_;
+    std::size_t size_;
+    std::vector<std::thread> threads_;
+    std::mutex run_lock_;
+    std::mutex lock_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    job_type job_;
+    std::exception_ptr error_;
+    std::uint64_t generation_ = 0;
+    std::size_t active_ = 0;
+    bool stop_ = false;
+};
+
+}
@@ -1,5 +1,8 @@
 #pragma once
 #include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
 #include <string>
 
 namespace helpers {
@@ -191,68 +194,51 @@ struct reader {
     }
 
 
+    /// the digits go to strtod as "<digits>e<exponent>": it rounds
+    /// correctly and does not depend on the decimal point of the locale
     template <typename ItrT>
     static double read_float(ItrT& s, ItrT end)
     {
-        double a = 0.0;
+        std::string digits;
         int e = 0;
-        int c = 0;
 
-        while ((s != end) && valid_for_dec_(c = *s++)) {
-            if (!is_gap(c)) {
-                a = a * 10.0 + (c - '0');
+        /// s is only moved over what belongs to the literal
+        for (; (s != end) && valid_for_dec_(*s); ++s) {
+            if (!is_gap(*s)) {
+                digits += static_cast<char>(*s);
             }
         }
 
-        if (c == '.') {
-            while ((s != end) && valid_for_dec_(c = *s++)) {
-                if (!is_gap(c)) {
-                    a = a * 10.0 + (c - '0');
+        if ((s != end) && (*s == '.')) {
+            for (++s; (s != end) && valid_for_dec_(*s); ++s) {
+                if (!is_gap(*s)) {
+                    digits += static_cast<char>(*s);
                     e = e - 1;
                 }
             }
         }
 
-        if (c == 'e' || c == 'E') {
+        if ((s != end) && (*s == 'e' || *s == 'E')) {
             int sign = 1;
             int i = 0;
-            c = *s++;
-
-            if (c == '+') {
-                c = *s++;
-            } else if (c == '-') {
-                c = *s++;
-                sign = -1;
+            if ((++s != end) && (*s == '+' || *s == '-')) {
+                sign = (*s == '-') ? -1 : 1;
+                ++s;
             }
-
-            while (valid_for_dec_(c)) {
-                if (is_gap(c)) {
-                    c = *s++;
-                }
-                i = i * 10 + (c - '0');
-                if (s == end) {
-                    break;
-                } else {
-                    c = *s++;
+            for (; (s != end) && valid_for_dec_(*s); ++s) {
+                if (!is_gap(*s)) {
+                    i = i * 10 + (*s - '0');
                 }
             }
             e += i * sign;
         }
 
-        while (e > 0) {
-            a *= 10.0;
-            e--;
+        if (digits.empty()) {
+            return 0.0;
         }
-
-        while (e < 0) {
-            a *= 0.1;
-            e++;
-        }
-
-        if (s != end) {
-            --s;
-        }
-        return a;
+        digits += 'e';
+        digits += std::to_string(e);
+        return std::strtod(digits.c_str(), nullptr);
     }
 
     template <typename CharT>
@@ -281,20 +267,33 @@ struct reader {
         return 0xFF;
     }
 
+    /// the digits as unsigned 64 bit, returned as int64. overflow is
+    /// set if the digits do not fit in 64 bits
     template <typename ItrT>
     static std::int64_t read_int(ItrT begin, ItrT end,
-                                 int* first_inval = nullptr)
+                                 int* first_inval = nullptr,
+                                 bool* overflow = nullptr)
     {
+        constexpr auto most = std::numeric_limits<std::uint64_t>::max();
         std::uint64_t res = 0;
-        *first_inval = -1;
+        if (first_inval) {
+            *first_inval = -1;
+        }
+        if (overflow) {
+            *overflow = false;
+        }
 
         int pos = 0;
         for (; begin != end; ++begin) {
             auto c = *begin;
             if (!is_gap(c)) {
                 if (valid_for_dec_(c)) {
+                    auto digit = char2int(c);
+                    if (overflow && res > (most - digit) / 10) {
+                        *overflow = true;
+                    }
                     res *= 10;
-                    res += char2int(c);
+                    res += digit;
                     ++pos;
                 } else {
                     if (first_inval) {
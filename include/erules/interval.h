@@ -0,0 +1,266 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+namespace erules {
+
+/// 'low .. high' or 'low ... high' with the endpoints inline.
+/// values of another arithmetic type are compared as is, so
+/// 2.5 is inside the integer interval 1...3
+template <typename T>
+struct numeric_interval {
+    using value_type = T;
+
+    T low = T {};
+    T high = T {};
+    bool exclusive = false;
+
+    template <typename U>
+    bool contains(U value) const
+    {
+        return (low <= value) && (exclusive ? value < high : value <= high);
+    }
+
+    bool empty() const
+    {
+        return exclusive ? !(low < high) : !(low <= high);
+    }
+};
+
+static_assert(std::is_trivially_copyable<numeric_interval<double>>::value,
+              "numeric_interval is passed by value");
+
+/// union of intervals as a sorted list of disjoint ones.
+/// add() everything, then build() once; contains() is a binary search
+template <typename T>
+class interval_set {
+public:
+    using interval_type = numeric_interval<T>;
+
+    interval_set() = default;
+
+    explicit interval_set(std::vector<interval_type> values)
+        : values_(std::move(values))
+    {
+        build();
+    }
+
+    void add(const interval_type& value)
+    {
+        values_.push_back(value);
+    }
+
+    /// sorts and merges overlapping and touching intervals
+    void build()
+    {
+        values_.erase(std::remove_if(values_.begin(), values_.end(),
+                                     [](const interval_type& i) {
+                                         return i.empty();
+                                     }),
+                      values_.end());
+        std::sort(values_.begin(), values_.end(),
+                  [](const interval_type& l, const interval_type& r) {
+                      return l.low < r.low;
+                  });
+        std::vector<interval_type> merged;
+        for (auto& next : values_) {
+            if (merged.empty() || merged.back().high < next.low) {
+                merged.push_back(next);
+                continue;
+            }
+            auto& last = merged.back();
+            if (last.high < next.high) {
+                last.high = next.high;
+                last.exclusive = next.exclusive;
+            } else if (!(next.high < last.high)) {
+                last.exclusive = last.exclusive && next.exclusive;
+            }
+        }
+        values_ = std::move(merged);
+    }
+
+    template <typename U>
+    bool contains(U value) const
+    {
+        auto next = std::upper_bound(
+            values_.begin(), values_.end(), value,
+            [](const U& v, const interval_type& i) { return v < i.low; });
+        if (next == values_.begin()) {
+            return false;
+        }
+        return std::prev(next)->contains(value);
+    }
+
+    bool empty() const
+    {
+        return values_.empty();
+    }
+
+    std::size_t size() const
+    {
+        return values_.size();
+    }
+
+    const std::vector<interval_type>& intervals() const
+    {
+        return values_;
+    }
+
+private:
+    std::vector<interval_type> values_;
+};
+
+/// Static centered interval tree: which of many intervals contain a value.
+/// Both ends can be open. add() everything, then build();
+/// query() is O(log n + k) for k hits. Intervals added after a build()
+/// join the earlier ones on the next build().
+template <typename T>
+class interval_tree {
+public:
+    struct item {
+        T low;
+        T high;
+        bool low_open;
+        bool high_open;
+        std::uint32_t id;
+
+        bool contains(T value) const
+        {
+            return (low_open ? low < value : low <= value)
+                && (high_open ? value < high : value <= high);
+        }
+    };
+
+    void add(const item& value)
+    {
+        pending_.push_back(value);
+    }
+
+    void build()
+    {
+        items_.insert(items_.end(), pending_.begin(), pending_.end());
+        pending_.clear();
+        nodes_.clear();
+        root_ = build(items_);
+    }
+
+    /// calls call(id) for every interval that contains value
+    template <typename CallT>
+    void query(T value, CallT&& call) const
+    {
+        if (!(value == value)) {
+            return;
+        }
+        for (auto pos = root_; pos != npos;) {
+            auto& node = nodes_[pos];
+            if (value < node.center) {
+                for (auto& i : node.by_low) {
+                    if (value < i.low) {
+                        break;
+                    }
+                    if (i.contains(value)) {
+                        call(i.id);
+                    }
+                }
+                pos = node.left;
+            } else if (node.center < value) {
+                for (auto& i : node.by_high) {
+                    if (i.high < value) {
+                        break;
+                    }
+                    if (i.contains(value)) {
+                        call(i.id);
+                    }
+                }
+                pos = node.right;
+            } else {
+                for (auto& i : node.by_low) {
+                    if (i.contains(value)) {
+                        call(i.id);
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    bool empty() const
+    {
+        return root_ == npos && pending_.empty();
+    }
+
+private:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    struct node {
+        T center;
+        /// intervals that contain center, by low ascending
+        std::vector<item> by_low;
+        /// the same intervals by high descending
+        std::vector<item> by_high;
+        std::size_t left = npos;
+        std::size_t right = npos;
+    };
+
+    /// the center is the median endpoint. if nothing contains it and
+    /// everything falls on one side, the node keeps all the intervals
+    std::size_t build(std::vector<item> items)
+    {
+        if (items.empty()) {
+            return npos;
+        }
+        std::vector<T> ends;
+        ends.reserve(items.size() * 2);
+        for (auto& i : items) {
+            ends.push_back(i.low);
+            ends.push_back(i.high);
+        }
+        auto middle = ends.begin() + ends.size() / 2;
+        std::nth_element(ends.begin(), middle, ends.end());
+        node current;
+        current.center = *middle;
+
+        std::vector<item> left;
+        std::vector<item> right;
+        for (auto& i : items) {
+            if (i.high < current.center
+                || (i.high_open && !(current.center < i.high))) {
+                left.push_back(i);
+            } else if (current.center < i.low
+                       || (i.low_open && !(i.low < current.center))) {
+                right.push_back(i);
+            } else {
+                current.by_low.push_back(i);
+            }
+        }
+        if (current.by_low.empty()
+            && (left.size() == items.size() || right.size() == items.size())) {
+            current.by_low = std::move(items);
+            left.clear();
+            right.clear();
+        }
+        std::sort(current.by_low.begin(), current.by_low.end(),
+                  [](const item& l, const item& r) { return l.low < r.low; });
+        current.by_high = current.by_low;
+        std::sort(current.by_high.begin(), current.by_high.end(),
+                  [](const item& l, const item& r) { return r.high < l.high; });
+
+        auto pos = nodes_.size();
+        nodes_.push_back(std::move(current));
+        auto lpos = build(std::move(left));
+        auto rpos = build(std::move(right));
+        nodes_[pos].left = lpos;
+        nodes_[pos].right = rpos;
+        return pos;
+    }
+
+    std::vector<item> items_;
+    std::vector<item> pending_;
+    std::vector<node> nodes_;
+    std::size_t root_ = npos;
+};
+
+}
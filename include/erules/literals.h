@@ -0,0 +1,166 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+
+#include "erules/constants.h"
+#include "erules/helpers.h"
+#include "erules/objects.h"
+
+namespace erules {
+
+/// converts value lexems (NUMBER, FLOAT, STRING, BOOL_*) to objects and back
+template <typename LexemT>
+struct literals {
+    using lexem_type = LexemT;
+    using char_type = typename lexem_type::char_type;
+    using string_type = std::basic_string<char_type>;
+    using string_object = objects::string<char_type>;
+    using stream_type = std::basic_stringstream<char_type>;
+
+    static bool is_literal(constants::token_type token)
+    {
+        switch (token) {
+        case constants::token_type::NUMBER:
+        case constants::token_type::FLOAT:
+        case constants::token_type::STRING:
+        case constants::token_type::BOOL_FALSE:
+        case constants::token_type::BOOL_TRUE:
+            return true;
+        default:
+            break;
+        }
+        return false;
+    }
+
+    static objects::base::uptr to_object(const lexem_type& lex)
+    {
+        switch (lex.token()) {
+        case constants::token_type::NUMBER: {
+            auto val = lex.value();
+            auto begin = val.begin();
+            bool negative = (begin != val.end()) && (*begin == '-');
+            if (negative) {
+                ++begin;
+            }
+            int inval = -1;
+            bool overflow = false;
+            auto num = helpers::reader::read_int(begin, val.end(), &inval,
+                                                 &overflow);
+            if (-1 != inval) {
+                return {};
+            }
+            /// in unsigned: "-9223372036854775808" reads as INT64_MIN.
+            /// beyond [INT64_MIN, INT64_MAX] the literal is the nearest
+            /// floating value, as it would be with a decimal point
+            auto magnitude = static_cast<std::uint64_t>(num);
+            auto most = static_cast<std::uint64_t>(
+                            std::numeric_limits<std::int64_t>::max())
+                + (negative ? 1 : 0);
+            if (overflow || magnitude > most) {
+                auto digits = begin;
+                auto flt = overflow
+                    ? helpers::reader::read_float(digits, val.end())
+                    : static_cast<double>(magnitude);
+                return std::make_unique<objects::floating>(negative ? -flt
+                                                                    : flt);
+            }
+            if (negative) {
+                num = static_cast<std::int64_t>(0 - magnitude);
+            }
+            return std::make_unique<objects::number>(num);
+        }
+        case constants::token_type::FLOAT: {
+            auto val = lex.value();
+            bool negative = !val.empty() && (val[0] == '-');
+            auto num = helpers::reader::read_float(
+                negative ? val.substr(1) : val);
+            return std::make_unique<objects::floating>(negative ? -num : num);
+        }
+        case constants::token_type::STRING:
+            return std::make_unique<string_object>(lex.value());
+        case constants::token_type::BOOL_FALSE:
+            return std::make_unique<objects::boolean>(false);
+        case constants::token_type::BOOL_TRUE:
+            return std::make_unique<objects::boolean>(true);
+        default:
+            break;
+        }
+        return {};
+    }
+
+    /// fills token, value and raw value of the lexem.
+    /// returns false if the object can't be represented as a literal
+    static bool from_object(objects::base::cptr obj, lexem_type& lex)
+    {
+        using namespace objects;
+        if (base::is<number>(obj)) {
+            auto val = to_string(base::cast<number>(obj)->value());
+            set(lex, constants::token_type::NUMBER, val, val);
+            return true;
+        } else if (base::is<floating>(obj)) {
+            auto num = base::cast<floating>(obj)->value();
+            if (!std::isfinite(num)) {
+                return false;
+            }
+            auto val = to_string(num);
+            if (val.find_first_of(helpers::strings::to_string<char_type>(
+                    ".eE"))
+                == string_type::npos) {
+                val += helpers::strings::to_string<char_type>(".0");
+            }
+            set(lex, constants::token_type::FLOAT, val, val);
+            return true;
+        } else if (base::is<boolean>(obj)) {
+            bool val = base::cast<boolean>(obj)->value();
+            auto str = helpers::strings::to_string<char_type>(
+                std::string(val ? "true" : "false"));
+            set(lex,
+                val ? constants::token_type::BOOL_TRUE
+                    : constants::token_type::BOOL_FALSE,
+                str, str);
+            return true;
+        } else if (base::is<string_object>(obj)) {
+            auto& val = base::cast<string_object>(obj)->value();
+            set(lex, constants::token_type::STRING, val, quote(val));
+            return true;
+        }
+        return false;
+    }
+
+    static string_type quote(const string_type& value)
+    {
+        string_type result;
+        result.reserve(value.size() + 2);
+        result.push_back('"');
+        for (auto c : value) {
+            if (c == '"' || c == '\\') {
+                result.push_back('\\');
+            }
+            result.push_back(c);
+        }
+        result.push_back('"');
+        return result;
+    }
+
+private:
+    template <typename T>
+    static string_type to_string(T value)
+    {
+        stream_type ss;
+        ss.precision(std::numeric_limits<double>::max_digits10);
+        ss << value;
+        return ss.str();
+    }
+
+    static void set(lexem_type& lex, constants::token_type token,
+                    string_type value, string_type raw_value)
+    {
+        lex.set_token(token);
+        lex.set_value(std::move(value));
+        lex.set_raw_value(std::move(raw_value));
+    }
+};
+
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace erules { namespace lookup {
+
+    /// open addressing set with linear probing.
+    /// built once, never modified afterwards
+    template <typename T, typename HashT = std::hash<T>,
+              typename EqualT = std::equal_to<T>>
+    class hash_set {
+    public:
+        hash_set() = default;
+
+        explicit hash_set(std::vector<T> values)
+            : values_(std::move(values))
+        {
+            std::size_t bits = 1;
+            while ((std::size_t(1) << bits) < values_.size() * 2) {
+                ++bits;
+            }
+            shift_ = 64 - bits;
+            slots_.resize(std::size_t(1) << bits);
+            for (std::size_t i = 0; i < values_.size(); ++i) {
+                auto hash = hash_of(values_[i]);
+                auto pos = position(hash);
+                while (slots_[pos].index != 0) {
+                    pos = (pos + 1) & (slots_.size() - 1);
+                }
+                slots_[pos].index = static_cast<std::uint32_t>(i + 1);
+                slots_[pos].tag = static_cast<std::uint32_t>(hash);
+            }
+        }
+
+        bool contains(const T& value) const
+        {
+            if (values_.empty()) {
+                return false;
+            }
+            auto hash = hash_of(value);
+            auto tag = static_cast<std::uint32_t>(hash);
+            for (auto pos = position(hash);;
+                 pos = (pos + 1) & (slots_.size() - 1)) {
+                const auto& slot = slots_[pos];
+                if (slot.index == 0) {
+                    return false;
+                }
+                if (slot.tag == tag
+                    && EqualT {}(values_[slot.index - 1], value)) {
+                    return true;
+                }
+            }
+        }
+
+        std::size_t size() const
+        {
+            return values_.size();
+        }
+
+    private:
+        struct slot {
+            std::uint32_t index = 0;
+            std::uint32_t tag = 0;
+        };
+
+        static std::uint64_t hash_of(const T& value)
+        {
+            return static_cast<std::uint64_t>(HashT {}(value));
+        }
+
+        /// fibonacci hashing spreads identity hashes of integers
+        std::size_t position(std::uint64_t hash) const
+        {
+            return static_cast<std::size_t>((hash * 0x9E3779B97F4A7C15ull)
+                                            >> shift_);
+        }
+
+        std::vector<T> values_;
+        std::vector<slot> slots_;
+        unsigned shift_ = 63;
+    };
+
+    /// sorted vector for short lists, hash_set for the long ones
+    template <typename T, typename LessT = std::less<T>,
+              typename HashT = std::hash<T>>
+    class membership {
+    public:
+        static constexpr std::size_t small_size = 16;
+
+        membership() = default;
+
+        explicit membership(std::vector<T> values)
+        {
+            std::sort(values.begin(), values.end(), LessT {});
+            values.erase(std::unique(values.begin(), values.end(),
+                                     [](const T& l, const T& r) {
+                                         return !LessT {}(l, r)
+                                             && !LessT {}(r, l);
+                                     }),
+                         values.end());
+            if (values.size() <= small_size) {
+                sorted_ = std::move(values);
+            } else {
+                hashed_ = hash_set<T, HashT>(std::move(values));
+                use_hash_ = true;
+            }
+        }
+
+        bool contains(const T& value) const
+        {
+            if (use_hash_) {
+                return hashed_.contains(value);
+            }
+            return std::binary_search(sorted_.begin(), sorted_.end(), value,
+                                      LessT {});
+        }
+
+        bool empty() const
+        {
+            return !use_hash_ && sorted_.empty();
+        }
+
+        std::size_t size() const
+        {
+            return use_hash_ ? hashed_.size() : sorted_.size();
+        }
+
+    private:
+        std::vector<T> sorted_;
+        hash_set<T, HashT> hashed_;
+        bool use_hash_ = false;
+    };
+
+}}
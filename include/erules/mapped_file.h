@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace erules {
+
+/// Read only view of a whole file, mapped into memory where the platform
+/// has mmap and read into an aligned buffer elsewhere
+class mapped_file {
+public:
+    explicit mapped_file(const std::string& path)
+    {
+#if defined(_WIN32)
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) {
+            throw std::runtime_error("mapped_file: cannot open " + path);
+        }
+        size_ = static_cast<std::size_t>(in.tellg());
+        buffer_.resize((size_ + 7) / 8);
+        in.seekg(0);
+        in.read(reinterpret_cast<char*>(buffer_.data()),
+                static_cast<std::streamsize>(size_));
+        data_ = buffer_.data();
+#else
+        auto fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("mapped_file: cannot open " + path);
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("mapped_file: cannot stat " + path);
+        }
+        size_ = static_cast<std::size_t>(info.st_size);
+        if (size_ > 0) {
+            auto addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("mapped_file: cannot map " + path);
+            }
+            data_ = addr;
+        }
+        ::close(fd);
+#endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    ~mapped_file()
+    {
+#if !defined(_WIN32)
+        if (data_) {
+            ::munmap(const_cast<void*>(data_), size_);
+        }
+#endif
+    }
+
+    const void* data() const
+    {
+        return data_;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+private:
+    const void* data_ = nullptr;
+    std::size_t size_ = 0;
+#if defined(_WIN32)
+    std::vector<std::uint64_t> buffer_;
+#endif
+};
+
+}
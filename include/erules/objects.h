@@ -1,10 +1,14 @@
 #ifndef ERULES_OBJECTS_H
 #define ERULES_OBJECTS_H
 
+#include <cstdint>
 #include <map>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
+#include "erules/interval.h"
 #include "erules/objects/base.h"
 
 namespace erules { namespace objects {
@@ -202,7 +206,7 @@ namespace erules { namespace objects {
 
         base::uptr clone() const override
         {
-            return std::make_unique<floating>(value());
+            return std::make_unique<boolean>(value());
         }
 
     private:
@@ -279,6 +283,10 @@ namespace erules { namespace objects {
         {
             return value_;
         }
+        const std::vector<base::uptr>& value() const
+        {
+            return value_;
+        }
         base::uptr clone() const override
         {
             std::vector<base::uptr> tmp;
@@ -292,6 +300,147 @@ namespace erules { namespace objects {
         std::vector<base::uptr> value_;
     };
 
+    /// homogeneous array of numbers, floating or booleans in one block.
+    /// booleans are kept as bytes
+    template <typename T>
+    class erules_define_template_object(typed_array, T)
+    {
+        using super_type = typed_object<typed_array<T>>;
+
+    public:
+        using value_type = T;
+        using storage_type = std::conditional_t<std::is_same<T, bool>::value,
+                                                std::uint8_t, T>;
+
+        typed_array(std::vector<storage_type> val)
+            : super_type(__func__)
+            , value_(std::move(val))
+        {
+        }
+
+        typed_array()
+            : super_type(__func__)
+        {
+        }
+
+        void set_value(std::vector<storage_type> val)
+        {
+            value_ = std::move(val);
+        }
+
+        const std::vector<storage_type>& value() const
+        {
+            return value_;
+        }
+
+        std::size_t size() const
+        {
+            return value_.size();
+        }
+
+        base::uptr clone() const override
+        {
+            return std::make_unique<typed_array<T>>(value_);
+        }
+
+    private:
+        std::vector<storage_type> value_;
+    };
+
+    using number_array = typed_array<std::int64_t>;
+    using floating_array = typed_array<double>;
+    using boolean_array = typed_array<bool>;
+
+    /// strings share one buffer, element i is [offsets[i], offsets[i + 1])
+    template <typename CharT>
+    class erules_define_template_object(string_array, CharT)
+    {
+        using super_type = typed_object<string_array<CharT>>;
+
+    public:
+        using string_type = std::basic_string<CharT>;
+        using string_view_type = std::basic_string_view<CharT>;
+
+        string_array()
+            : super_type(__func__)
+        {
+        }
+
+        void push_back(string_view_type val)
+        {
+            buffer_.append(val.data(), val.size());
+            offsets_.push_back(buffer_.size());
+        }
+
+        string_view_type operator[](std::size_t pos) const
+        {
+            return string_view_type(buffer_).substr(
+                offsets_[pos], offsets_[pos + 1] - offsets_[pos]);
+        }
+
+        std::size_t size() const
+        {
+            return offsets_.size() - 1;
+        }
+
+        base::uptr clone() const override
+        {
+            return std::make_unique<string_array<CharT>>(*this);
+        }
+
+    private:
+        string_type buffer_;
+        std::vector<std::size_t> offsets_ = { 0 };
+    };
+
+    template <typename T>
+    bool all_of_type(const std::vector<base::uptr>& values)
+    {
+        for (auto& v : values) {
+            if (!base::is<T>(v.get())) {
+                return false;
+            }
+        }
+        return !values.empty();
+    }
+
+    /// typed array if every element is a number, a floating,
+    /// a boolean or a string; the heterogeneous array otherwise
+    template <typename CharT = char>
+    base::uptr make_array(std::vector<base::uptr> values)
+    {
+        using string_type = string<CharT>;
+        if (all_of_type<number>(values)) {
+            std::vector<std::int64_t> tmp;
+            tmp.reserve(values.size());
+            for (auto& v : values) {
+                tmp.push_back(base::cast<number>(v.get())->value());
+            }
+            return std::make_unique<number_array>(std::move(tmp));
+        } else if (all_of_type<floating>(values)) {
+            std::vector<double> tmp;
+            tmp.reserve(values.size());
+            for (auto& v : values) {
+                tmp.push_back(base::cast<floating>(v.get())->value());
+            }
+            return std::make_unique<floating_array>(std::move(tmp));
+        } else if (all_of_type<boolean>(values)) {
+            std::vector<std::uint8_t> tmp;
+            tmp.reserve(values.size());
+            for (auto& v : values) {
+                tmp.push_back(base::cast<boolean>(v.get())->value());
+            }
+            return std::make_unique<boolean_array>(std::move(tmp));
+        } else if (all_of_type<string_type>(values)) {
+            auto res = std::make_unique<string_array<CharT>>();
+            for (auto& v : values) {
+                res->push_back(base::cast<string_type>(v.get())->value());
+            }
+            return res;
+        }
+        return std::make_unique<array>(std::move(values));
+    }
+
     template <typename ObjT>
     class erules_define_template_object(interval, ObjT)
     {
@@ -338,6 +487,98 @@ namespace erules { namespace objects {
         std::unique_ptr<ObjT> right_;
     };
 
+    /// interval of numbers or floating: the endpoints are inline,
+    /// clone() is a single allocation. there are no boxed endpoints to
+    /// hand out, so left() and right() of the generic interval are
+    /// left_copy() and right_copy() here; change the endpoints with
+    /// set_left() and set_right()
+    template <typename ObjT, typename T>
+    class numeric_interval_object : public typed_object<interval<ObjT>> {
+        using super_type = typed_object<interval<ObjT>>;
+
+    public:
+        using interval_type = numeric_interval<T>;
+
+        numeric_interval_object(interval_type val)
+            : super_type("interval")
+            , value_(val)
+        {
+        }
+
+        numeric_interval_object(T low, T high, bool exclusive = false)
+            : numeric_interval_object(interval_type { low, high, exclusive })
+        {
+        }
+
+        numeric_interval_object(std::unique_ptr<ObjT> lft,
+                                std::unique_ptr<ObjT> rght)
+            : numeric_interval_object(lft->value(), rght->value())
+        {
+        }
+
+        numeric_interval_object()
+            : super_type("interval")
+        {
+        }
+
+        void set_value(interval_type val)
+        {
+            value_ = val;
+        }
+
+        interval_type value() const
+        {
+            return value_;
+        }
+
+        void set_left(std::unique_ptr<ObjT> val)
+        {
+            value_.low = val->value();
+        }
+
+        void set_right(std::unique_ptr<ObjT> val)
+        {
+            value_.high = val->value();
+        }
+
+        std::unique_ptr<ObjT> left_copy() const
+        {
+            return std::make_unique<ObjT>(value_.low);
+        }
+
+        std::unique_ptr<ObjT> right_copy() const
+        {
+            return std::make_unique<ObjT>(value_.high);
+        }
+
+        template <typename U>
+        bool contains(U val) const
+        {
+            return value_.contains(val);
+        }
+
+        base::uptr clone() const override
+        {
+            return std::make_unique<interval<ObjT>>(value_);
+        }
+
+    private:
+        interval_type value_;
+    };
+
+    template <>
+    class interval<number>
+        : public numeric_interval_object<number, std::int64_t> {
+    public:
+        using numeric_interval_object::numeric_interval_object;
+    };
+
+    template <>
+    class interval<floating>
+        : public numeric_interval_object<floating, double> {
+    public:
+        using numeric_interval_object::numeric_interval_object;
+    };
 
 }}
 
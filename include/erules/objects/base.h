@@ -1,11 +1,15 @@
 #ifndef ERULES_OBJECTS_BASE
 #define ERULES_OBJECTS_BASE
 
+#include <cstddef>
 #include <cstdlib>
 #include <functional>
 #include <memory>
+#include <stdexcept>
 #include <type_traits>
 
+#include "erules/arena.h"
+
 namespace erules { namespace objects {
 
     struct base {
@@ -95,6 +99,41 @@ namespace erules { namespace objects {
 
         virtual ~base() = default;
 
+        /// objects created while an arena is current are placed there,
+        /// the others come from the heap. the byte after the object
+        /// records which; deleting an arena object only runs its
+        /// destructor, the arena takes the memory back on reset()
+        static void* operator new(std::size_t size)
+        {
+            unsigned char* res = nullptr;
+            auto origin = origin_heap;
+            if (auto owner = arena::current()) {
+                res = static_cast<unsigned char*>(owner->allocate(size + 1));
+                origin = origin_arena;
+            } else {
+                res = static_cast<unsigned char*>(::operator new(size + 1));
+            }
+            res[size] = origin;
+            return res;
+        }
+
+        /// the destructor is virtual, so size is that of the whole object
+        static void operator delete(void* p, std::size_t size) noexcept
+        {
+            if (p && static_cast<unsigned char*>(p)[size] == origin_heap) {
+                ::operator delete(p);
+            }
+        }
+
+        static void* operator new(std::size_t, void* where) noexcept
+        {
+            return where;
+        }
+
+        static void operator delete(void*, void*) noexcept
+        {
+        }
+
         template <typename ToT>
         static const ToT* cast(cptr p)
         {
@@ -131,6 +170,12 @@ namespace erules { namespace objects {
             return std::shared_ptr<ToT>(p, static_cast<ToT*>(p.get()));
         }
 
+        template <typename T>
+        static bool is(cptr p)
+        {
+            return (p != nullptr) && (p->type_id() == info::create<T>()->id);
+        }
+
         std::uintptr_t type_id() const
         {
             return info_->id;
@@ -161,6 +206,9 @@ namespace erules { namespace objects {
         }
 
     private:
+        static constexpr unsigned char origin_heap = 0x48;
+        static constexpr unsigned char origin_arena = 0x41;
+
         const info::holder info_;
     };
 
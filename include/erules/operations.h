@@ -8,7 +8,8 @@ namespace erules { namespace objects { namespace oprerations {
     public:
         using id_type = IdType;
 
-        using function_type = std::function<base::uptr(base::ptr, base::ptr)>;
+        using function_type
+            = std::function<base::uptr(base::cptr, base::cptr)>;
         using index_type
             = std::tuple<id_type, base::info::holder, base::info::holder>;
         using map_type = std::map<index_type, function_type>;
@@ -44,7 +45,7 @@ namespace erules { namespace objects { namespace oprerations {
                      create_call<LeftT, RightT, CallT>(std::move(call)));
         }
 
-        base::uptr call(id_type op, base::ptr left, base::ptr right)
+        base::uptr call(id_type op, base::cptr left, base::cptr right) const
         {
             if (auto call = get(op, left, right)) {
                 return call(left, right);
@@ -53,13 +54,13 @@ namespace erules { namespace objects { namespace oprerations {
         }
 
         template <typename TargetObj>
-        std::unique_ptr<TargetObj> call_cast(id_type op, base::ptr left,
-                                             base::ptr right)
+        std::unique_ptr<TargetObj> call_cast(id_type op, base::cptr left,
+                                             base::cptr right) const
         {
             return base::cast<TargetObj>(call(op, left, right));
         }
 
-        function_type get(id_type op, base::ptr left, base::ptr right)
+        function_type get(id_type op, base::cptr left, base::cptr right) const
         {
             auto id
                 = std::make_tuple(op, left->type_info(), right->type_info());
@@ -71,7 +72,7 @@ namespace erules { namespace objects { namespace oprerations {
         }
 
         template <typename LeftT, typename RightT>
-        function_type get(id_type op)
+        function_type get(id_type op) const
         {
             auto id = std::make_tuple(op, base::info::create<LeftT>(),
                                       base::info::create<RightT>());
@@ -97,7 +98,7 @@ namespace erules { namespace objects { namespace oprerations {
     class unary {
     public:
         using id_type = IdType;
-        using function_type = std::function<base::uptr(base::ptr)>;
+        using function_type = std::function<base::uptr(base::cptr)>;
         using index_type = std::tuple<id_type, base::info::holder>;
         using map_type = std::map<index_type, function_type>;
 
@@ -116,7 +117,7 @@ namespace erules { namespace objects { namespace oprerations {
                      create_call<ValueT, CallT>(std::move(call)));
         }
 
-        base::uptr call(id_type op, base::ptr value)
+        base::uptr call(id_type op, base::cptr value) const
         {
             if (auto call = get(op, value)) {
                 return call(value);
@@ -125,12 +126,12 @@ namespace erules { namespace objects { namespace oprerations {
         }
 
         template <typename TargetObj>
-        std::unique_ptr<TargetObj> call_cast(id_type op, base::ptr val)
+        std::unique_ptr<TargetObj> call_cast(id_type op, base::cptr val) const
         {
             return base::cast<TargetObj>(call(op, val));
         }
 
-        function_type get(id_type op, base::ptr value)
+        function_type get(id_type op, base::cptr value) const
         {
             auto id = std::make_tuple(op, value->type_info());
             auto find = un_map_.find(id);
@@ -141,7 +142,7 @@ namespace erules { namespace objects { namespace oprerations {
         }
 
         template <typename ValueT>
-        function_type get(id_type op)
+        function_type get(id_type op) const
         {
             auto id = std::make_tuple(op, base::info::create<ValueT>());
             auto find = un_map_.find(id);
@@ -0,0 +1,247 @@
+#pragma once
+#include <memory>
+
+#include "erules/ast.h"
+#include "erules/literals.h"
+#include "erules/rules_basic_operations.h"
+
+namespace erules {
+
+/// Constant folding and boolean simplification over a parsed rule.
+/// The pass never modifies the source tree; it builds a new one.
+template <typename LexemT>
+class optimizer {
+public:
+    using lexem_type = LexemT;
+    using char_type = typename lexem_type::char_type;
+    using less_type = typename lexem_type::less_type;
+    using id_type = typename lexem_type::id_type;
+    using node_type = objects::ast::node<lexem_type>;
+    using node_uptr = typename node_type::uptr;
+    using literals_type = literals<lexem_type>;
+    using binary_type = objects::oprerations::binary<id_type>;
+    using unary_type = objects::oprerations::unary<id_type>;
+
+    /// folded strings longer than this stay in the tree as expressions
+    static constexpr std::size_t max_folded_string = 4096;
+
+    optimizer()
+        : binary_(operations::binary_operations<char_type, less_type>::get())
+        , unary_(operations::unary_operations<char_type, less_type>::get())
+    {
+    }
+
+    optimizer(binary_type binops, unary_type unops)
+        : binary_(std::move(binops))
+        , unary_(std::move(unops))
+    {
+    }
+
+    node_uptr optimize(const node_type* root)
+    {
+        if (objects::base::is<binary_node>(root)) {
+            return optimize_binary(objects::base::cast<binary_node>(root));
+        } else if (objects::base::is<prefix_node>(root)) {
+            return optimize_prefix(objects::base::cast<prefix_node>(root));
+        }
+        return clone(root);
+    }
+
+    node_uptr optimize(const node_uptr& root)
+    {
+        return optimize(root.get());
+    }
+
+    static bool is_bool_constant(const node_type* node, bool& value)
+    {
+        if (objects::base::is<value_node>(node)) {
+            switch (node->lexem().token()) {
+            case constants::token_type::BOOL_TRUE:
+                value = true;
+                return true;
+            case constants::token_type::BOOL_FALSE:
+                value = false;
+                return true;
+            default:
+                break;
+            }
+        }
+        return false;
+    }
+
+    /// nodes whose value is always a boolean: boolean literals,
+    /// comparisons, 'in', 'startswith', 'and', 'or' and 'not'
+    static bool is_boolean(const node_type* node)
+    {
+        bool value = false;
+        if (is_bool_constant(node, value)) {
+            return true;
+        } else if (objects::base::is<prefix_node>(node)) {
+            return node->lexem().token() == constants::token_type::NOT;
+        } else if (!objects::base::is<binary_node>(node)) {
+            return false;
+        }
+        switch (node->lexem().token()) {
+        case constants::token_type::AND:
+        case constants::token_type::OR:
+        case constants::token_type::IN:
+        case constants::token_type::EQ:
+        case constants::token_type::NOTEQ:
+        case constants::token_type::LT:
+        case constants::token_type::GT:
+        case constants::token_type::LEQ:
+        case constants::token_type::GEQ:
+        case constants::token_type::STARTSWITH:
+            return true;
+        default:
+            break;
+        }
+        return false;
+    }
+
+private:
+    using value_node = objects::ast::value<lexem_type>;
+    using binary_node = objects::ast::binary_operation<lexem_type>;
+    using prefix_node = objects::ast::prefix_operation<lexem_type>;
+
+    static node_uptr clone(const node_type* node)
+    {
+        if (!node) {
+            return {};
+        }
+        return node_uptr(static_cast<node_type*>(node->clone().release()));
+    }
+
+    node_uptr optimize_binary(const binary_node* node)
+    {
+        auto left = optimize(node->left().get());
+        auto right = optimize(node->right().get());
+
+        switch (node->lexem().token()) {
+        case constants::token_type::AND:
+            return fold_logic(node->lexem(), std::move(left), std::move(right),
+                              false);
+        case constants::token_type::OR:
+            return fold_logic(node->lexem(), std::move(left), std::move(right),
+                              true);
+        default:
+            break;
+        }
+
+        if (auto folded = fold_binary(node->lexem(), left.get(), right.get())) {
+            return folded;
+        }
+        return std::make_unique<binary_node>(node->lexem(), std::move(left),
+                                             std::move(right));
+    }
+
+    node_uptr optimize_prefix(const prefix_node* node)
+    {
+        auto value = optimize(node->value().get());
+        auto token = node->lexem().token();
+
+        if (token == constants::token_type::NOT
+            && objects::base::is<prefix_node>(value.get())) {
+            auto inner = objects::base::cast<prefix_node>(value.get());
+            if (inner->lexem().token() == constants::token_type::NOT
+                && is_boolean(inner->value().get())) {
+                /// not not x => x
+                return clone(inner->value().get());
+            }
+        }
+
+        if (objects::base::is<value_node>(value.get())) {
+            auto obj = literals_type::to_object(value->lexem());
+            if (obj) {
+                auto result = unary_.call(token, obj.get());
+                if (auto folded = make_value(node->lexem(), result.get())) {
+                    return folded;
+                }
+            }
+        }
+        return std::make_unique<prefix_node>(node->lexem(), std::move(value));
+    }
+
+    /// and: false dominates, true is neutral
+    /// or:  true dominates, false is neutral. the neutral one goes only
+    /// when the other side is a boolean: '5 and true' is true, not 5
+    static node_uptr fold_logic(const lexem_type& lex, node_uptr left,
+                                node_uptr right, bool dominant)
+    {
+        bool value = false;
+        if (is_bool_constant(left.get(), value)
+            && (value == dominant || is_boolean(right.get()))) {
+            return (value == dominant) ? std::move(left) : std::move(right);
+        }
+        if (is_bool_constant(right.get(), value)
+            && (value == dominant || is_boolean(left.get()))) {
+            return (value == dominant) ? std::move(right) : std::move(left);
+        }
+        return std::make_unique<binary_node>(lex, std::move(left),
+                                             std::move(right));
+    }
+
+    node_uptr fold_binary(const lexem_type& lex, const node_type* left,
+                          const node_type* right)
+    {
+        if (!objects::base::is<value_node>(left)
+            || !objects::base::is<value_node>(right)) {
+            return {};
+        }
+        auto lobj = literals_type::to_object(left->lexem());
+        auto robj = literals_type::to_object(right->lexem());
+        if (!lobj || !robj || !foldable(lex.token(), lobj.get(), robj.get())) {
+            return {};
+        }
+        auto result = binary_.call(lex.token(), lobj.get(), robj.get());
+        return make_value(lex, result.get());
+    }
+
+    /// rejects folds that would fail or explode at compile time
+    static bool foldable(id_type op, objects::base::cptr left,
+                         objects::base::cptr right)
+    {
+        using namespace objects;
+        using string_object = typename literals_type::string_object;
+        switch (op) {
+        case constants::token_type::DIV:
+        case constants::token_type::MOD:
+            return !base::is<number>(right)
+                || base::cast<number>(right)->value() != 0;
+        case constants::token_type::MUL:
+            if (base::is<string_object>(left) && base::is<number>(right)) {
+                return repeat_fits(base::cast<string_object>(left),
+                                   base::cast<number>(right));
+            } else if (base::is<number>(left)
+                       && base::is<string_object>(right)) {
+                return repeat_fits(base::cast<string_object>(right),
+                                   base::cast<number>(left));
+            }
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+
+    static bool repeat_fits(const typename literals_type::string_object* str,
+                            const objects::number* count)
+    {
+        return count->value() <= 0 || str->value().empty()
+            || static_cast<std::uint64_t>(count->value())
+            <= max_folded_string / str->value().size();
+    }
+
+    static node_uptr make_value(lexem_type lex, objects::base::cptr obj)
+    {
+        if (obj && literals_type::from_object(obj, lex)) {
+            return std::make_unique<value_node>(std::move(lex));
+        }
+        return {};
+    }
+
+    binary_type binary_;
+    unary_type unary_;
+};
+
+}
@@ -0,0 +1,349 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "erules/environment.h"
+#include "erules/objects.h"
+#include "erules/scalar.h"
+
+namespace erules {
+
+/// Describes how identifiers map to the fields of a user struct.
+/// Fields are resolved against the symbol table of the compiler,
+/// so a binding can serve every rule compiled with that table.
+/// Members of bool, fixed width integer, float, double, string and
+/// string view types are read through their member pointer; other
+/// members and computed fields go through a reader function.
+/// Unsigned 64 bit members above INT64_MAX read as floating values.
+template <typename RecordT, typename CharT = char,
+          typename LessT = std::less<CharT>>
+class record_binding {
+public:
+    using record_type = RecordT;
+    using string_type = std::basic_string<CharT>;
+    using string_view_type = std::basic_string_view<CharT>;
+    using symbol_table_type = symbol_table<CharT, LessT>;
+    using scalar_type = scalar<CharT>;
+    using kind_type = typename scalar_type::kind_type;
+    using reader_type = std::function<scalar_type(const record_type&)>;
+
+    /// the type of the member behind a field
+    enum class member_kind : std::uint8_t {
+        COMPUTED,
+        BOOLEAN,
+        INT8,
+        INT16,
+        INT32,
+        INT64,
+        UINT8,
+        UINT16,
+        UINT32,
+        UINT64,
+        FLOAT,
+        DOUBLE,
+        STRING,
+        STRING_VIEW,
+    };
+
+    struct field {
+        kind_type kind = kind_type::NONE;
+        member_kind type = member_kind::COMPUTED;
+        union {
+            bool RecordT::*boolean;
+            std::int8_t RecordT::*int8;
+            std::int16_t RecordT::*int16;
+            std::int32_t RecordT::*int32;
+            std::int64_t RecordT::*int64;
+            std::uint8_t RecordT::*uint8;
+            std::uint16_t RecordT::*uint16;
+            std::uint32_t RecordT::*uint32;
+            std::uint64_t RecordT::*uint64;
+            float RecordT::*float32;
+            double RecordT::*float64;
+            string_type RecordT::*string;
+            string_view_type RecordT::*string_view;
+        } member {};
+        reader_type compute;
+
+        scalar_type read(const RecordT& r) const
+        {
+            switch (type) {
+            case member_kind::BOOLEAN:
+                return scalar_type::make_boolean(r.*member.boolean);
+            case member_kind::INT8:
+                return scalar_type::make_integer(r.*member.int8);
+            case member_kind::INT16:
+                return scalar_type::make_integer(r.*member.int16);
+            case member_kind::INT32:
+                return scalar_type::make_integer(r.*member.int32);
+            case member_kind::INT64:
+                return scalar_type::make_integer(r.*member.int64);
+            case member_kind::UINT8:
+                return scalar_type::make_integer(r.*member.uint8);
+            case member_kind::UINT16:
+                return scalar_type::make_integer(r.*member.uint16);
+            case member_kind::UINT32:
+                return scalar_type::make_integer(r.*member.uint32);
+            case member_kind::UINT64:
+                return from_unsigned(r.*member.uint64);
+            case member_kind::FLOAT:
+                return scalar_type::make_floating(r.*member.float32);
+            case member_kind::DOUBLE:
+                return scalar_type::make_floating(r.*member.float64);
+            case member_kind::STRING:
+                return scalar_type::make_string(
+                    string_view_type(r.*member.string));
+            case member_kind::STRING_VIEW:
+                return scalar_type::make_string(r.*member.string_view);
+            default:
+                break;
+            }
+            return compute(r);
+        }
+    };
+
+    /// an unsigned 64 bit value is an integer up to INT64_MAX; above
+    /// it is the nearest double, so it keeps its sign and its order
+    /// with other numbers but loses the low bits
+    static scalar_type from_unsigned(std::uint64_t value)
+    {
+        constexpr auto most = static_cast<std::uint64_t>(INT64_MAX);
+        if (value <= most) {
+            return scalar_type::make_integer(
+                static_cast<std::int64_t>(value));
+        }
+        return scalar_type::make_floating(static_cast<double>(value));
+    }
+
+    record_binding(std::shared_ptr<symbol_table_type> symbols)
+        : symbols_(std::move(symbols))
+    {
+    }
+
+    /// integral, floating, bool, string or string view members
+    template <typename MemberT>
+    record_binding& add(const string_type& name, MemberT RecordT::*member)
+    {
+        using member_type = std::decay_t<MemberT>;
+        field direct;
+        if (place(direct, member)) {
+            return add(name, std::move(direct));
+        } else if constexpr (std::is_same<member_type, bool>::value) {
+            return add(name, kind_type::BOOLEAN, [member](const RecordT& r) {
+                return scalar_type::make_boolean(r.*member);
+            });
+        } else if constexpr (std::is_integral<member_type>::value
+                             && std::is_unsigned<member_type>::value
+                             && sizeof(member_type) >= 8) {
+            return add(name, kind_type::INTEGER, [member](const RecordT& r) {
+                return from_unsigned(static_cast<std::uint64_t>(r.*member));
+            });
+        } else if constexpr (std::is_integral<member_type>::value) {
+            return add(name, kind_type::INTEGER, [member](const RecordT& r) {
+                return scalar_type::make_integer(
+                    static_cast<std::int64_t>(r.*member));
+            });
+        } else if constexpr (std::is_floating_point<member_type>::value) {
+            return add(name, kind_type::FLOATING, [member](const RecordT& r) {
+                return scalar_type::make_floating(
+                    static_cast<double>(r.*member));
+            });
+        } else {
+            static_assert(
+                std::is_convertible<const member_type&,
+                                    string_view_type>::value,
+                "field must be integral, floating, bool or a string");
+            return add(name, kind_type::STRING, [member](const RecordT& r) {
+                return scalar_type::make_string(string_view_type(r.*member));
+            });
+        }
+    }
+
+    /// computed field
+    record_binding& add(const string_type& name, kind_type kind,
+                        reader_type reader)
+    {
+        field computed;
+        computed.kind = kind;
+        computed.compute = std::move(reader);
+        return add(name, std::move(computed));
+    }
+
+    const field* get(std::size_t slot) const
+    {
+        if (slot < fields_.size() && fields_[slot].kind != kind_type::NONE) {
+            return &fields_[slot];
+        }
+        return nullptr;
+    }
+
+    std::size_t size() const
+    {
+        return fields_.size();
+    }
+
+    const std::shared_ptr<symbol_table_type>& symbols() const
+    {
+        return symbols_;
+    }
+
+private:
+    record_binding& add(const string_type& name, field value)
+    {
+        auto slot = symbols_->resolve(name);
+        if (slot >= fields_.size()) {
+            fields_.resize(slot + 1);
+        }
+        fields_[slot] = std::move(value);
+        return *this;
+    }
+
+    /// members of other types are not placed and get a reader
+    template <typename MemberT>
+    static bool place(field&, MemberT RecordT::*)
+    {
+        return false;
+    }
+
+    static bool place(field& f, bool RecordT::*member)
+    {
+        f.member.boolean = member;
+        return typed(f, member_kind::BOOLEAN, kind_type::BOOLEAN);
+    }
+
+    static bool place(field& f, std::int8_t RecordT::*member)
+    {
+        f.member.int8 = member;
+        return typed(f, member_kind::INT8, kind_type::INTEGER);
+    }
+
+    static bool place(field& f, std::int16_t RecordT::*member)
+    {
+        f.member.int16 = member;
+        return typed(f, member_kind::INT16, kind_type::INTEGER);
+    }
+
+    static bool place(field& f, std::int32_t RecordT::*member)
+    {
+        f.member.int32 = member;
+        return typed(f, member_kind::INT32, kind_type::INTEGER);
+    }
+
+    static bool place(field& f, std::int64_t RecordT::*member)
+    {
+        f.member.int64 = member;
+        return typed(f, member_kind::INT64, kind_type::INTEGER);
+    }
+
+    static bool place(field& f, std::uint8_t RecordT::*member)
+    {
+        f.member.uint8 = member;
+        return typed(f, member_kind::UINT8, kind_type::INTEGER);
+    }
+
+    static bool place(field& f, std::uint16_t RecordT::*member)
+    {
+        f.member.uint16 = member;
+        return typed(f, member_kind::UINT16, kind_type::INTEGER);
+    }
+
+    static bool place(field& f, std::uint32_t RecordT::*member)
+    {
+        f.member.uint32 = member;
+        return typed(f, member_kind::UINT32, kind_type::INTEGER);
+    }
+
+    static bool place(field& f, std::uint64_t RecordT::*member)
+    {
+        f.member.uint64 = member;
+        return typed(f, member_kind::UINT64, kind_type::INTEGER);
+    }
+
+    static bool place(field& f, float RecordT::*member)
+    {
+        f.member.float32 = member;
+        return typed(f, member_kind::FLOAT, kind_type::FLOATING);
+    }
+
+    static bool place(field& f, double RecordT::*member)
+    {
+        f.member.float64 = member;
+        return typed(f, member_kind::DOUBLE, kind_type::FLOATING);
+    }
+
+    static bool place(field& f, string_type RecordT::*member)
+    {
+        f.member.string = member;
+        return typed(f, member_kind::STRING, kind_type::STRING);
+    }
+
+    static bool place(field& f, string_view_type RecordT::*member)
+    {
+        f.member.string_view = member;
+        return typed(f, member_kind::STRING_VIEW, kind_type::STRING);
+    }
+
+    static bool typed(field& f, member_kind type, kind_type kind)
+    {
+        f.type = type;
+        f.kind = kind;
+        return true;
+    }
+
+    std::shared_ptr<symbol_table_type> symbols_;
+    std::vector<field> fields_;
+};
+
+/// Environment over one bound record.
+/// read() goes straight to the struct. The environment keeps no
+/// objects: get() returns nullptr and context::get() boxes the value
+/// in the arena of the context, so one environment can serve several
+/// contexts as long as the bound record doesn't change under them.
+template <typename RecordT, typename CharT = char,
+          typename LessT = std::less<CharT>>
+class record_environment : public environment<CharT, LessT> {
+public:
+    using super_type = environment<CharT, LessT>;
+    using binding_type = record_binding<RecordT, CharT, LessT>;
+    using scalar_type = typename super_type::scalar_type;
+
+    record_environment(std::shared_ptr<const binding_type> binding)
+        : binding_(std::move(binding))
+    {
+    }
+
+    void bind(const RecordT& record)
+    {
+        record_ = &record;
+    }
+
+    const RecordT* record() const
+    {
+        return record_;
+    }
+
+    scalar_type read(std::size_t slot) const override
+    {
+        auto field = binding_->get(slot);
+        if (!field || !record_) {
+            return {};
+        }
+        return field->read(*record_);
+    }
+
+    objects::base::cptr get(std::size_t) const override
+    {
+        return nullptr;
+    }
+
+private:
+    std::shared_ptr<const binding_type> binding_;
+    const RecordT* record_ = nullptr;
+};
+
+}
@@ -0,0 +1,230 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "erules/compiler.h"
+#include "erules/rule_lexer.h"
+#include "erules/rule_parser.h"
+
+namespace erules {
+
+/// Compiled rules by their text, for the same filters arriving again and
+/// again. Texts are normalized first, so spacing does not matter; get()
+/// with canonical = true skips that when the caller already did it.
+/// At most capacity rules are kept, the least recently used one goes
+/// first. Lookups can run on any number of threads; compilation runs one
+/// at a time and outside of the lookups. Rules stay valid after eviction
+/// for as long as a caller holds them.
+/// Every rule has a constant pool of its own, released with the rule, so
+/// the literals of evicted rules do not pile up. The symbol table is
+/// shared, environments are built on it while get() compiles new rules;
+/// it locks itself and grows with the distinct identifiers only.
+template <typename CharT, typename LessT = std::less<CharT>>
+class rule_cache {
+public:
+    using lexer_type = filters::lexer<CharT, LessT>;
+    using lexem_type = typename lexer_type::lexem_type;
+    using parser_type = rule_parser<lexem_type>;
+    using compiler_type = compiler<lexem_type>;
+    using rule_type = typename compiler_type::rule_type;
+    using rule_ptr = std::shared_ptr<const rule_type>;
+    using string_type = std::basic_string<CharT>;
+    using symbol_table_type = typename compiler_type::symbol_table_type;
+
+    struct statistics {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+        std::size_t size = 0;
+    };
+
+    explicit rule_cache(std::size_t capacity = 1024)
+        : rule_cache(capacity, std::make_shared<symbol_table_type>())
+    {
+    }
+
+    rule_cache(std::size_t capacity, std::shared_ptr<symbol_table_type> symbols)
+        : capacity_(std::max<std::size_t>(capacity, 1))
+        , compiler_(std::move(symbols))
+    {
+    }
+
+    rule_cache(const rule_cache&) = delete;
+    rule_cache& operator=(const rule_cache&) = delete;
+
+    const std::shared_ptr<symbol_table_type>& symbols() const
+    {
+        return compiler_.symbols();
+    }
+
+    std::size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    /// the compiled rule for text. errors of the lexer, the parser and
+    /// the compiler are thrown and nothing is cached
+    rule_ptr get(const string_type& text, bool canonical = false)
+    {
+        auto key = canonical ? text : normalize(text);
+        if (auto found = lookup(key)) {
+            return found;
+        }
+        rule_ptr rule;
+        {
+            std::lock_guard<std::mutex> guard(compile_lock_);
+            lexer_type lex;
+            parser_type pars(lex.read_all(text));
+            auto tree = pars.parse();
+            if (!pars.complete()) {
+                throw std::runtime_error(
+                    "rule_cache: unexpected lexem after the rule");
+            }
+            compiler_.reset_constants();
+            rule = std::make_shared<const rule_type>(
+                compiler_.compile(tree));
+        }
+        return insert(std::move(key), std::move(rule));
+    }
+
+    statistics stats() const
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto res = stats_;
+        res.size = order_.size();
+        return res;
+    }
+
+    /// drops every rule, the statistics stay
+    void clear()
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        entries_.clear();
+        order_.clear();
+    }
+
+    /// the cache key of a text: whitespace outside of quotes and
+    /// brackets becomes one space between two word characters or two
+    /// operator characters and goes away elsewhere. quoted text is kept
+    /// as it is
+    static string_type normalize(const string_type& text)
+    {
+        string_type res;
+        res.reserve(text.size());
+        bool space = false;
+        CharT close = 0;
+        for (std::size_t i = 0; i < text.size(); ++i) {
+            auto c = text[i];
+            if (close) {
+                res += c;
+                if (c == static_cast<CharT>('\\') && i + 1 < text.size()) {
+                    res += text[++i];
+                } else if (c == close) {
+                    close = 0;
+                }
+                continue;
+            }
+            if (is_space(c)) {
+                space = true;
+                continue;
+            }
+            if (space && !res.empty() && class_of(res.back()) == class_of(c)
+                && class_of(c) != char_class::DELIMITER) {
+                res += static_cast<CharT>(' ');
+            }
+            space = false;
+            res += c;
+            if (c == static_cast<CharT>('"') || c == static_cast<CharT>('\'')) {
+                close = c;
+            } else if (c == static_cast<CharT>('[')) {
+                close = static_cast<CharT>(']');
+            }
+        }
+        return res;
+    }
+
+private:
+    using order_list = std::list<std::pair<string_type, rule_ptr>>;
+
+    rule_ptr lookup(const string_type& key)
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto found = entries_.find(key);
+        if (found == entries_.end()) {
+            ++stats_.misses;
+            return nullptr;
+        }
+        ++stats_.hits;
+        order_.splice(order_.begin(), order_, found->second);
+        return found->second->second;
+    }
+
+    /// another thread may have compiled the same text meanwhile; the
+    /// first rule stays
+    rule_ptr insert(string_type key, rule_ptr rule)
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto found = entries_.find(key);
+        if (found != entries_.end()) {
+            order_.splice(order_.begin(), order_, found->second);
+            return found->second->second;
+        }
+        order_.emplace_front(std::move(key), std::move(rule));
+        entries_.emplace(order_.front().first, order_.begin());
+        while (order_.size() > capacity_) {
+            entries_.erase(order_.back().first);
+            order_.pop_back();
+            ++stats_.evictions;
+        }
+        return order_.front().second;
+    }
+
+    static bool is_space(CharT c)
+    {
+        return c == static_cast<CharT>(' ') || c == static_cast<CharT>('\t')
+            || c == static_cast<CharT>('\n') || c == static_cast<CharT>('\r');
+    }
+
+    enum class char_class { WORD, OPERATOR, DELIMITER };
+
+    /// words are identifiers, keywords and numbers
+    static char_class class_of(CharT c)
+    {
+        auto code = static_cast<std::uint32_t>(c);
+        if ((code >= 'a' && code <= 'z') || (code >= 'A' && code <= 'Z')
+            || (code >= '0' && code <= '9') || code == '_' || code == '.'
+            || code > 127) {
+            return char_class::WORD;
+        }
+        switch (code) {
+        case '"':
+        case '\'':
+        case '[':
+        case ']':
+        case '(':
+        case ')':
+        case ',':
+            return char_class::DELIMITER;
+        default:
+            break;
+        }
+        return char_class::OPERATOR;
+    }
+
+    std::size_t capacity_;
+    mutable std::mutex lock_;
+    std::mutex compile_lock_;
+    compiler_type compiler_;
+    order_list order_;
+    std::unordered_map<string_type, typename order_list::iterator> entries_;
+    statistics stats_;
+};
+
+}
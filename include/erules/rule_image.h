@@ -0,0 +1,1106 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "erules/bitset.h"
+#include "erules/compiler.h"
+#include "erules/interval.h"
+#include "erules/mapped_file.h"
+#include "erules/rule_runtime.h"
+#include "erules/rule_set.h"
+
+namespace erules {
+
+/// Layout of a rule image: a header, then sections of fixed size records,
+/// each starting at a multiple of 8 bytes. Records refer to each other by
+/// index and to the string data by offset, so an image is evaluated where
+/// it lies, without fix-ups. Numbers and characters are stored as the
+/// writer has them; the header records the byte order and the character
+/// size, and a reader refuses images that differ.
+namespace image_format {
+
+    constexpr char magic[8] = { 'e', 'r', 'u', 'l', 'e', 's', 'i', 'm' };
+    constexpr std::uint32_t version = 1;
+    constexpr std::uint32_t byte_order = 0x01020304;
+
+    enum class node_kind : std::uint8_t { IDENT, VALUE, PREFIX, BINARY };
+
+    enum class value_kind : std::uint32_t {
+        INTEGER,
+        FLOATING,
+        BOOLEAN,
+        STRING
+    };
+
+    /// offset in bytes from the start of the image, count in records
+    struct section {
+        std::uint64_t offset;
+        std::uint64_t count;
+    };
+
+    struct header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byte_order;
+        std::uint32_t char_size;
+        std::uint32_t reserved;
+        section symbols;
+        section nodes;
+        section constants;
+        section rules;
+        section conjuncts;
+        section unindexed;
+        section slots;
+        section entries;
+        section strings;
+    };
+
+    /// a name, in characters of the strings section
+    struct symbol {
+        std::uint32_t offset;
+        std::uint32_t length;
+    };
+
+    /// operands are earlier nodes. first is the slot of an identifier,
+    /// the constant of a value, the operand of a prefix operation or the
+    /// left operand of a binary one
+    struct node {
+        node_kind kind;
+        std::uint8_t reserved;
+        std::uint16_t token;
+        std::uint32_t first;
+        std::uint32_t second;
+    };
+
+    /// bits hold the integer, the double, the boolean or the offset of
+    /// the string
+    struct constant {
+        value_kind kind;
+        std::uint32_t length;
+        std::uint64_t bits;
+    };
+
+    /// the conjuncts left after indexing are conjuncts[first, +count)
+    struct rule {
+        std::uint32_t root;
+        std::uint32_t required;
+        std::uint32_t first;
+        std::uint32_t count;
+    };
+
+    /// entries[first, +count) are the indexed conjuncts over one slot
+    struct index {
+        std::uint32_t slot;
+        std::uint32_t first;
+        std::uint32_t count;
+        std::uint32_t reserved;
+    };
+
+    /// an 'ident = literal' conjunct; sorted by kind, then value
+    struct entry {
+        value_kind kind;
+        std::uint32_t length;
+        std::uint32_t rule;
+        std::uint32_t reserved;
+        std::uint64_t bits;
+    };
+
+    static_assert(sizeof(header) == 168, "rule image header");
+    static_assert(sizeof(node) == 12, "rule image node");
+    static_assert(sizeof(constant) == 16, "rule image constant");
+    static_assert(sizeof(entry) == 24, "rule image entry");
+
+    template <typename CharT>
+    scalar<CharT> decode(value_kind kind, std::uint64_t bits,
+                         std::uint32_t length, const CharT* strings)
+    {
+        using scalar_type = scalar<CharT>;
+        switch (kind) {
+        case value_kind::INTEGER:
+            return scalar_type::make_integer(static_cast<std::int64_t>(bits));
+        case value_kind::FLOATING: {
+            double value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return scalar_type::make_floating(value);
+        }
+        case value_kind::BOOLEAN:
+            return scalar_type::make_boolean(bits != 0);
+        default:
+            break;
+        }
+        return scalar_type::make_string(
+            typename scalar_type::string_view_type(strings + bits, length));
+    }
+
+    /// order of two values of one kind
+    template <typename CharT>
+    bool less(const scalar<CharT>& l, const scalar<CharT>& r)
+    {
+        using kind_type = typename scalar<CharT>::kind_type;
+        switch (l.kind) {
+        case kind_type::INTEGER:
+            return l.integer < r.integer;
+        case kind_type::FLOATING:
+            return l.floating < r.floating;
+        case kind_type::BOOLEAN:
+            return l.boolean < r.boolean;
+        default:
+            break;
+        }
+        return l.string < r.string;
+    }
+}
+
+/// Writes a rule set as an image for rule_image.
+/// Rules are optimized and flattened into nodes in post order; literals
+/// go to a constant table and their strings, like the identifier names,
+/// to one string section. Top level 'ident = literal' conjuncts are
+/// indexed by slot, kind and value, the way rule_set indexes them.
+template <typename LexemT>
+class rule_image_writer {
+public:
+    using lexem_type = LexemT;
+    using compiler_type = compiler<lexem_type>;
+    using char_type = typename compiler_type::char_type;
+    using string_type = typename compiler_type::string_type;
+    using node_type = typename compiler_type::node_type;
+    using symbol_table_type = typename compiler_type::symbol_table_type;
+    using scalar_type = typename compiler_type::scalar_type;
+
+    rule_image_writer()
+        : rule_image_writer(std::make_shared<symbol_table_type>())
+    {
+    }
+
+    rule_image_writer(std::shared_ptr<symbol_table_type> symbols)
+        : compiler_(std::move(symbols))
+    {
+    }
+
+    const std::shared_ptr<symbol_table_type>& symbols() const
+    {
+        return compiler_.symbols();
+    }
+
+    /// ids are dense, in the order the rules are added
+    std::size_t add(const node_type* root)
+    {
+        if (!root) {
+            throw std::runtime_error("rule_image: empty rule");
+        }
+        auto id = to_index(rules_.size());
+        auto optimized = compiler_.optimize(root);
+        std::vector<std::pair<const node_type*, std::uint32_t>> conjuncts;
+        image_format::rule rule {};
+        rule.root = emit_conjunction(optimized.get(), conjuncts);
+        rule.first = to_index(conjuncts_.size());
+        for (auto& conjunct : conjuncts) {
+            if (index_equality(conjunct.first, id)) {
+                ++rule.required;
+            } else {
+                conjuncts_.emplace_back(conjunct.second);
+            }
+        }
+        rule.count = to_index(conjuncts_.size()) - rule.first;
+        if (rule.required == 0) {
+            unindexed_.emplace_back(id);
+        }
+        rules_.emplace_back(rule);
+        return id;
+    }
+
+    std::size_t add(const typename node_type::uptr& root)
+    {
+        return add(root.get());
+    }
+
+    std::size_t size() const
+    {
+        return rules_.size();
+    }
+
+    /// the image in 8 byte words, aligned as rule_image expects
+    std::vector<std::uint64_t> serialize()
+    {
+        std::vector<image_format::symbol> names;
+        for (std::size_t i = 0; i < symbols()->size(); ++i) {
+            auto& name = symbols()->name(i);
+            names.push_back({ add_string(name), to_index(name.size()) });
+        }
+        std::vector<image_format::index> slots;
+        std::vector<image_format::entry> entries;
+        sort_entries(slots, entries);
+
+        image_format::header head {};
+        std::memcpy(head.magic, image_format::magic, sizeof(head.magic));
+        head.version = image_format::version;
+        head.byte_order = image_format::byte_order;
+        head.char_size = sizeof(char_type);
+        std::uint64_t end = sizeof(image_format::header);
+        head.symbols = place(end, names);
+        head.nodes = place(end, nodes_);
+        head.constants = place(end, constants_);
+        head.rules = place(end, rules_);
+        head.conjuncts = place(end, conjuncts_);
+        head.unindexed = place(end, unindexed_);
+        head.slots = place(end, slots);
+        head.entries = place(end, entries);
+        head.strings = place(end, strings_);
+
+        std::vector<std::uint64_t> res(end / 8, 0);
+        auto base = reinterpret_cast<char*>(res.data());
+        std::memcpy(base, &head, sizeof(head));
+        copy(base, head.symbols, names);
+        copy(base, head.nodes, nodes_);
+        copy(base, head.constants, constants_);
+        copy(base, head.rules, rules_);
+        copy(base, head.conjuncts, conjuncts_);
+        copy(base, head.unindexed, unindexed_);
+        copy(base, head.slots, slots);
+        copy(base, head.entries, entries);
+        copy(base, head.strings, strings_);
+        return res;
+    }
+
+    void save(std::ostream& out)
+    {
+        auto words = serialize();
+        out.write(reinterpret_cast<const char*>(words.data()),
+                  static_cast<std::streamsize>(words.size() * 8));
+        if (!out) {
+            throw std::runtime_error("rule_image: write failed");
+        }
+    }
+
+private:
+    using value_node = objects::ast::value<lexem_type>;
+    using ident_node = objects::ast::ident<lexem_type>;
+    using binary_node = objects::ast::binary_operation<lexem_type>;
+    using prefix_node = objects::ast::prefix_operation<lexem_type>;
+    using literals_type = typename compiler_type::literals_type;
+    using string_object = typename literals_type::string_object;
+    using node_kind = image_format::node_kind;
+    using value_kind = image_format::value_kind;
+
+    /// an indexed conjunct before the entries are sorted
+    struct pending {
+        std::uint32_t slot;
+        image_format::entry entry;
+    };
+
+    static std::uint32_t to_index(std::size_t value)
+    {
+        if (value > 0xFFFFFFFFu) {
+            throw std::runtime_error("rule_image: too large");
+        }
+        return static_cast<std::uint32_t>(value);
+    }
+
+    /// 'a and b and ...' at the top of a rule; every operand is a
+    /// conjunct. returns the node of the whole expression
+    std::uint32_t emit_conjunction(
+        const node_type* node,
+        std::vector<std::pair<const node_type*, std::uint32_t>>& out)
+    {
+        if (objects::base::is<binary_node>(node)
+            && node->lexem().token() == constants::token_type::AND) {
+            auto bin = objects::base::cast<binary_node>(node);
+            auto left = emit_conjunction(bin->left().get(), out);
+            auto right = emit_conjunction(bin->right().get(), out);
+            return push(node_kind::BINARY, node, left, right);
+        }
+        auto res = emit(node);
+        out.emplace_back(node, res);
+        return res;
+    }
+
+    std::uint32_t emit(const node_type* node)
+    {
+        using namespace objects;
+        if (base::is<ident_node>(node)) {
+            auto slot = symbols()->resolve(node->lexem().value());
+            return push(node_kind::IDENT, node, to_index(slot), 0);
+        } else if (base::is<value_node>(node)) {
+            return push(node_kind::VALUE, node, constant(node), 0);
+        } else if (base::is<prefix_node>(node)) {
+            auto operand = emit(base::cast<prefix_node>(node)->value().get());
+            return push(node_kind::PREFIX, node, operand, 0);
+        } else if (base::is<binary_node>(node)) {
+            auto bin = base::cast<binary_node>(node);
+            auto left = emit(bin->left().get());
+            auto right = emit(bin->right().get());
+            return push(node_kind::BINARY, node, left, right);
+        }
+        throw std::runtime_error(std::string("rule_image: unsupported node ")
+                                 + (node ? node->type_name() : "null"));
+    }
+
+    std::uint32_t push(node_kind kind, const node_type* node,
+                       std::uint32_t first, std::uint32_t second)
+    {
+        auto token = static_cast<std::size_t>(node->lexem().token());
+        if (token > 0xFFFFu) {
+            throw std::runtime_error("rule_image: bad token");
+        }
+        nodes_.push_back({ kind, 0, static_cast<std::uint16_t>(token), first,
+                           second });
+        return to_index(nodes_.size() - 1);
+    }
+
+    /// the literal as a constant record, without the table
+    image_format::constant encode(const node_type* node)
+    {
+        using namespace objects;
+        auto literal = literals_type::to_object(node->lexem());
+        image_format::constant res {};
+        if (base::is<number>(literal.get())) {
+            res.kind = value_kind::INTEGER;
+            res.bits = static_cast<std::uint64_t>(
+                base::cast<number>(literal.get())->value());
+        } else if (base::is<floating>(literal.get())) {
+            auto value = base::cast<floating>(literal.get())->value();
+            res.kind = value_kind::FLOATING;
+            std::memcpy(&res.bits, &value, sizeof(value));
+        } else if (base::is<boolean>(literal.get())) {
+            res.kind = value_kind::BOOLEAN;
+            res.bits = base::cast<boolean>(literal.get())->value() ? 1 : 0;
+        } else if (base::is<string_object>(literal.get())) {
+            auto& value = base::cast<string_object>(literal.get())->value();
+            res.kind = value_kind::STRING;
+            res.bits = add_string(value);
+            res.length = to_index(value.size());
+        } else {
+            throw std::runtime_error("rule_image: bad literal");
+        }
+        return res;
+    }
+
+    /// equal literals share one constant
+    std::uint32_t constant(const node_type* node)
+    {
+        auto value = encode(node);
+        auto key = std::make_tuple(static_cast<std::uint32_t>(value.kind),
+                                   value.bits, value.length);
+        auto found = constant_ids_.find(key);
+        if (found != constant_ids_.end()) {
+            return found->second;
+        }
+        auto id = to_index(constants_.size());
+        constants_.emplace_back(value);
+        constant_ids_.emplace(key, id);
+        return id;
+    }
+
+    std::uint32_t add_string(const string_type& value)
+    {
+        auto found = string_ids_.find(value);
+        if (found != string_ids_.end()) {
+            return found->second;
+        }
+        auto offset = to_index(strings_.size());
+        if (strings_.size() + value.size() > 0xFFFFFFFFu) {
+            throw std::runtime_error("rule_image: too large");
+        }
+        strings_.insert(strings_.end(), value.begin(), value.end());
+        string_ids_.emplace(value, offset);
+        return offset;
+    }
+
+    /// 'ident = literal' in either order, with the literals rule_set
+    /// indexes
+    bool index_equality(const node_type* node, std::uint32_t id)
+    {
+        using namespace objects;
+        if (!base::is<binary_node>(node)
+            || node->lexem().token() != constants::token_type::EQ) {
+            return false;
+        }
+        auto bin = base::cast<binary_node>(node);
+        const node_type* ident = bin->left().get();
+        const node_type* value = bin->right().get();
+        if (!base::is<ident_node>(ident)) {
+            std::swap(ident, value);
+        }
+        if (!base::is<ident_node>(ident) || !base::is<value_node>(value)) {
+            return false;
+        }
+        auto object = literals_type::to_object(value->lexem());
+        if (!object || !rule_set<lexem_type>::exact_key(object.get())) {
+            return false;
+        }
+        auto literal = encode(value);
+        auto slot = symbols()->resolve(ident->lexem().value());
+        pending_.push_back({ to_index(slot),
+                             { literal.kind, literal.length, id, 0,
+                               literal.bits } });
+        return true;
+    }
+
+    void sort_entries(std::vector<image_format::index>& slots,
+                      std::vector<image_format::entry>& entries)
+    {
+        auto strings = strings_.data();
+        auto value = [strings](const image_format::entry& e) {
+            return image_format::decode(e.kind, e.bits, e.length, strings);
+        };
+        std::stable_sort(
+            pending_.begin(), pending_.end(),
+            [&value](const pending& l, const pending& r) {
+                if (l.slot != r.slot) {
+                    return l.slot < r.slot;
+                } else if (l.entry.kind != r.entry.kind) {
+                    return l.entry.kind < r.entry.kind;
+                }
+                return image_format::less(value(l.entry), value(r.entry));
+            });
+        for (auto& item : pending_) {
+            if (slots.empty() || slots.back().slot != item.slot) {
+                slots.push_back({ item.slot, to_index(entries.size()), 0, 0 });
+            }
+            ++slots.back().count;
+            entries.emplace_back(item.entry);
+        }
+    }
+
+    template <typename T>
+    static image_format::section place(std::uint64_t& end,
+                                       const std::vector<T>& items)
+    {
+        image_format::section res { end, items.size() };
+        end += (items.size() * sizeof(T) + 7) / 8 * 8;
+        return res;
+    }
+
+    template <typename T>
+    static void copy(char* base, const image_format::section& where,
+                     const std::vector<T>& items)
+    {
+        if (!items.empty()) {
+            std::memcpy(base + where.offset, items.data(),
+                        items.size() * sizeof(T));
+        }
+    }
+
+    compiler_type compiler_;
+    std::vector<image_format::node> nodes_;
+    std::vector<image_format::constant> constants_;
+    std::vector<image_format::rule> rules_;
+    std::vector<std::uint32_t> conjuncts_;
+    std::vector<std::uint32_t> unindexed_;
+    std::vector<pending> pending_;
+    std::vector<char_type> strings_;
+    std::map<std::tuple<std::uint32_t, std::uint64_t, std::uint32_t>,
+             std::uint32_t>
+        constant_ids_;
+    std::map<string_type, std::uint32_t> string_ids_;
+};
+
+/// A rule set evaluated in place from an image of rule_image_writer,
+/// typically a mapped_file. Opening checks the bounds of every record
+/// once and builds nothing; the image must stay alive and unchanged.
+/// Evaluation follows the compiled closures: unboxed operations first,
+/// the operation maps for anything else. Environments read through
+/// make_symbols(), or any table with the same slots for these names.
+/// Matching is const and can run on any number of threads, with one
+/// context and match state per thread.
+template <typename CharT, typename LessT = std::less<CharT>>
+class rule_image {
+public:
+    using lexem_type = filters::rule_lexem<CharT, LessT>;
+    using compiler_type = compiler<lexem_type>;
+    using context_type = typename compiler_type::context_type;
+    using environment_type = typename compiler_type::environment_type;
+    using symbol_table_type = typename compiler_type::symbol_table_type;
+    using scalar_type = typename compiler_type::scalar_type;
+    using string_view_type = typename scalar_type::string_view_type;
+
+    /// scratch of one match() call. reuse it to avoid allocations
+    struct match_state {
+        std::vector<std::uint32_t> counts;
+        std::vector<std::uint32_t> touched;
+        rule_bitset matched;
+    };
+
+    /// data is aligned to 8 bytes
+    rule_image(const void* data, std::size_t size)
+        : binary_(operations::binary_operations<CharT, LessT>::get())
+        , unary_(operations::unary_operations<CharT, LessT>::get())
+    {
+        open(static_cast<const char*>(data), size);
+    }
+
+    /// rules in the image
+    std::size_t size() const
+    {
+        return head_->rules.count;
+    }
+
+    std::size_t symbol_count() const
+    {
+        return head_->symbols.count;
+    }
+
+    string_view_type symbol(std::size_t slot) const
+    {
+        return string_view_type(strings_ + symbols_[slot].offset,
+                                symbols_[slot].length);
+    }
+
+    /// a table with the slots of the image
+    std::shared_ptr<symbol_table_type> make_symbols() const
+    {
+        auto res = std::make_shared<symbol_table_type>();
+        for (std::size_t i = 0; i < symbol_count(); ++i) {
+            auto name = symbol(i);
+            res->resolve(typename symbol_table_type::string_type(
+                name.begin(), name.end()));
+        }
+        return res;
+    }
+
+    /// the matching rules as the bits of a set of size() bits
+    void match(context_type& ctx, match_state& state, rule_bitset& out) const
+    {
+        out.resize(size());
+        out.clear();
+        auto& counts = state.counts;
+        auto& touched = state.touched;
+        counts.resize(size(), 0);
+        touched.clear();
+        auto hit = [&counts, &touched](std::uint32_t id) {
+            if (counts[id]++ == 0) {
+                touched.emplace_back(id);
+            }
+        };
+        for (std::size_t i = 0; i < head_->slots.count; ++i) {
+            collect(slots_[i], ctx.read(slots_[i].slot), hit);
+        }
+        for (auto id : touched) {
+            if (counts[id] == rules_[id].required && residual(id, ctx)) {
+                out.set(id);
+            }
+            counts[id] = 0;
+        }
+        for (std::size_t i = 0; i < head_->unindexed.count; ++i) {
+            if (residual(unindexed_[i], ctx)) {
+                out.set(unindexed_[i]);
+            }
+        }
+    }
+
+    /// ids of the matching rules, ascending
+    void match(context_type& ctx, match_state& state,
+               std::vector<std::size_t>& out) const
+    {
+        match(ctx, state, state.matched);
+        state.matched.append_to(out);
+    }
+
+    std::vector<std::size_t> match(const environment_type& env) const
+    {
+        context_type ctx(env);
+        match_state state;
+        std::vector<std::size_t> out;
+        match(ctx, state, out);
+        return out;
+    }
+
+    /// one rule, the whole expression, without the index
+    bool test(std::size_t id, context_type& ctx) const
+    {
+        auto res = predicate(rules_[id].root, ctx);
+        ctx.reset();
+        return res;
+    }
+
+private:
+    using node_kind = image_format::node_kind;
+    using value_kind = image_format::value_kind;
+    using kind_type = typename scalar_type::kind_type;
+    using id_type = typename lexem_type::id_type;
+    using runtime_type = rule_runtime<CharT, LessT>;
+
+    template <typename T>
+    static const T* view(const char* data, std::size_t size,
+                     const image_format::section& where)
+    {
+        if (where.offset % 8 != 0 || where.offset > size
+            || where.count > (size - where.offset) / sizeof(T)) {
+            throw std::runtime_error("rule_image: section out of bounds");
+        }
+        return reinterpret_cast<const T*>(data + where.offset);
+    }
+
+    void open(const char* data, std::size_t size)
+    {
+        if (!data || reinterpret_cast<std::uintptr_t>(data) % 8 != 0) {
+            throw std::runtime_error("rule_image: data is not aligned");
+        } else if (size < sizeof(image_format::header)) {
+            throw std::runtime_error("rule_image: too small");
+        }
+        head_ = reinterpret_cast<const image_format::header*>(data);
+        if (std::memcmp(head_->magic, image_format::magic,
+                        sizeof(head_->magic)) != 0) {
+            throw std::runtime_error("rule_image: not a rule image");
+        } else if (head_->version != image_format::version) {
+            throw std::runtime_error("rule_image: unknown version");
+        } else if (head_->byte_order != image_format::byte_order
+                   || head_->char_size != sizeof(CharT)) {
+            throw std::runtime_error("rule_image: other platform");
+        }
+        symbols_ = view<image_format::symbol>(data, size, head_->symbols);
+        nodes_ = view<image_format::node>(data, size, head_->nodes);
+        constants_
+            = view<image_format::constant>(data, size, head_->constants);
+        rules_ = view<image_format::rule>(data, size, head_->rules);
+        conjuncts_ = view<std::uint32_t>(data, size, head_->conjuncts);
+        unindexed_ = view<std::uint32_t>(data, size, head_->unindexed);
+        slots_ = view<image_format::index>(data, size, head_->slots);
+        entries_ = view<image_format::entry>(data, size, head_->entries);
+        strings_ = view<CharT>(data, size, head_->strings);
+        check();
+    }
+
+    /// every index points inside its section and operands come before
+    /// their nodes, so evaluation always ends
+    void check() const
+    {
+        auto fail = [](const char* what) {
+            throw std::runtime_error(std::string("rule_image: bad ") + what);
+        };
+        auto text = [this](std::uint64_t offset, std::uint64_t length) {
+            auto count = head_->strings.count;
+            return offset <= count && length <= count - offset;
+        };
+        auto value = [&text](value_kind kind, std::uint64_t bits,
+                             std::uint32_t length) {
+            return kind <= value_kind::STRING
+                && (kind != value_kind::STRING || text(bits, length));
+        };
+        for (std::size_t i = 0; i < head_->symbols.count; ++i) {
+            if (!text(symbols_[i].offset, symbols_[i].length)) {
+                fail("symbol");
+            }
+        }
+        for (std::size_t i = 0; i < head_->constants.count; ++i) {
+            auto& c = constants_[i];
+            if (!value(c.kind, c.bits, c.length)) {
+                fail("constant");
+            }
+        }
+        for (std::size_t i = 0; i < head_->nodes.count; ++i) {
+            auto& n = nodes_[i];
+            bool ok = false;
+            switch (n.kind) {
+            case node_kind::IDENT:
+                ok = n.first < head_->symbols.count;
+                break;
+            case node_kind::VALUE:
+                ok = n.first < head_->constants.count;
+                break;
+            case node_kind::PREFIX:
+                ok = n.first < i;
+                break;
+            case node_kind::BINARY:
+                ok = n.first < i && n.second < i;
+                break;
+            }
+            if (!ok) {
+                fail("node");
+            }
+        }
+        for (std::size_t i = 0; i < head_->rules.count; ++i) {
+            auto& r = rules_[i];
+            if (r.root >= head_->nodes.count
+                || std::uint64_t(r.first) + r.count > head_->conjuncts.count) {
+                fail("rule");
+            }
+        }
+        for (std::size_t i = 0; i < head_->conjuncts.count; ++i) {
+            if (conjuncts_[i] >= head_->nodes.count) {
+                fail("conjunct");
+            }
+        }
+        for (std::size_t i = 0; i < head_->unindexed.count; ++i) {
+            if (unindexed_[i] >= head_->rules.count) {
+                fail("rule list");
+            }
+        }
+        for (std::size_t i = 0; i < head_->slots.count; ++i) {
+            auto& s = slots_[i];
+            if (std::uint64_t(s.first) + s.count > head_->entries.count) {
+                fail("slot");
+            }
+        }
+        for (std::size_t i = 0; i < head_->entries.count; ++i) {
+            auto& e = entries_[i];
+            if (e.rule >= head_->rules.count
+                || !value(e.kind, e.bits, e.length)) {
+                fail("entry");
+            }
+        }
+    }
+
+    template <typename CallT>
+    void collect(const image_format::index& index, const scalar_type& value,
+                 CallT& call) const
+    {
+        switch (value.kind) {
+        case kind_type::INTEGER:
+            find(index, value_kind::INTEGER, value, call);
+            find(index, value_kind::FLOATING,
+                 scalar_type::make_floating(static_cast<double>(value.integer)),
+                 call);
+            break;
+        case kind_type::FLOATING:
+            find(index, value_kind::FLOATING, value, call);
+            if (value.floating >= -9.2e18 && value.floating <= 9.2e18
+                && std::trunc(value.floating) == value.floating) {
+                find(index, value_kind::INTEGER,
+                     scalar_type::make_integer(
+                         static_cast<std::int64_t>(value.floating)),
+                     call);
+            }
+            break;
+        case kind_type::STRING:
+            find(index, value_kind::STRING, value, call);
+            break;
+        case kind_type::BOOLEAN:
+            find(index, value_kind::BOOLEAN, value, call);
+            break;
+        default:
+            break;
+        }
+    }
+
+    /// entries of a slot are sorted by kind, then value
+    template <typename CallT>
+    void find(const image_format::index& index, value_kind kind,
+              const scalar_type& value, CallT& call) const
+    {
+        auto first = entries_ + index.first;
+        auto last = first + index.count;
+        auto before = [this, kind, &value](const image_format::entry& e) {
+            return e.kind < kind
+                || (e.kind == kind && image_format::less(decode(e), value));
+        };
+        auto it = std::partition_point(first, last, before);
+        for (; it != last && it->kind == kind
+             && !image_format::less(value, decode(*it));
+             ++it) {
+            call(it->rule);
+        }
+    }
+
+    scalar_type decode(const image_format::entry& e) const
+    {
+        return image_format::decode(e.kind, e.bits, e.length, strings_);
+    }
+
+    scalar_type constant(std::uint32_t id) const
+    {
+        auto& c = constants_[id];
+        return image_format::decode(c.kind, c.bits, c.length, strings_);
+    }
+
+    bool residual(std::uint32_t id, context_type& ctx) const
+    {
+        auto& r = rules_[id];
+        auto res = true;
+        for (std::uint32_t i = 0; res && i < r.count; ++i) {
+            res = predicate(conjuncts_[r.first + i], ctx);
+        }
+        ctx.reset();
+        return res;
+    }
+
+    static bool is_logical(id_type token)
+    {
+        switch (token) {
+        case constants::token_type::AND:
+        case constants::token_type::OR:
+        case constants::token_type::IN:
+        case constants::token_type::EQ:
+        case constants::token_type::NOTEQ:
+        case constants::token_type::LT:
+        case constants::token_type::GT:
+        case constants::token_type::LEQ:
+        case constants::token_type::GEQ:
+        case constants::token_type::STARTSWITH:
+            return true;
+        default:
+            break;
+        }
+        return false;
+    }
+
+    static id_type token_of(const image_format::node& n)
+    {
+        return static_cast<id_type>(n.token);
+    }
+
+    static bool is_range(const image_format::node& n)
+    {
+        return n.kind == node_kind::BINARY
+            && (token_of(n) == constants::token_type::DOTDOT
+                || token_of(n) == constants::token_type::DOTDOTDOT);
+    }
+
+    bool is_literal(std::uint32_t id) const
+    {
+        return nodes_[id].kind == node_kind::VALUE;
+    }
+
+    bool predicate(std::uint32_t id, context_type& ctx) const
+    {
+        auto& n = nodes_[id];
+        if (n.kind == node_kind::PREFIX
+            && token_of(n) == constants::token_type::NOT) {
+            return !predicate(n.first, ctx);
+        } else if (n.kind == node_kind::BINARY) {
+            switch (token_of(n)) {
+            case constants::token_type::AND:
+                return predicate(n.first, ctx) && predicate(n.second, ctx);
+            case constants::token_type::OR:
+                return predicate(n.first, ctx) || predicate(n.second, ctx);
+            case constants::token_type::IN:
+                return contains(n, ctx);
+            case constants::token_type::EQ:
+            case constants::token_type::NOTEQ:
+            case constants::token_type::LT:
+            case constants::token_type::GT:
+            case constants::token_type::LEQ:
+            case constants::token_type::GEQ:
+                return compare(n, ctx);
+            case constants::token_type::STARTSWITH:
+                return starts_with(n, ctx);
+            default:
+                break;
+            }
+        }
+        return compiler_type::to_bool(value(id, ctx));
+    }
+
+    scalar_type value(std::uint32_t id, context_type& ctx) const
+    {
+        auto& n = nodes_[id];
+        switch (n.kind) {
+        case node_kind::IDENT:
+            return ctx.read(n.first);
+        case node_kind::VALUE:
+            return constant(n.first);
+        case node_kind::PREFIX:
+            if (token_of(n) == constants::token_type::NOT) {
+                return scalar_type::make_boolean(predicate(id, ctx));
+            }
+            return unary(token_of(n), value(n.first, ctx), ctx);
+        default:
+            break;
+        }
+        if (is_logical(token_of(n))) {
+            return scalar_type::make_boolean(predicate(id, ctx));
+        }
+        auto left = value(n.first, ctx);
+        auto right = value(n.second, ctx);
+        return compiler_type::call_binary(binary_, token_of(n), left, right,
+                                          ctx);
+    }
+
+    scalar_type unary(id_type op, const scalar_type& val,
+                      context_type& ctx) const
+    {
+        using scalar_operations_type =
+            typename compiler_type::scalar_operations_type;
+        scalar_type res;
+        if (val.empty() || scalar_operations_type::unary(op, val, res)) {
+            return res;
+        }
+        arena::scope scope(ctx.storage());
+        objects::base::uptr holder;
+        return scalar_type::from_object(
+            ctx.keep(unary_.call(op, compiler_type::box(val, holder))));
+    }
+
+    /// with a literal on either side the kinds are compared as the
+    /// compiled rules compare them
+    bool compare(const image_format::node& n, context_type& ctx) const
+    {
+        id_type op = token_of(n);
+        auto other = n.first;
+        auto literal = n.second;
+        if (!is_literal(literal) && is_literal(other)) {
+            std::swap(other, literal);
+            op = flip(op);
+        }
+        if (!is_literal(literal)) {
+            auto left = value(n.first, ctx);
+            auto right = value(n.second, ctx);
+            return compiler_type::to_bool(
+                compiler_type::call_binary(binary_, op, left, right, ctx));
+        }
+        auto val = value(other, ctx);
+        auto lit = constant(nodes_[literal].first);
+        switch (op) {
+        case constants::token_type::EQ:
+            return typed<std::equal_to<>>(val, lit);
+        case constants::token_type::NOTEQ:
+            return typed<std::not_equal_to<>>(val, lit);
+        case constants::token_type::LT:
+            return typed<std::less<>>(val, lit);
+        case constants::token_type::GT:
+            return typed<std::greater<>>(val, lit);
+        case constants::token_type::LEQ:
+            return typed<std::less_equal<>>(val, lit);
+        default:
+            break;
+        }
+        return typed<std::greater_equal<>>(val, lit);
+    }
+
+    template <typename CmpT>
+    static bool typed(const scalar_type& val, const scalar_type& lit)
+    {
+        return runtime_type::template compare<CmpT>(val, lit);
+    }
+
+    static id_type flip(id_type op)
+    {
+        switch (op) {
+        case constants::token_type::LT:
+            return constants::token_type::GT;
+        case constants::token_type::GT:
+            return constants::token_type::LT;
+        case constants::token_type::LEQ:
+            return constants::token_type::GEQ;
+        case constants::token_type::GEQ:
+            return constants::token_type::LEQ;
+        default:
+            break;
+        }
+        return op;
+    }
+
+    bool starts_with(const image_format::node& n, context_type& ctx) const
+    {
+        auto val = value(n.first, ctx);
+        if (is_literal(n.second)) {
+            auto prefix = constant(nodes_[n.second].first);
+            if (prefix.kind == kind_type::STRING) {
+                return runtime_type::starts_with(val, prefix.string);
+            }
+        }
+        auto prefix = value(n.second, ctx);
+        return compiler_type::to_bool(compiler_type::call_binary(
+            binary_, token_of(n), val, prefix, ctx));
+    }
+
+    /// 'value in a..b' and 'value in (x, y, ...)'
+    bool contains(const image_format::node& n, context_type& ctx) const
+    {
+        auto& container = nodes_[n.second];
+        auto val = value(n.first, ctx);
+        if (is_range(container)) {
+            if (literal_range(container)) {
+                return in_literal_range(val, container);
+            }
+            auto low = value(container.first, ctx);
+            auto high = value(container.second, ctx);
+            auto exclusive = token_of(container)
+                == constants::token_type::DOTDOTDOT;
+            auto high_op = exclusive ? constants::token_type::LT
+                                     : constants::token_type::LEQ;
+            return compiler_type::to_bool(compiler_type::call_binary(
+                       binary_, constants::token_type::GEQ, val, low, ctx))
+                && compiler_type::to_bool(compiler_type::call_binary(
+                    binary_, high_op, val, high, ctx));
+        }
+        return !val.empty() && in_list(n.second, val, ctx);
+    }
+
+    bool in_list(std::uint32_t id, const scalar_type& val,
+                 context_type& ctx) const
+    {
+        auto& n = nodes_[id];
+        if (n.kind == node_kind::BINARY
+            && token_of(n) == constants::token_type::COMMA) {
+            return in_list(n.first, val, ctx) || in_list(n.second, val, ctx);
+        } else if (literal_range(n)) {
+            return in_literal_range(val, n);
+        } else if (is_literal(id)) {
+            return typed<std::equal_to<>>(val, constant(n.first));
+        }
+        auto element = value(id, ctx);
+        if (compiler_type::is_array(element)) {
+            return compiler_type::array_contains(binary_, val, element.object,
+                                                 ctx);
+        } else if (compiler_type::is_interval(element)) {
+            return compiler_type::interval_contains(val, element.object);
+        }
+        return compiler_type::to_bool(compiler_type::call_binary(
+            binary_, constants::token_type::EQ, val, element, ctx));
+    }
+
+    /// a range with numeric literals at both ends
+    bool literal_range(const image_format::node& n) const
+    {
+        return is_range(n) && is_numeric(n.first) && is_numeric(n.second);
+    }
+
+    bool is_numeric(std::uint32_t id) const
+    {
+        if (!is_literal(id)) {
+            return false;
+        }
+        auto kind = constants_[nodes_[id].first].kind;
+        return kind == value_kind::INTEGER || kind == value_kind::FLOATING;
+    }
+
+    bool in_literal_range(const scalar_type& val,
+                          const image_format::node& range) const
+    {
+        auto low = constant(nodes_[range.first].first);
+        auto high = constant(nodes_[range.second].first);
+        auto exclusive = token_of(range) == constants::token_type::DOTDOTDOT;
+        if (low.kind == kind_type::INTEGER && high.kind == kind_type::INTEGER) {
+            numeric_interval<std::int64_t> bounds { low.integer, high.integer,
+                                                    exclusive };
+            return runtime_type::inside(bounds, val);
+        }
+        numeric_interval<double> bounds { to_double(low), to_double(high),
+                                          exclusive };
+        return runtime_type::inside(bounds, val);
+    }
+
+    static double to_double(const scalar_type& value)
+    {
+        return value.kind == kind_type::INTEGER
+            ? static_cast<double>(value.integer)
+            : value.floating;
+    }
+
+    typename compiler_type::binary_type binary_;
+    typename compiler_type::unary_type unary_;
+    const image_format::header* head_ = nullptr;
+    const image_format::symbol* symbols_ = nullptr;
+    const image_format::node* nodes_ = nullptr;
+    const image_format::constant* constants_ = nullptr;
+    const image_format::rule* rules_ = nullptr;
+    const std::uint32_t* conjuncts_ = nullptr;
+    const std::uint32_t* unindexed_ = nullptr;
+    const image_format::index* slots_ = nullptr;
+    const image_format::entry* entries_ = nullptr;
+    const CharT* strings_ = nullptr;
+};
+
+}
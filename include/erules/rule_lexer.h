@@ -1,5 +1,7 @@
 #pragma once
 #include <numeric>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 #include "constants.h"
@@ -112,6 +114,9 @@ namespace erules { namespace filters {
                                create_token_ident(constants::token_type::OR));
             lexer_.add_factory(make_name("in"),
                                create_token_ident(constants::token_type::IN));
+            lexer_.add_factory(
+                make_name("startswith"),
+                create_token_ident(constants::token_type::STARTSWITH));
             lexer_.add_factory(make_name("="),
                                create_token(constants::token_type::EQ));
             lexer_.add_factory(make_name("!="),
@@ -146,6 +151,8 @@ namespace erules { namespace filters {
 
             lexer_.add_factory(make_name(","),
                                create_token(constants::token_type::COMMA));
+            lexer_.add_factory(make_name(";"),
+                               create_token(constants::token_type::SEMICOLON));
             lexer_.add_factory(make_name("."),
                                create_token(constants::token_type::DOT));
             lexer_.add_factory(make_name(".."),
@@ -276,6 +283,11 @@ namespace erules { namespace filters {
                     } else if (helpers::reader::is_ident(*current_)) {
                         return read_ident(std::move(state));
                     }
+                    auto pos = get_position(current_);
+                    throw std::runtime_error(
+                        "lexer: unexpected character at line "
+                        + std::to_string(pos.first) + ", column "
+                        + std::to_string(pos.second));
                 }
                 return state;
             };
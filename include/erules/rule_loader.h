@@ -0,0 +1,285 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "erules/executor.h"
+#include "erules/mapped_file.h"
+#include "erules/rule_lexer.h"
+#include "erules/rule_parser.h"
+#include "erules/rule_set.h"
+
+namespace erules {
+
+/// Many rules in one text, separated by ';', into one rule set.
+/// The text is cut at the semicolons outside of quotes and brackets;
+/// the pieces are lexed and parsed on the threads of an executor, a
+/// batch at a time, and added to the set in the order of the text.
+/// A rule that does not lex, parse or compile is reported with its
+/// position and left out, the others are loaded all the same.
+template <typename LexemT>
+class rule_loader {
+public:
+    using lexem_type = LexemT;
+    using rule_set_type = rule_set<lexem_type>;
+    using char_type = typename rule_set_type::char_type;
+    using string_type = typename rule_set_type::string_type;
+    using string_view_type = std::basic_string_view<char_type>;
+    using node_type = typename rule_set_type::node_type;
+    using node_uptr = typename node_type::uptr;
+    using lexer_type
+        = filters::lexer<char_type, typename lexem_type::less_type>;
+    using parser_type = rule_parser<lexem_type>;
+
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    /// one rule of the text: offsets of its first and past its last
+    /// character, the position of the first one, 1 based
+    struct chunk {
+        std::size_t begin = 0;
+        std::size_t end = 0;
+        std::size_t line = 1;
+        std::size_t column = 1;
+        bool balanced = true;
+    };
+
+    struct error {
+        std::size_t rule = 0;
+        std::size_t line = 0;
+        std::size_t column = 0;
+        std::string message;
+    };
+
+    struct report {
+        /// id in the set by rule of the text, npos for the failed ones
+        std::vector<std::size_t> ids;
+        std::vector<error> errors;
+
+        std::size_t loaded() const
+        {
+            return ids.size() - errors.size();
+        }
+    };
+
+    /// rules parsed before the batch is added to the set
+    explicit rule_loader(std::size_t batch = 4096)
+        : batch_(std::max<std::size_t>(batch, 1))
+    {
+    }
+
+    /// the rules of text; empty ones, like the one after a last ';', are
+    /// skipped. a ';' can not be part of a rule, so parentheses do not
+    /// change where a rule ends; unbalanced ones only mark the rule
+    static std::vector<chunk> split(string_view_type text)
+    {
+        std::vector<chunk> res;
+        chunk current;
+        std::size_t line = 1;
+        std::size_t column = 1;
+        std::size_t last = 0;
+        std::ptrdiff_t depth = 0;
+        char_type close = 0;
+        bool empty = true;
+        bool balanced = true;
+        auto finish = [&]() {
+            if (!empty) {
+                current.end = last;
+                current.balanced = balanced && depth == 0 && close == 0;
+                res.emplace_back(current);
+            }
+            empty = true;
+            balanced = true;
+            depth = 0;
+            close = 0;
+        };
+        for (std::size_t i = 0; i < text.size(); ++i, ++column) {
+            auto c = text[i];
+            if (c == static_cast<char_type>('\n')) {
+                ++line;
+                column = 0;
+            }
+            if (close) {
+                if (c == static_cast<char_type>('\\') && i + 1 < text.size()) {
+                    ++i;
+                    ++column;
+                } else if (c == close) {
+                    close = 0;
+                }
+                last = i + 1;
+                continue;
+            } else if (c == static_cast<char_type>(';')) {
+                finish();
+                continue;
+            } else if (is_space(c)) {
+                continue;
+            }
+            if (empty) {
+                empty = false;
+                current.begin = i;
+                current.line = line;
+                current.column = column;
+            }
+            last = i + 1;
+            if (c == static_cast<char_type>('"')
+                || c == static_cast<char_type>('\'')) {
+                close = c;
+            } else if (c == static_cast<char_type>('[')) {
+                close = static_cast<char_type>(']');
+            } else if (c == static_cast<char_type>('(')) {
+                ++depth;
+            } else if (c == static_cast<char_type>(')') && --depth < 0) {
+                balanced = false;
+            }
+        }
+        finish();
+        return res;
+    }
+
+    /// rules of text into rules, which is built afterwards
+    report load(string_view_type text, rule_set_type& rules,
+                executor& pool) const
+    {
+        return load(text, rules, &pool);
+    }
+
+    /// as above, on the calling thread
+    report load(string_view_type text, rule_set_type& rules) const
+    {
+        return load(text, rules, nullptr);
+    }
+
+    /// the file is mapped, not read
+    report load_file(const std::string& path, rule_set_type& rules,
+                     executor& pool) const
+    {
+        static_assert(std::is_same<char_type, char>::value,
+                      "rule_loader: files are read as char");
+        mapped_file file(path);
+        return load(string_view_type(static_cast<const char*>(file.data()),
+                                     file.size()),
+                    rules, &pool);
+    }
+
+private:
+    /// what one thread parses with
+    struct worker {
+        lexer_type lex;
+        parser_type pars { std::vector<lexem_type>() };
+    };
+
+    struct parsed {
+        node_uptr tree;
+        std::string message;
+    };
+
+    report load(string_view_type text, rule_set_type& rules,
+                executor* pool) const
+    {
+        auto chunks = split(text);
+        report res;
+        res.ids.assign(chunks.size(), npos);
+        std::vector<std::unique_ptr<worker>> workers;
+        for (std::size_t i = 0; i < (pool ? pool->size() : 1); ++i) {
+            workers.emplace_back(std::make_unique<worker>());
+        }
+        std::vector<parsed> batch;
+        for (std::size_t first = 0; first < chunks.size(); first += batch_) {
+            auto count = std::min(batch_, chunks.size() - first);
+            batch.clear();
+            batch.resize(count);
+            auto job = [&](std::size_t i, std::size_t id) {
+                batch[i] = parse(*workers[id], text, chunks[first + i]);
+            };
+            if (pool) {
+                pool->parallel_for(count, job);
+            } else {
+                for (std::size_t i = 0; i < count; ++i) {
+                    job(i, 0);
+                }
+            }
+            for (std::size_t i = 0; i < count; ++i) {
+                auto rule = first + i;
+                if (batch[i].message.empty()) {
+                    try {
+                        res.ids[rule] = rules.add(batch[i].tree);
+                    } catch (const std::exception& ex) {
+                        batch[i].message = ex.what();
+                    }
+                }
+                if (!batch[i].message.empty()) {
+                    res.errors.push_back({ rule, chunks[rule].line,
+                                           chunks[rule].column,
+                                           std::move(batch[i].message) });
+                }
+            }
+        }
+        rules.build();
+        return res;
+    }
+
+    /// never throws, a failure is the message
+    static parsed parse(worker& state, string_view_type text,
+                        const chunk& where)
+    {
+        parsed res;
+        if (!where.balanced) {
+            res.message = "rule_loader: unbalanced quotes or parentheses";
+            return res;
+        }
+        try {
+            state.pars.reset(state.lex.read_all(string_type(
+                text.substr(where.begin, where.end - where.begin))));
+            res.tree = state.pars.parse();
+            if (!state.pars.complete()) {
+                res.message = "rule_loader: unexpected lexem after the rule";
+            } else if (!well_formed(res.tree.get())) {
+                res.message = "rule_loader: incomplete rule";
+            }
+        } catch (const std::exception& ex) {
+            res.message = ex.what();
+        }
+        if (!res.message.empty()) {
+            res.tree.reset();
+        }
+        return res;
+    }
+
+    /// every operation has its operands
+    static bool well_formed(const node_type* node)
+    {
+        using namespace objects;
+        if (!node) {
+            return false;
+        } else if (base::is<ast::prefix_operation<lexem_type>>(node)) {
+            return well_formed(
+                base::cast<ast::prefix_operation<lexem_type>>(node)
+                    ->value()
+                    .get());
+        } else if (base::is<ast::binary_operation<lexem_type>>(node)) {
+            auto bin = base::cast<ast::binary_operation<lexem_type>>(node);
+            return well_formed(bin->left().get())
+                && well_formed(bin->right().get());
+        }
+        return base::is<ast::ident<lexem_type>>(node)
+            || base::is<ast::value<lexem_type>>(node);
+    }
+
+    static bool is_space(char_type c)
+    {
+        return c == static_cast<char_type>(' ')
+            || c == static_cast<char_type>('\t')
+            || c == static_cast<char_type>('\n')
+            || c == static_cast<char_type>('\r');
+    }
+
+    std::size_t batch_;
+};
+
+}
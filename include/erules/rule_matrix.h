@@ -0,0 +1,307 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "erules/bitset.h"
+#include "erules/columnar.h"
+#include "erules/executor.h"
+
+namespace erules {
+
+/// Which rules matched which records: one row of bits per record,
+/// padded to whole 64 bit words
+class match_matrix {
+public:
+    using word_type = rule_bitset::word_type;
+    static constexpr std::size_t word_bits = rule_bitset::word_bits;
+
+    match_matrix() = default;
+
+    match_matrix(std::size_t records, std::size_t rules)
+    {
+        reset(records, rules);
+    }
+
+    /// resizes and clears every bit
+    void reset(std::size_t records, std::size_t rules)
+    {
+        records_ = records;
+        rules_ = rules;
+        stride_ = (rules + word_bits - 1) / word_bits;
+        words_.assign(records_ * stride_, 0);
+    }
+
+    std::size_t records() const
+    {
+        return records_;
+    }
+
+    std::size_t rules() const
+    {
+        return rules_;
+    }
+
+    /// ors bits into the word'th word of the row of record
+    void merge(std::size_t record, std::size_t word, word_type bits)
+    {
+        words_[record * stride_ + word] |= bits;
+    }
+
+    void set(std::size_t record, std::size_t rule)
+    {
+        words_[record * stride_ + rule / word_bits] |= word_type(1)
+            << (rule % word_bits);
+    }
+
+    bool test(std::size_t record, std::size_t rule) const
+    {
+        return (words_[record * stride_ + rule / word_bits]
+                >> (rule % word_bits))
+            & 1;
+    }
+
+    /// the rules matched by one record
+    rule_bitset row(std::size_t record) const
+    {
+        rule_bitset res(rules_);
+        auto data = words_.data() + record * stride_;
+        for (std::size_t i = 0; i < rules_; ++i) {
+            if ((data[i / word_bits] >> (i % word_bits)) & 1) {
+                res.set(i);
+            }
+        }
+        return res;
+    }
+
+    std::size_t count() const
+    {
+        std::size_t res = 0;
+        for (auto w : words_) {
+            for (; w != 0; w &= w - 1) {
+                ++res;
+            }
+        }
+        return res;
+    }
+
+    friend bool operator==(const match_matrix& l, const match_matrix& r)
+    {
+        return l.records_ == r.records_ && l.rules_ == r.rules_
+            && l.words_ == r.words_;
+    }
+
+    friend bool operator!=(const match_matrix& l, const match_matrix& r)
+    {
+        return !(l == r);
+    }
+
+private:
+    std::size_t records_ = 0;
+    std::size_t rules_ = 0;
+    std::size_t stride_ = 0;
+    std::vector<word_type> words_;
+};
+
+/// N rules against the M records of a column batch.
+/// The work is cut into tiles of records and rules: a block of records
+/// is small enough for its columns, the row bits of its rules and its
+/// rows of the matrix to stay in the L2 cache while every rule of a
+/// block of rules runs over it. Tiles that cover whole words of rules
+/// turn the row bits of 64 rules into matrix words at once; others set
+/// one bit per match. One record per tile is the record-major loop,
+/// every record per tile the rule-major one.
+/// With an executor the tiles are spread over its threads.
+template <typename LexemT>
+class rule_matrix {
+public:
+    using lexem_type = LexemT;
+    using compiler_type = batch_compiler<lexem_type>;
+    using node_type = typename compiler_type::node_type;
+    using batch_type = typename compiler_type::batch_type;
+    using rule_type = typename compiler_type::rule_type;
+    using symbol_table_type = typename compiler_type::symbol_table_type;
+
+    /// records 0 sizes the record blocks from l2_bytes and the row width
+    struct tile {
+        std::size_t records = 0;
+        std::size_t rules = 64;
+    };
+
+    static constexpr std::size_t l2_bytes = 256 * 1024;
+
+    rule_matrix()
+        : rule_matrix(std::make_shared<symbol_table_type>())
+    {
+    }
+
+    rule_matrix(std::shared_ptr<symbol_table_type> symbols)
+        : compiler_(std::move(symbols))
+    {
+    }
+
+    compiler_type& rule_compiler()
+    {
+        return compiler_;
+    }
+
+    const std::shared_ptr<symbol_table_type>& symbols() const
+    {
+        return compiler_.symbols();
+    }
+
+    /// ids are dense, in the order the rules are added
+    std::size_t add(const node_type* root)
+    {
+        rules_.emplace_back(compiler_.compile(root));
+        return rules_.size() - 1;
+    }
+
+    std::size_t add(const typename node_type::uptr& root)
+    {
+        return add(root.get());
+    }
+
+    std::size_t size() const
+    {
+        return rules_.size();
+    }
+
+    void set_tile(const tile& value)
+    {
+        tile_ = value;
+    }
+
+    const tile& get_tile() const
+    {
+        return tile_;
+    }
+
+    /// records per block for a batch: what fits in l2_bytes, in whole
+    /// words of the row bitsets. a record takes its columns, one bit
+    /// per rule of a word of rules and its word of the matrix
+    static std::size_t block_records(const batch_type& batch)
+    {
+        auto width = batch.row_bytes() + 2 * sizeof(word_type);
+        auto res = l2_bytes / width;
+        res -= res % rule_bitset::word_bits;
+        return std::max<std::size_t>(res, rule_bitset::word_bits);
+    }
+
+    void match(const batch_type& batch, match_matrix& out) const
+    {
+        match(batch, out, tile_);
+    }
+
+    void match(const batch_type& batch, match_matrix& out,
+               const tile& shape) const
+    {
+        auto records = shape.records ? shape.records : block_records(batch);
+        auto rules = std::max<std::size_t>(shape.rules, 1);
+        out.reset(batch.rows(), rules_.size());
+        std::vector<rule_bitset> bits;
+        for (std::size_t first = 0; first < rules_.size(); first += rules) {
+            for (std::size_t begin = 0; begin < batch.rows();
+                 begin += records) {
+                run_tile(batch, out, bits, first, rules, begin, records);
+            }
+        }
+    }
+
+    /// the tiles run on the threads of pool. rule blocks are rounded up
+    /// to whole words of the matrix, so no two tiles write the same word
+    void match(const batch_type& batch, match_matrix& out,
+               executor& pool) const
+    {
+        auto records = tile_.records ? tile_.records : block_records(batch);
+        auto rules = std::max<std::size_t>(tile_.rules, 1);
+        rules += (match_matrix::word_bits - rules % match_matrix::word_bits)
+            % match_matrix::word_bits;
+        out.reset(batch.rows(), rules_.size());
+        auto record_blocks = (batch.rows() + records - 1) / records;
+        auto rule_blocks = (rules_.size() + rules - 1) / rules;
+        std::vector<std::vector<rule_bitset>> bits(pool.size());
+        pool.parallel_for(
+            record_blocks * rule_blocks,
+            [&](std::size_t task, std::size_t worker) {
+                run_tile(batch, out, bits[worker],
+                         task / record_blocks * rules, rules,
+                         task % record_blocks * records, records);
+            });
+    }
+
+    match_matrix match(const batch_type& batch) const
+    {
+        match_matrix out;
+        match(batch, out);
+        return out;
+    }
+
+private:
+    using word_type = match_matrix::word_type;
+    static constexpr std::size_t word_bits = match_matrix::word_bits;
+
+    void run_tile(const batch_type& batch, match_matrix& out,
+                  std::vector<rule_bitset>& bits, std::size_t first,
+                  std::size_t rules, std::size_t begin,
+                  std::size_t records) const
+    {
+        auto last = std::min(first + rules, rules_.size());
+        auto count = std::min(records, batch.rows() - begin);
+        auto block = batch.slice(begin, count);
+        bits.resize(word_bits);
+        if (first % word_bits != 0
+            || (last % word_bits != 0 && last != rules_.size())) {
+            auto& found = bits.front();
+            for (auto id = first; id < last; ++id) {
+                rules_[id].select(block, found);
+                found.for_each([&out, begin, id](std::size_t row) {
+                    out.set(begin + row, id);
+                });
+            }
+            return;
+        }
+        word_type square[word_bits];
+        for (auto group = first; group < last; group += word_bits) {
+            auto width = std::min(word_bits, last - group);
+            for (std::size_t i = 0; i < width; ++i) {
+                rules_[group + i].select(block, bits[i]);
+            }
+            for (std::size_t row = 0; row < count; row += word_bits) {
+                auto word = row / word_bits;
+                for (std::size_t i = 0; i < word_bits; ++i) {
+                    square[i] = i < width ? bits[i].words()[word] : 0;
+                }
+                transpose(square);
+                auto height = std::min(word_bits, count - row);
+                for (std::size_t i = 0; i < height; ++i) {
+                    if (square[i]) {
+                        out.merge(begin + row + i, group / word_bits,
+                                  square[i]);
+                    }
+                }
+            }
+        }
+    }
+
+    /// bit j of word i goes to bit i of word j
+    static void transpose(word_type (&square)[word_bits])
+    {
+        word_type mask = 0x00000000FFFFFFFFull;
+        for (std::size_t j = word_bits / 2; j != 0;
+             j >>= 1, mask ^= mask << j) {
+            for (std::size_t k = 0; k < word_bits; k = ((k | j) + 1) & ~j) {
+                auto t = ((square[k] >> j) ^ square[k | j]) & mask;
+                square[k] ^= t << j;
+                square[k | j] ^= t;
+            }
+        }
+    }
+
+    compiler_type compiler_;
+    std::vector<rule_type> rules_;
+    tile tile_;
+};
+
+}
@@ -2,6 +2,7 @@
 #include <sstream>
 
 #include "ast.h"
+#include "ast_factory.h"
 #include "parser.h"
 #include "rule_lexem.h"
 
@@ -48,6 +49,9 @@ public:
         parser_.set_precedense(
             constants::token_type::GEQ,
             static_cast<int>(constants::precedence_type::CMP));
+        parser_.set_precedense(
+            constants::token_type::STARTSWITH,
+            static_cast<int>(constants::precedence_type::CMP));
 
         parser_.set_precedense(
             constants::token_type::PLUS,
@@ -100,6 +104,19 @@ public:
             static_cast<int>(constants::precedence_type::LOWEST));
     }
 
+    /// false when the last parse() stopped before the last lexem
+    bool complete() const
+    {
+        return parser_.next_eof();
+    }
+
+    /// the rule interned by factory, sharing the subtrees it already has
+    typename ast_factory<lexem_type>::handle
+    parse(ast_factory<lexem_type>& factory)
+    {
+        return factory.intern(parse());
+    }
+
 private:
     void fill_parsers()
     {
@@ -160,12 +177,16 @@ private:
         parser_.set_led(constants::token_type::AND, binary_operation);
         parser_.set_led(constants::token_type::GEQ, binary_operation);
         parser_.set_led(constants::token_type::LEQ, binary_operation);
+        parser_.set_led(constants::token_type::STARTSWITH, binary_operation);
 
         parser_.set_nud(constants::token_type::LPAREN, [this](auto parser_ptr) {
             parser_.advance();
             auto expr = parser_ptr->parse_expression(
                 static_cast<int>(constants::precedence_type::LOWEST));
-            parser_ptr->expect(constants::token_type::RPAREN);
+            /// an unclosed paren leaves the rule incomplete
+            if (!parser_ptr->expect(constants::token_type::RPAREN)) {
+                expr.reset();
+            }
             return expr;
         });
     }
@@ -0,0 +1,155 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "erules/bitset.h"
+#include "erules/compiler.h"
+#include "erules/environment.h"
+#include "erules/interval.h"
+
+namespace erules {
+
+/// What evaluated rules need besides their fields: the operation
+/// registries and the storage for temporaries. Generated rules call it
+/// for everything they can not do inline; the static helpers are the
+/// typed comparisons of compiled rules with a literal.
+/// One runtime per thread; reset() after each record.
+template <typename CharT, typename LessT = std::less<CharT>>
+class rule_runtime {
+public:
+    using lexem_type = filters::rule_lexem<CharT, LessT>;
+    using compiler_type = compiler<lexem_type>;
+    using context_type = typename compiler_type::context_type;
+    using scalar_type = typename compiler_type::scalar_type;
+    using string_view_type = typename scalar_type::string_view_type;
+    using id_type = typename lexem_type::id_type;
+
+    rule_runtime()
+        : binary_(operations::binary_operations<CharT, LessT>::get())
+        , unary_(operations::unary_operations<CharT, LessT>::get())
+        , none_(std::make_shared<symbol_table_type>())
+        , ctx_(none_)
+    {
+    }
+
+    rule_runtime(const rule_runtime&) = delete;
+    rule_runtime& operator=(const rule_runtime&) = delete;
+
+    /// releases the temporaries of the last record
+    void reset()
+    {
+        ctx_.reset();
+    }
+
+    scalar_type binary(id_type op, const scalar_type& left,
+                       const scalar_type& right)
+    {
+        return compiler_type::call_binary(binary_, op, left, right, ctx_);
+    }
+
+    scalar_type unary(id_type op, const scalar_type& value)
+    {
+        using scalar_operations_type =
+            typename compiler_type::scalar_operations_type;
+        scalar_type res;
+        if (value.empty() || scalar_operations_type::unary(op, value, res)) {
+            return res;
+        }
+        arena::scope scope(ctx_.storage());
+        objects::base::uptr holder;
+        return scalar_type::from_object(
+            ctx_.keep(unary_.call(op, compiler_type::box(value, holder))));
+    }
+
+    /// 'value in low..high' with computed ends
+    bool in_range(const scalar_type& value, const scalar_type& low,
+                  const scalar_type& high, bool exclusive)
+    {
+        auto high_op = exclusive ? constants::token_type::LT
+                                 : constants::token_type::LEQ;
+        return truth(binary(constants::token_type::GEQ, value, low))
+            && truth(binary(high_op, value, high));
+    }
+
+    /// one computed element of 'value in (x, y, ...)'; arrays are
+    /// searched, interval objects contain the value or not
+    bool contains(const scalar_type& value, const scalar_type& element)
+    {
+        if (compiler_type::is_array(element)) {
+            return compiler_type::array_contains(binary_, value,
+                                                 element.object, ctx_);
+        } else if (compiler_type::is_interval(element)) {
+            return compiler_type::interval_contains(value, element.object);
+        }
+        return truth(binary(constants::token_type::EQ, value, element));
+    }
+
+    static bool truth(const scalar_type& value)
+    {
+        return compiler_type::to_bool(value);
+    }
+
+    /// value against a literal: numbers of both kinds compare with each
+    /// other, anything else only with its own kind
+    template <typename CmpT>
+    static bool compare(const scalar_type& value, const scalar_type& literal)
+    {
+        using kind_type = typename scalar_type::kind_type;
+        switch (literal.kind) {
+        case kind_type::INTEGER:
+            if (value.kind == kind_type::INTEGER) {
+                return CmpT {}(value.integer, literal.integer);
+            }
+            return value.kind == kind_type::FLOATING
+                && CmpT {}(value.floating,
+                           static_cast<double>(literal.integer));
+        case kind_type::FLOATING:
+            if (value.kind == kind_type::INTEGER) {
+                return CmpT {}(static_cast<double>(value.integer),
+                               literal.floating);
+            }
+            return value.kind == kind_type::FLOATING
+                && CmpT {}(value.floating, literal.floating);
+        case kind_type::BOOLEAN:
+            return value.kind == kind_type::BOOLEAN
+                && CmpT {}(value.boolean, literal.boolean);
+        default:
+            break;
+        }
+        return value.kind == kind_type::STRING
+            && CmpT {}(value.string, literal.string);
+    }
+
+    template <typename T>
+    static bool inside(const numeric_interval<T>& range,
+                       const scalar_type& value)
+    {
+        using kind_type = typename scalar_type::kind_type;
+        switch (value.kind) {
+        case kind_type::INTEGER:
+            return range.contains(value.integer);
+        case kind_type::FLOATING:
+            return range.contains(value.floating);
+        default:
+            break;
+        }
+        return false;
+    }
+
+    static bool starts_with(const scalar_type& value, string_view_type prefix)
+    {
+        return value.kind == scalar_type::kind_type::STRING
+            && operations::starts_with(value.string, prefix);
+    }
+
+private:
+    using symbol_table_type = typename compiler_type::symbol_table_type;
+
+    typename compiler_type::binary_type binary_;
+    typename compiler_type::unary_type unary_;
+    slot_environment<CharT, LessT> none_;
+    context_type ctx_;
+};
+
+}
@@ -0,0 +1,645 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "erules/bitset.h"
+#include "erules/compiler.h"
+#include "erules/executor.h"
+#include "erules/interval.h"
+#include "erules/trie.h"
+
+namespace erules {
+
+/// Many rules matched against one environment.
+/// Top level 'ident = literal' conjuncts are indexed by slot and value,
+/// numeric ranges and comparisons with a literal go to an interval tree
+/// per slot, 'ident startswith literal' prefixes go to a trie per slot.
+/// Matching reads every indexed slot once and counts the hits per rule;
+/// only rules whose indexed conjuncts all hit run the rest of their
+/// expression. Rules without indexed conjuncts always run. Predicates
+/// that occur in several of these expressions are compiled once and run
+/// at most once per match.
+/// Call build() after adding rules and before matching.
+template <typename LexemT>
+class rule_set {
+public:
+    using lexem_type = LexemT;
+    using compiler_type = compiler<lexem_type>;
+    using char_type = typename compiler_type::char_type;
+    using string_type = typename compiler_type::string_type;
+    using node_type = typename compiler_type::node_type;
+    using rule_type = typename compiler_type::rule_type;
+    using context_type = typename compiler_type::context_type;
+    using environment_type = typename compiler_type::environment_type;
+    using symbol_table_type = typename compiler_type::symbol_table_type;
+    using scalar_type = typename compiler_type::scalar_type;
+    using shared_type = typename compiler_type::shared_type;
+
+    /// scratch of one match() call. reuse it to avoid allocations
+    struct match_state {
+        std::vector<std::uint32_t> counts;
+        std::vector<std::uint32_t> touched;
+        rule_bitset matched;
+    };
+
+    rule_set()
+        : rule_set(std::make_shared<symbol_table_type>())
+    {
+    }
+
+    rule_set(std::shared_ptr<symbol_table_type> symbols)
+        : compiler_(std::move(symbols))
+    {
+    }
+
+    compiler_type& rule_compiler()
+    {
+        return compiler_;
+    }
+
+    const std::shared_ptr<symbol_table_type>& symbols() const
+    {
+        return compiler_.symbols();
+    }
+
+    /// ids are dense, in the order the rules are added
+    std::size_t add(const node_type* root)
+    {
+        if (!root) {
+            throw std::runtime_error("rule_set: empty rule");
+        }
+        auto id = static_cast<std::uint32_t>(rules_.size());
+        auto optimized = compiler_.optimize(root);
+        std::vector<const node_type*> conjuncts;
+        flatten(optimized.get(), conjuncts);
+
+        /// the indexes change only after the residual compiled, so a
+        /// rule that throws leaves no trace of its id
+        std::vector<const node_type*> indexed;
+        std::vector<const node_type*> residual;
+        for (auto conjunct : conjuncts) {
+            if (index_conjunct(conjunct, id, false)) {
+                indexed.emplace_back(conjunct);
+            } else {
+                residual.emplace_back(conjunct);
+            }
+        }
+        entry rule { compiler_.compile_conjunction(residual, shared_),
+                     static_cast<std::uint32_t>(indexed.size()) };
+        for (auto conjunct : indexed) {
+            index_conjunct(conjunct, id, true);
+        }
+        if (indexed.empty()) {
+            unindexed_.emplace_back(id);
+        }
+        rules_.emplace_back(std::move(rule));
+        built_ = false;
+        return id;
+    }
+
+    void build()
+    {
+        for (auto& index : indexes_) {
+            index.ranges.build();
+        }
+        built_ = true;
+    }
+
+    std::size_t add(const typename node_type::uptr& root)
+    {
+        return add(root.get());
+    }
+
+    std::size_t size() const
+    {
+        return rules_.size();
+    }
+
+    /// how much the residual predicates of the rules are shared
+    const shared_type& sharing() const
+    {
+        return shared_;
+    }
+
+    /// the matching rules as the bits of a set of size() bits
+    void match(context_type& ctx, match_state& state, rule_bitset& out) const
+    {
+        if (!built_) {
+            throw std::runtime_error("rule_set: build() was not called");
+        }
+        out.resize(rules_.size());
+        out.clear();
+        ctx.forget();
+        auto& counts = state.counts;
+        auto& touched = state.touched;
+        counts.resize(rules_.size(), 0);
+        touched.clear();
+        auto hit = [&counts, &touched](std::uint32_t id) {
+            if (counts[id]++ == 0) {
+                touched.emplace_back(id);
+            }
+        };
+        for (auto& index : indexes_) {
+            index.collect(ctx.read(index.slot), hit);
+        }
+        for (auto id : touched) {
+            auto& rule = rules_[id];
+            if (counts[id] == rule.required && rule.residual.match(ctx)) {
+                out.set(id);
+            }
+            counts[id] = 0;
+        }
+        for (auto id : unindexed_) {
+            if (rules_[id].residual.match(ctx)) {
+                out.set(id);
+            }
+        }
+    }
+
+    /// ids of the matching rules, ascending
+    void match(context_type& ctx, match_state& state,
+               std::vector<std::size_t>& out) const
+    {
+        match(ctx, state, state.matched);
+        state.matched.append_to(out);
+    }
+
+    /// scratch of the sharded match() of one record: the candidate
+    /// rules, their verdicts and one context per thread of the pool
+    struct shard_state {
+        match_state state;
+        std::vector<std::uint32_t> candidates;
+        std::vector<unsigned char> verdicts;
+        std::vector<std::unique_ptr<context_type>> contexts;
+    };
+
+    /// candidate rules per task of the sharded match()
+    static constexpr std::size_t rule_grain = 256;
+
+    /// one record with the rules shared out over the threads of pool.
+    /// the indexes are read once; the residuals of the rules they leave,
+    /// and of the unindexed ones, run in chunks of grain rules
+    void match(executor& pool, const environment_type& env,
+               shard_state& shard, rule_bitset& out,
+               std::size_t grain = rule_grain) const
+    {
+        if (!built_) {
+            throw std::runtime_error("rule_set: build() was not called");
+        }
+        grain = std::max<std::size_t>(grain, 1);
+        out.resize(rules_.size());
+        out.clear();
+        auto& counts = shard.state.counts;
+        auto& touched = shard.state.touched;
+        auto& candidates = shard.candidates;
+        counts.resize(rules_.size(), 0);
+        touched.clear();
+        candidates.clear();
+        auto hit = [&counts, &touched](std::uint32_t id) {
+            if (counts[id]++ == 0) {
+                touched.emplace_back(id);
+            }
+        };
+        for (auto& index : indexes_) {
+            index.collect(env.read(index.slot), hit);
+        }
+        for (auto id : touched) {
+            if (counts[id] == rules_[id].required) {
+                candidates.emplace_back(id);
+            }
+            counts[id] = 0;
+        }
+        candidates.insert(candidates.end(), unindexed_.begin(),
+                          unindexed_.end());
+
+        auto& verdicts = shard.verdicts;
+        verdicts.assign(candidates.size(), 0);
+        shard.contexts.resize(std::max(shard.contexts.size(), pool.size()));
+        for (auto& ctx : shard.contexts) {
+            if (ctx) {
+                ctx->set_environment(env);
+                ctx->forget();
+            }
+        }
+        auto chunks = (candidates.size() + grain - 1) / grain;
+        pool.parallel_for(chunks, [&](std::size_t chunk, std::size_t id) {
+            auto& ctx = shard.contexts[id];
+            if (!ctx) {
+                ctx = std::make_unique<context_type>(env);
+            }
+            auto last = std::min(candidates.size(), (chunk + 1) * grain);
+            for (auto i = chunk * grain; i < last; ++i) {
+                verdicts[i] = rules_[candidates[i]].residual.match(*ctx);
+            }
+        });
+        for (std::size_t i = 0; i < candidates.size(); ++i) {
+            if (verdicts[i]) {
+                out.set(candidates[i]);
+            }
+        }
+    }
+
+    /// records in chunks of grain over the threads of pool; out[i] gets
+    /// the ids of the rules matched by records[i]. the rules are shared,
+    /// every thread has its own context and match state. too few records
+    /// to keep the threads busy and many rules: the records go one by
+    /// one, each with its rules shared out over the threads
+    void match(executor& pool,
+               const std::vector<const environment_type*>& records,
+               std::vector<std::vector<std::size_t>>& out,
+               std::size_t grain = 64) const
+    {
+        struct worker {
+            std::unique_ptr<context_type> ctx;
+            match_state state;
+        };
+        grain = std::max<std::size_t>(grain, 1);
+        out.resize(records.size());
+        auto chunks = (records.size() + grain - 1) / grain;
+        if (pool.size() > 1 && chunks < pool.size()
+            && rules_.size() >= 2 * rule_grain * pool.size()) {
+            shard_state shard;
+            rule_bitset found;
+            for (std::size_t i = 0; i < records.size(); ++i) {
+                match(pool, *records[i], shard, found);
+                out[i].clear();
+                found.append_to(out[i]);
+            }
+            return;
+        }
+        std::vector<worker> workers(pool.size());
+        pool.parallel_for(chunks, [&](std::size_t chunk, std::size_t id) {
+            auto& local = workers[id];
+            auto last = std::min(records.size(), (chunk + 1) * grain);
+            for (auto i = chunk * grain; i < last; ++i) {
+                if (!local.ctx) {
+                    local.ctx = std::make_unique<context_type>(*records[i]);
+                } else {
+                    local.ctx->set_environment(*records[i]);
+                }
+                out[i].clear();
+                match(*local.ctx, local.state, out[i]);
+            }
+        });
+    }
+
+    std::vector<std::size_t> match(const environment_type& env) const
+    {
+        context_type ctx(env);
+        match_state state;
+        std::vector<std::size_t> out;
+        match(ctx, state, out);
+        return out;
+    }
+
+    void match(const environment_type& env, rule_bitset& out) const
+    {
+        context_type ctx(env);
+        match_state state;
+        match(ctx, state, out);
+    }
+
+    /// a floating value equals an integer literal if it equals the
+    /// literal as a double. beyond 2^53 several integers share that
+    /// double and the exact key would miss some, so such literals
+    /// stay with the residual. rule_image_writer indexes the same way
+    static bool exact_key(objects::base::cptr literal)
+    {
+        using namespace objects;
+        if (!base::is<number>(literal)) {
+            return true;
+        }
+        auto num = base::cast<number>(literal)->value();
+        return -max_exact < num && num < max_exact;
+    }
+
+private:
+    using id_list = std::vector<std::uint32_t>;
+    using id_type = typename lexem_type::id_type;
+    using string_view_type = typename scalar_type::string_view_type;
+    using literals_type = literals<lexem_type>;
+    using value_node = objects::ast::value<lexem_type>;
+    using ident_node = objects::ast::ident<lexem_type>;
+    using binary_node = objects::ast::binary_operation<lexem_type>;
+    using string_object = typename literals_type::string_object;
+
+    struct entry {
+        rule_type residual;
+        std::uint32_t required;
+    };
+
+    /// bounds of indexed ranges are below 2^53 in magnitude, so they and
+    /// every integer up to there are exact doubles. larger integers are
+    /// moved to the next double past the limit, the order stays the same
+    static constexpr double max_exact = 9007199254740992.0;
+
+    /// rules by the constant their 'ident = constant' conjunct expects,
+    /// by the interval of their range conjuncts and by their prefixes
+    struct slot_index {
+        std::size_t slot = 0;
+        std::unordered_map<std::int64_t, id_list> numbers;
+        std::unordered_map<double, id_list> floats;
+        std::unordered_map<string_view_type, id_list> strings;
+        id_list booleans[2];
+        interval_tree<double> ranges;
+        trie<char_type, id_list> prefixes;
+
+        template <typename CallT>
+        void collect(const scalar_type& value, CallT& call) const
+        {
+            switch (value.kind) {
+            case scalar_type::kind_type::INTEGER:
+                find(numbers, value.integer, call);
+                if (!floats.empty()) {
+                    find(floats, static_cast<double>(value.integer), call);
+                }
+                ranges.query(to_bound(value.integer), call);
+                break;
+            case scalar_type::kind_type::FLOATING:
+                find(floats, value.floating, call);
+                if (!numbers.empty() && is_integral(value.floating)) {
+                    find(numbers, static_cast<std::int64_t>(value.floating),
+                         call);
+                }
+                ranges.query(value.floating, call);
+                break;
+            case scalar_type::kind_type::STRING:
+                find(strings, value.string, call);
+                prefixes.for_each_prefix(value.string.begin(),
+                                         value.string.end(),
+                                         [&call](const id_list& ids) {
+                                             for (auto id : ids) {
+                                                 call(id);
+                                             }
+                                         });
+                break;
+            case scalar_type::kind_type::BOOLEAN:
+                for (auto id : booleans[value.boolean]) {
+                    call(id);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        template <typename MapT, typename KeyT, typename CallT>
+        static void find(const MapT& map, const KeyT& key, CallT& call)
+        {
+            auto found = map.find(key);
+            if (found != map.end()) {
+                for (auto id : found->second) {
+                    call(id);
+                }
+            }
+        }
+
+        static double to_bound(std::int64_t value)
+        {
+            if (value > max_exact) {
+                return max_exact + 2;
+            } else if (value < -max_exact) {
+                return -max_exact - 2;
+            }
+            return static_cast<double>(value);
+        }
+
+        static bool is_integral(double num)
+        {
+            return num >= -9.2e18 && num <= 9.2e18 && std::trunc(num) == num;
+        }
+    };
+
+    static void flatten(const node_type* node,
+                        std::vector<const node_type*>& out)
+    {
+        if (objects::base::is<binary_node>(node)
+            && node->lexem().token() == constants::token_type::AND) {
+            auto bin = objects::base::cast<binary_node>(node);
+            flatten(bin->left().get(), out);
+            flatten(bin->right().get(), out);
+        } else {
+            out.emplace_back(node);
+        }
+    }
+
+    slot_index& index_for(std::size_t slot)
+    {
+        if (slot >= positions_.size()) {
+            positions_.resize(slot + 1, npos);
+        }
+        if (positions_[slot] == npos) {
+            positions_[slot] = indexes_.size();
+            indexes_.emplace_back();
+            indexes_.back().slot = slot;
+        }
+        return indexes_[positions_[slot]];
+    }
+
+    /// whether node goes to an index; with store it is added there
+    bool index_conjunct(const node_type* node, std::uint32_t id, bool store)
+    {
+        return index_equality(node, id, store) || index_range(node, id, store)
+            || index_prefix(node, id, store);
+    }
+
+    /// 'ident = literal' or 'literal = ident'
+    bool index_equality(const node_type* node, std::uint32_t id, bool store)
+    {
+        using namespace objects;
+        if (!base::is<binary_node>(node)
+            || node->lexem().token() != constants::token_type::EQ) {
+            return false;
+        }
+        auto bin = base::cast<binary_node>(node);
+        const node_type* ident = bin->left().get();
+        const node_type* value = bin->right().get();
+        if (!base::is<ident_node>(ident)) {
+            std::swap(ident, value);
+        }
+        if (!base::is<ident_node>(ident) || !base::is<value_node>(value)) {
+            return false;
+        }
+        auto literal = literals_type::to_object(value->lexem());
+        if (!literal || !exact_key(literal.get())) {
+            return false;
+        } else if (!store) {
+            return true;
+        }
+        auto& index = index_for(symbols()->resolve(ident->lexem().value()));
+        if (base::is<number>(literal.get())) {
+            index.numbers[base::cast<number>(literal.get())->value()]
+                .emplace_back(id);
+        } else if (base::is<floating>(literal.get())) {
+            index.floats[base::cast<floating>(literal.get())->value()]
+                .emplace_back(id);
+        } else if (base::is<boolean>(literal.get())) {
+            index.booleans[base::cast<boolean>(literal.get())->value()]
+                .emplace_back(id);
+        } else {
+            auto str = base::cast<string_object>(literal.get());
+            index.strings[string_view_type(intern(str->value()))]
+                .emplace_back(id);
+        }
+        return true;
+    }
+
+    /// 'ident in a..b' and comparisons of an identifier with a literal.
+    /// one sided comparisons are intervals that end at infinity
+    bool index_range(const node_type* node, std::uint32_t id, bool store)
+    {
+        using namespace objects;
+        using item_type = typename interval_tree<double>::item;
+        if (!base::is<binary_node>(node)) {
+            return false;
+        }
+        auto bin = base::cast<binary_node>(node);
+        auto token = bin->lexem().token();
+        const node_type* ident = bin->left().get();
+        const node_type* bound = bin->right().get();
+        const auto inf = std::numeric_limits<double>::infinity();
+        item_type item { 0, 0, false, false, id };
+        double low = 0;
+        double high = 0;
+        switch (token) {
+        case constants::token_type::IN: {
+            auto range_token = bound->lexem().token();
+            if (!base::is<binary_node>(bound)
+                || (range_token != constants::token_type::DOTDOT
+                    && range_token != constants::token_type::DOTDOTDOT)) {
+                return false;
+            }
+            auto range = base::cast<binary_node>(bound);
+            if (!base::is<ident_node>(ident)
+                || !exact_bound(range->left().get(), low)
+                || !exact_bound(range->right().get(), high)) {
+                return false;
+            }
+            auto exclusive = (range_token == constants::token_type::DOTDOTDOT);
+            item = { low, high, false, exclusive, id };
+            break;
+        }
+        case constants::token_type::LT:
+        case constants::token_type::GT:
+        case constants::token_type::LEQ:
+        case constants::token_type::GEQ:
+            if (!base::is<ident_node>(ident)) {
+                std::swap(ident, bound);
+                token = flip(token);
+            }
+            if (!base::is<ident_node>(ident) || !exact_bound(bound, low)) {
+                return false;
+            }
+            if (token == constants::token_type::LT) {
+                item = { -inf, low, false, true, id };
+            } else if (token == constants::token_type::LEQ) {
+                item = { -inf, low, false, false, id };
+            } else if (token == constants::token_type::GT) {
+                item = { low, inf, true, false, id };
+            } else {
+                item = { low, inf, false, false, id };
+            }
+            break;
+        default:
+            return false;
+        }
+        if (store) {
+            index_for(symbols()->resolve(ident->lexem().value()))
+                .ranges.add(item);
+        }
+        return true;
+    }
+
+    /// 'ident startswith "literal"'
+    bool index_prefix(const node_type* node, std::uint32_t id, bool store)
+    {
+        using namespace objects;
+        if (!base::is<binary_node>(node)
+            || node->lexem().token() != constants::token_type::STARTSWITH) {
+            return false;
+        }
+        auto bin = base::cast<binary_node>(node);
+        auto ident = bin->left().get();
+        auto value = bin->right().get();
+        if (!base::is<ident_node>(ident) || !base::is<value_node>(value)) {
+            return false;
+        }
+        auto literal = literals_type::to_object(value->lexem());
+        if (!base::is<string_object>(literal.get())) {
+            return false;
+        } else if (!store) {
+            return true;
+        }
+        auto& prefix = base::cast<string_object>(literal.get())->value();
+        index_for(symbols()->resolve(ident->lexem().value()))
+            .prefixes.get_or_set(prefix.begin(), prefix.end())
+            .emplace_back(id);
+        return true;
+    }
+
+    static id_type flip(id_type token)
+    {
+        switch (token) {
+        case constants::token_type::LT:
+            return constants::token_type::GT;
+        case constants::token_type::GT:
+            return constants::token_type::LT;
+        case constants::token_type::LEQ:
+            return constants::token_type::GEQ;
+        case constants::token_type::GEQ:
+            return constants::token_type::LEQ;
+        default:
+            break;
+        }
+        return token;
+    }
+
+    static bool exact_bound(const node_type* node, double& out)
+    {
+        using namespace objects;
+        if (!base::is<value_node>(node)) {
+            return false;
+        }
+        auto literal = literals_type::to_object(node->lexem());
+        if (base::is<number>(literal.get())) {
+            auto num = base::cast<number>(literal.get())->value();
+            out = static_cast<double>(num);
+        } else if (base::is<floating>(literal.get())) {
+            out = base::cast<floating>(literal.get())->value();
+        } else {
+            return false;
+        }
+        return -max_exact < out && out < max_exact;
+    }
+
+    const string_type& intern(const string_type& value)
+    {
+        auto found = strings_.find(value);
+        if (found == strings_.end()) {
+            found = strings_.emplace(value).first;
+        }
+        return *found;
+    }
+
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    compiler_type compiler_;
+    shared_type shared_;
+    std::vector<entry> rules_;
+    std::vector<std::uint32_t> unindexed_;
+    std::vector<slot_index> indexes_;
+    std::vector<std::size_t> positions_;
+    std::set<string_type> strings_;
+    bool built_ = true;
+};
+
+}
@@ -4,10 +4,68 @@
 #include "erules/objects.h"
 #include "erules/operations.h"
 #include "erules/rule_lexem.h"
+#include "erules/scalar.h"
+#include <cstdint>
 #include <sstream>
+#include <string_view>
 
 namespace erules { namespace operations {
 
+    /// 'value startswith prefix'
+    template <typename CharT>
+    inline bool starts_with(std::basic_string_view<CharT> value,
+                            std::basic_string_view<CharT> prefix)
+    {
+        return value.size() >= prefix.size()
+            && value.substr(0, prefix.size()) == prefix;
+    }
+
+    /// integer arithmetic wraps around as unsigned numbers do, it never
+    /// overflows. a zero divisor gives no value; INT64_MIN / -1 wraps to
+    /// INT64_MIN and its remainder is 0
+    namespace integers {
+        inline std::int64_t add(std::int64_t l, std::int64_t r)
+        {
+            return static_cast<std::int64_t>(static_cast<std::uint64_t>(l)
+                                             + static_cast<std::uint64_t>(r));
+        }
+
+        inline std::int64_t sub(std::int64_t l, std::int64_t r)
+        {
+            return static_cast<std::int64_t>(static_cast<std::uint64_t>(l)
+                                             - static_cast<std::uint64_t>(r));
+        }
+
+        inline std::int64_t mul(std::int64_t l, std::int64_t r)
+        {
+            return static_cast<std::int64_t>(static_cast<std::uint64_t>(l)
+                                             * static_cast<std::uint64_t>(r));
+        }
+
+        inline std::int64_t neg(std::int64_t v)
+        {
+            return sub(0, v);
+        }
+
+        inline bool div(std::int64_t l, std::int64_t r, std::int64_t& out)
+        {
+            if (r == 0) {
+                return false;
+            }
+            out = (r == -1) ? neg(l) : l / r;
+            return true;
+        }
+
+        inline bool mod(std::int64_t l, std::int64_t r, std::int64_t& out)
+        {
+            if (r == 0) {
+                return false;
+            }
+            out = (r == -1) ? 0 : l % r;
+            return true;
+        }
+    }
+
     template <typename CharT = char, typename LessType = std::less<CharT>>
     class binary_operations {
     public:
@@ -23,7 +81,8 @@ namespace erules { namespace operations {
             /// + operation. numbers, float, strings
             result.template set<number, number>(
                 constants::token_type::PLUS, [](auto l, auto r) {
-                    return std::make_unique<number>(l->value() + r->value());
+                    return std::make_unique<number>(
+                        integers::add(l->value(), r->value()));
                 });
             result.template set<floating, number>(
                 constants::token_type::PLUS,
@@ -33,6 +92,10 @@ namespace erules { namespace operations {
                         + static_cast<double>(r->value()));
                 },
                 true);
+            result.template set<floating, floating>(
+                constants::token_type::PLUS, [](auto l, auto r) {
+                    return std::make_unique<floating>(l->value() + r->value());
+                });
             result.template set<string_type, string_type>(
                 constants::token_type::PLUS, [](auto l, auto r) {
                     return std::make_unique<string_type>(l->value()
@@ -41,7 +104,8 @@ namespace erules { namespace operations {
             /// - number floating
             result.template set<number, number>(
                 constants::token_type::MINUS, [](auto l, auto r) {
-                    return std::make_unique<number>(l->value() - r->value());
+                    return std::make_unique<number>(
+                        integers::sub(l->value(), r->value()));
                 });
             result.template set<floating, number>(
                 constants::token_type::MINUS, [](auto l, auto r) {
@@ -55,11 +119,16 @@ namespace erules { namespace operations {
                         static_cast<double>(l->value())
                         - static_cast<double>(r->value()));
                 });
+            result.template set<floating, floating>(
+                constants::token_type::MINUS, [](auto l, auto r) {
+                    return std::make_unique<floating>(l->value() - r->value());
+                });
 
             /// * numbers, float, string * number
             result.template set<number, number>(
                 constants::token_type::MUL, [](auto l, auto r) {
-                    return std::make_unique<number>(l->value() * r->value());
+                    return std::make_unique<number>(
+                        integers::mul(l->value(), r->value()));
                 });
             result.template set<floating, number>(
                 constants::token_type::MUL,
@@ -69,13 +138,19 @@ namespace erules { namespace operations {
                         * static_cast<double>(r->value()));
                 },
                 true);
+            result.template set<floating, floating>(
+                constants::token_type::MUL, [](auto l, auto r) {
+                    return std::make_unique<floating>(l->value() * r->value());
+                });
             result.template set<string_type, number>(
                 constants::token_type::MUL,
                 [](auto l, auto r) {
                     std::basic_string<CharT> out;
-                    out.reserve(l->value().size()
-                                * static_cast<std::size_t>(r->value()));
                     auto count = r->value();
+                    if (count > 0) {
+                        out.reserve(l->value().size()
+                                    * static_cast<std::size_t>(count));
+                    }
                     while (count-- > 0) {
                         out += l->value();
                     }
@@ -86,7 +161,11 @@ namespace erules { namespace operations {
             /// / number, float
             result.template set<number, number>(
                 constants::token_type::DIV, [](auto l, auto r) {
-                    return std::make_unique<number>(l->value() / r->value());
+                    std::int64_t res;
+                    if (!integers::div(l->value(), r->value(), res)) {
+                        return std::unique_ptr<number> {};
+                    }
+                    return std::make_unique<number>(res);
                 });
             result.template set<floating, number>(
                 constants::token_type::DIV, [](auto l, auto r) {
@@ -102,10 +181,18 @@ namespace erules { namespace operations {
                         / static_cast<double>(r->value()));
                 });
 
+            result.template set<floating, floating>(
+                constants::token_type::DIV, [](auto l, auto r) {
+                    return std::make_unique<floating>(l->value() / r->value());
+                });
             /// mod numbers only
             result.template set<number, number>(
                 constants::token_type::MOD, [](auto l, auto r) {
-                    return std::make_unique<number>(l->value() % r->value());
+                    std::int64_t res;
+                    if (!integers::mod(l->value(), r->value(), res)) {
+                        return std::unique_ptr<number> {};
+                    }
+                    return std::make_unique<number>(res);
                 });
 
             fill_logic(result);
@@ -114,6 +201,8 @@ namespace erules { namespace operations {
 
         static void fill_logic(objects::oprerations::binary<id_type>& result)
         {
+            using namespace objects;
+
             auto logic_EQ = [](auto left, auto right) { return left == right; };
             auto logic_NEQ
                 = [](auto left, auto right) { return left != right; };
@@ -151,6 +240,11 @@ namespace erules { namespace operations {
                 constants::token_type::LEQ, create_logic(logic_LEQ));
             result.template set<string_type, string_type>(
                 constants::token_type::GEQ, create_logic(logic_GEQ));
+            result.template set<string_type, string_type>(
+                constants::token_type::STARTSWITH, [](auto l, auto r) {
+                    return std::make_unique<boolean>(starts_with<CharT>(
+                        l->value(), r->value()));
+                });
 
             /// floating
             result.template set<floating, floating>(constants::token_type::EQ,
@@ -166,6 +260,32 @@ namespace erules { namespace operations {
             result.template set<floating, floating>(constants::token_type::GEQ,
                                                     create_logic(logic_GEQ));
 
+            /// floating and number
+            result.template set<floating, number>(
+                constants::token_type::EQ, create_logic(logic_EQ));
+            result.template set<floating, number>(
+                constants::token_type::NOTEQ, create_logic(logic_NEQ));
+            result.template set<floating, number>(
+                constants::token_type::LT, create_logic(logic_LT));
+            result.template set<floating, number>(
+                constants::token_type::GT, create_logic(logic_GT));
+            result.template set<floating, number>(
+                constants::token_type::LEQ, create_logic(logic_LEQ));
+            result.template set<floating, number>(
+                constants::token_type::GEQ, create_logic(logic_GEQ));
+            result.template set<number, floating>(
+                constants::token_type::EQ, create_logic(logic_EQ));
+            result.template set<number, floating>(
+                constants::token_type::NOTEQ, create_logic(logic_NEQ));
+            result.template set<number, floating>(
+                constants::token_type::LT, create_logic(logic_LT));
+            result.template set<number, floating>(
+                constants::token_type::GT, create_logic(logic_GT));
+            result.template set<number, floating>(
+                constants::token_type::LEQ, create_logic(logic_LEQ));
+            result.template set<number, floating>(
+                constants::token_type::GEQ, create_logic(logic_GEQ));
+
             /// boolean
             result.template set<boolean, boolean>(constants::token_type::EQ,
                                                   create_logic(logic_EQ));
@@ -188,7 +308,7 @@ namespace erules { namespace operations {
         static auto create_logic(CallT call)
         {
             return [call](auto left, auto right) {
-                return std::make_unique<boolean>(
+                return std::make_unique<objects::boolean>(
                     call(left->value(), right->value()));
             };
         }
@@ -204,10 +324,193 @@ namespace erules { namespace operations {
             using namespace objects;
             objects::oprerations::unary<id_type> result;
 
+            /// - + numbers, float
+            result.template set<number>(constants::token_type::MINUS,
+                                        [](auto v) {
+                                            return std::make_unique<number>(
+                                                integers::neg(v->value()));
+                                        });
+            result.template set<floating>(constants::token_type::MINUS,
+                                          [](auto v) {
+                                              return std::make_unique<floating>(
+                                                  -v->value());
+                                          });
+            result.template set<number>(constants::token_type::PLUS,
+                                        [](auto v) { return v->clone(); });
+            result.template set<floating>(constants::token_type::PLUS,
+                                          [](auto v) { return v->clone(); });
+
+            /// not boolean
+            result.template set<boolean>(constants::token_type::NOT,
+                                         [](auto v) {
+                                             return std::make_unique<boolean>(
+                                                 !v->value());
+                                         });
             return result;
         }
     };
 
+    /// binary_operations and unary_operations over unboxed values.
+    /// covers numbers, floating, booleans and string comparisons; the
+    /// calls return false where a new object is needed (string + and *)
+    /// or the kinds are not known here, the caller boxes and uses the maps
+    template <typename CharT = char, typename LessType = std::less<CharT>>
+    class scalar_operations {
+    public:
+        using lexem_type = filters::rule_lexem<CharT, LessType>;
+        using id_type = typename lexem_type::id_type;
+        using scalar_type = scalar<CharT>;
+        using kind_type = typename scalar_type::kind_type;
+
+        static bool binary(id_type op, const scalar_type& l,
+                           const scalar_type& r, scalar_type& out)
+        {
+            if (l.kind == kind_type::INTEGER && r.kind == kind_type::INTEGER) {
+                return integer_call(op, l.integer, r.integer, out);
+            } else if (is_numeric(l) && is_numeric(r)) {
+                return floating_call(op, to_double(l), to_double(r), out);
+            } else if (l.kind == kind_type::STRING
+                       && r.kind == kind_type::STRING) {
+                if (op == constants::token_type::STARTSWITH) {
+                    out = scalar_type::make_boolean(
+                        starts_with<CharT>(l.string, r.string));
+                    return true;
+                }
+                return compare(op, l.string, r.string, out);
+            } else if (l.kind == kind_type::BOOLEAN
+                       && r.kind == kind_type::BOOLEAN) {
+                return compare(op, l.boolean, r.boolean, out);
+            }
+            return false;
+        }
+
+        static bool unary(id_type op, const scalar_type& val,
+                          scalar_type& out)
+        {
+            switch (op) {
+            case constants::token_type::MINUS:
+                if (val.kind == kind_type::INTEGER) {
+                    out = scalar_type::make_integer(
+                        integers::neg(val.integer));
+                    return true;
+                } else if (val.kind == kind_type::FLOATING) {
+                    out = scalar_type::make_floating(-val.floating);
+                    return true;
+                }
+                break;
+            case constants::token_type::PLUS:
+                if (is_numeric(val)) {
+                    out = val;
+                    return true;
+                }
+                break;
+            case constants::token_type::NOT:
+                if (val.kind == kind_type::BOOLEAN) {
+                    out = scalar_type::make_boolean(!val.boolean);
+                    return true;
+                }
+                break;
+            default:
+                break;
+            }
+            return false;
+        }
+
+    private:
+        static bool is_numeric(const scalar_type& val)
+        {
+            return val.kind == kind_type::INTEGER
+                || val.kind == kind_type::FLOATING;
+        }
+
+        static double to_double(const scalar_type& val)
+        {
+            return val.kind == kind_type::INTEGER
+                ? static_cast<double>(val.integer)
+                : val.floating;
+        }
+
+        /// as in binary_operations, see integers
+        static bool integer_call(id_type op, std::int64_t l, std::int64_t r,
+                                 scalar_type& out)
+        {
+            std::int64_t res;
+            switch (op) {
+            case constants::token_type::PLUS:
+                out = scalar_type::make_integer(integers::add(l, r));
+                return true;
+            case constants::token_type::MINUS:
+                out = scalar_type::make_integer(integers::sub(l, r));
+                return true;
+            case constants::token_type::MUL:
+                out = scalar_type::make_integer(integers::mul(l, r));
+                return true;
+            case constants::token_type::DIV:
+                out = integers::div(l, r, res) ? scalar_type::make_integer(res)
+                                               : scalar_type {};
+                return true;
+            case constants::token_type::MOD:
+                out = integers::mod(l, r, res) ? scalar_type::make_integer(res)
+                                               : scalar_type {};
+                return true;
+            default:
+                break;
+            }
+            return compare(op, l, r, out);
+        }
+
+        static bool floating_call(id_type op, double l, double r,
+                                  scalar_type& out)
+        {
+            switch (op) {
+            case constants::token_type::PLUS:
+                out = scalar_type::make_floating(l + r);
+                return true;
+            case constants::token_type::MINUS:
+                out = scalar_type::make_floating(l - r);
+                return true;
+            case constants::token_type::MUL:
+                out = scalar_type::make_floating(l * r);
+                return true;
+            case constants::token_type::DIV:
+                out = scalar_type::make_floating(l / r);
+                return true;
+            default:
+                break;
+            }
+            return compare(op, l, r, out);
+        }
+
+        template <typename T>
+        static bool compare(id_type op, const T& l, const T& r,
+                            scalar_type& out)
+        {
+            switch (op) {
+            case constants::token_type::EQ:
+                out = scalar_type::make_boolean(l == r);
+                return true;
+            case constants::token_type::NOTEQ:
+                out = scalar_type::make_boolean(l != r);
+                return true;
+            case constants::token_type::LT:
+                out = scalar_type::make_boolean(l < r);
+                return true;
+            case constants::token_type::GT:
+                out = scalar_type::make_boolean(l > r);
+                return true;
+            case constants::token_type::LEQ:
+                out = scalar_type::make_boolean(l <= r);
+                return true;
+            case constants::token_type::GEQ:
+                out = scalar_type::make_boolean(l >= r);
+                return true;
+            default:
+                break;
+            }
+            return false;
+        }
+    };
+
     template <typename CharT = char, typename LessType = std::less<CharT>>
     class transform_operations {
     public:
@@ -256,8 +559,7 @@ namespace erules { namespace operations {
 
             result.template set<string_type, floating>([](auto str) {
                 auto val = str->value();
-                auto num_val
-                    = helpers::reader::read_float(val.begin(), val.end());
+                auto num_val = helpers::reader::read_float(val);
                 return std::make_unique<floating>(num_val);
             });
 
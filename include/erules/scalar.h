@@ -0,0 +1,123 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+#include "erules/objects.h"
+
+namespace erules {
+
+/// unboxed view of a number, floating, boolean or string value.
+/// other objects are carried by pointer. nothing is owned: strings and
+/// objects are valid while their source is
+template <typename CharT>
+struct scalar {
+    using string_view_type = std::basic_string_view<CharT>;
+    using string_object = objects::string<CharT>;
+
+    enum class kind_type : std::uint8_t {
+        NONE,
+        INTEGER,
+        FLOATING,
+        BOOLEAN,
+        STRING,
+        OBJECT,
+    };
+
+    static scalar make_integer(std::int64_t val)
+    {
+        scalar res;
+        res.kind = kind_type::INTEGER;
+        res.integer = val;
+        return res;
+    }
+
+    static scalar make_floating(double val)
+    {
+        scalar res;
+        res.kind = kind_type::FLOATING;
+        res.floating = val;
+        return res;
+    }
+
+    static scalar make_boolean(bool val)
+    {
+        scalar res;
+        res.kind = kind_type::BOOLEAN;
+        res.boolean = val;
+        return res;
+    }
+
+    static scalar make_string(string_view_type val)
+    {
+        scalar res;
+        res.kind = kind_type::STRING;
+        res.string = val;
+        return res;
+    }
+
+    static scalar make_object(objects::base::cptr val)
+    {
+        scalar res;
+        if (val) {
+            res.kind = kind_type::OBJECT;
+            res.object = val;
+        }
+        return res;
+    }
+
+    static scalar from_object(objects::base::cptr obj)
+    {
+        using objects::base;
+        if (base::is<objects::number>(obj)) {
+            return make_integer(base::cast<objects::number>(obj)->value());
+        } else if (base::is<objects::floating>(obj)) {
+            return make_floating(base::cast<objects::floating>(obj)->value());
+        } else if (base::is<objects::boolean>(obj)) {
+            return make_boolean(base::cast<objects::boolean>(obj)->value());
+        } else if (base::is<string_object>(obj)) {
+            return make_string(base::cast<string_object>(obj)->value());
+        }
+        return make_object(obj);
+    }
+
+    /// boxes the value. strings are copied, objects are cloned
+    objects::base::uptr to_object() const
+    {
+        switch (kind) {
+        case kind_type::INTEGER:
+            return std::make_unique<objects::number>(integer);
+        case kind_type::FLOATING:
+            return std::make_unique<objects::floating>(floating);
+        case kind_type::BOOLEAN:
+            return std::make_unique<objects::boolean>(boolean);
+        case kind_type::STRING:
+            return std::make_unique<string_object>(
+                typename string_object::string_type(string));
+        case kind_type::OBJECT:
+            return object->clone();
+        default:
+            break;
+        }
+        return {};
+    }
+
+    bool empty() const
+    {
+        return kind == kind_type::NONE;
+    }
+
+    kind_type kind = kind_type::NONE;
+    union {
+        std::int64_t integer = 0;
+        double floating;
+        bool boolean;
+        objects::base::cptr object;
+    };
+    string_view_type string;
+};
+
+static_assert(std::is_trivially_copyable<scalar<char>>::value,
+              "scalar is passed by value on the evaluation path");
+
+}
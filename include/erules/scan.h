@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+
+namespace erules { namespace scan {
+
+    /// linear search over a contiguous block.
+    /// the inner loop has no early exit, so the compiler can turn it into
+    /// vector compares; the block size keeps the overshoot small
+    template <typename T>
+    bool contains(const T* data, std::size_t size, T value)
+    {
+        constexpr std::size_t block = 16;
+        std::size_t pos = 0;
+        for (; pos + block <= size; pos += block) {
+            unsigned hits = 0;
+            for (std::size_t i = 0; i < block; ++i) {
+                hits |= (data[pos + i] == value);
+            }
+            if (hits) {
+                return true;
+            }
+        }
+        for (; pos < size; ++pos) {
+            if (data[pos] == value) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+}}
@@ -18,6 +18,12 @@ class trie {
             return (f == m_next.end()) ? nullptr : &f->second;
         }
 
+        const NodeType* get(const key_type& k) const
+        {
+            auto f = m_next.find(k);
+            return (f == m_next.end()) ? nullptr : &f->second;
+        }
+
         NodeType* set(const key_type& k)
         {
             auto f = m_next.insert(std::make_pair(k, NodeType()));
@@ -183,6 +189,38 @@ public:
         set(ptr, ptr + len, std::move(value));
     }
 
+    /// value of the key; a default one is set if there is none
+    template <typename IterT>
+    value_type& get_or_set(IterT begin, const IterT& end)
+    {
+        node_type* last = &m_root;
+        for (; begin != end; ++begin) {
+            last = last->set(*begin);
+        }
+        if (!last->value()) {
+            last->set_value(value_type());
+        }
+        return *last->value();
+    }
+
+    /// calls call(value) for every key that is a prefix of [b, e),
+    /// the empty key included, shortest first
+    template <typename IterT, typename CallT>
+    void for_each_prefix(IterT b, const IterT& e, CallT&& call) const
+    {
+        const node_type* next = &m_root;
+        while (next) {
+            if (next->value()) {
+                call(*next->value());
+            }
+            if (b == e) {
+                break;
+            }
+            next = next->get(*b);
+            ++b;
+        }
+    }
+
     template <typename IterT>
     result_view<IterT> get(IterT b, const IterT& e, bool greedy)
     {
@@ -17,11 +17,31 @@ void run();
 namespace test_objects {
 void run();
 }
+namespace test_optimizer {
+void run();
+}
+namespace test_compiler {
+void run();
+}
+namespace test_rule_set {
+void run();
+}
+namespace test_columnar {
+void run();
+}
+namespace test_codegen {
+void run();
+}
 
 int main()
 {
     //    test_lexer::run();
     //    test_parser::run();
     test_objects::run();
+    test_optimizer::run();
+    test_compiler::run();
+    test_rule_set::run();
+    test_columnar::run();
+    test_codegen::run();
     return 0;
 }
@@ -0,0 +1,212 @@
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "codegen_rules.h"
+#include "erules/codegen.h"
+#include "erules/environment.h"
+#include "erules/objects.h"
+#include "erules/record.h"
+#include "erules/rule_image.h"
+#include "erules/rule_lexem.h"
+#include "erules/rule_lexer.h"
+#include "erules/rule_parser.h"
+
+using namespace erules;
+using namespace erules::objects;
+
+namespace test_codegen {
+
+using mlexer = filters::lexer<char>;
+using lexem_type = typename mlexer::lexem_type;
+using mparser = rule_parser<lexem_type>;
+using mcompiler = compiler<lexem_type>;
+using environment_type = slot_environment<char>;
+
+typename mcompiler::node_type::uptr parse(const std::string& input)
+{
+    mlexer lex;
+    mparser pars(lex.read_all(input));
+    return pars.parse();
+}
+
+struct order {
+    std::int64_t id;
+    std::int64_t quantity;
+    double amount;
+    bool paid;
+    std::string country;
+    std::string note;
+};
+
+std::vector<order> make_orders(std::size_t count)
+{
+    const char* countries[] = { "US", "CA", "DE", "FR", "JP", "" };
+    const char* notes[] = { "", "J", "say \"hi\"?", "tab\tx", "C", "U" };
+    std::vector<order> res;
+    for (std::size_t i = 0; i < count; ++i) {
+        auto id = static_cast<std::int64_t>(i);
+        res.push_back({ id, id % 7 - 2, static_cast<double>(i % 500) * 1.5,
+                        i % 3 != 0, countries[i % 6], notes[i % 5] });
+    }
+    return res;
+}
+
+/// the generated rules give what the compiled ones give, over a slot
+/// environment and over a record binding
+void test_differential()
+{
+    auto orders = make_orders(1200);
+    mcompiler comp(codegen_rules::make_symbols());
+    std::vector<typename mcompiler::rule_type> compiled;
+    for (auto text = codegen_rules::texts; *text; ++text) {
+        compiled.emplace_back(comp.compile(parse(*text)));
+    }
+
+    codegen_rules::runtime_type rt;
+    std::size_t matches = 0;
+    std::size_t mismatches = 0;
+    for (auto& o : orders) {
+        environment_type env(comp.symbols());
+        env.store("id", std::make_unique<number>(o.id));
+        env.store("quantity", std::make_unique<number>(o.quantity));
+        env.store("amount", std::make_unique<floating>(o.amount));
+        env.store("paid", std::make_unique<boolean>(o.paid));
+        env.store("country", std::make_unique<string<char>>(o.country));
+        env.store("note", std::make_unique<string<char>>(o.note));
+        env.store("window",
+                  std::make_unique<interval<number>>(-1, o.id % 40, true));
+        for (std::size_t id = 0; id < compiled.size(); ++id) {
+            auto expected = compiled[id].match(env);
+            matches += expected ? 1 : 0;
+            if (codegen_rules::test(id, env, rt) != expected) {
+                ++mismatches;
+                std::cout << "codegen rule " << id << " order " << o.id
+                          << ": " << codegen_rules::texts[id] << "\n";
+            }
+        }
+    }
+    std::cout << "codegen " << codegen_rules::rule_count << " rules: "
+              << matches << " matches"
+              << (mismatches == 0 && matches > 0 ? "" : "  FAILED") << "\n";
+
+    auto binding = std::make_shared<record_binding<order>>(comp.symbols());
+    binding->add("id", &order::id)
+        .add("quantity", &order::quantity)
+        .add("amount", &order::amount)
+        .add("paid", &order::paid)
+        .add("country", &order::country)
+        .add("note", &order::note);
+    record_environment<order> fields(binding);
+    mcompiler::context_type ctx(fields);
+    rule_bitset found;
+    rule_bitset expected(compiled.size());
+    mismatches = 0;
+    for (auto& o : orders) {
+        fields.bind(o);
+        codegen_rules::match(fields, rt, found);
+        expected.clear();
+        for (std::size_t id = 0; id < compiled.size(); ++id) {
+            if (compiled[id].match(ctx)) {
+                expected.set(id);
+            }
+            ctx.reset();
+        }
+        mismatches += found == expected ? 0 : 1;
+    }
+    std::cout << "codegen over a record binding: " << mismatches
+              << " mismatches" << (mismatches == 0 ? "" : "  FAILED") << "\n";
+}
+
+/// the image interpreter gives what the compiled rules give for every
+/// rule of the corpus, one by one and through its index
+void test_image()
+{
+    auto orders = make_orders(1200);
+    mcompiler comp(codegen_rules::make_symbols());
+    rule_image_writer<lexem_type> writer(comp.symbols());
+    std::vector<typename mcompiler::rule_type> compiled;
+    for (auto text = codegen_rules::texts; *text; ++text) {
+        compiled.emplace_back(comp.compile(parse(*text)));
+        writer.add(parse(*text));
+    }
+    auto words = writer.serialize();
+    rule_image<char> image(words.data(), words.size() * 8);
+
+    std::size_t matches = 0;
+    std::size_t mismatches = 0;
+    std::vector<std::size_t> expected;
+    for (auto& o : orders) {
+        environment_type env(comp.symbols());
+        env.store("id", std::make_unique<number>(o.id));
+        env.store("quantity", std::make_unique<number>(o.quantity));
+        if (o.id % 2) {
+            env.store("amount", std::make_unique<floating>(o.amount));
+        } else {
+            env.store("amount", std::make_unique<number>(o.id % 500));
+        }
+        env.store("paid", std::make_unique<boolean>(o.paid));
+        env.store("country", std::make_unique<string<char>>(o.country));
+        env.store("note", std::make_unique<string<char>>(o.note));
+        env.store("window",
+                  std::make_unique<interval<number>>(-1, o.id % 40, true));
+        mcompiler::context_type ctx(env);
+        expected.clear();
+        for (std::size_t id = 0; id < compiled.size(); ++id) {
+            auto match = compiled[id].match(ctx);
+            ctx.reset();
+            if (match) {
+                expected.emplace_back(id);
+            }
+            if (image.test(id, ctx) != match) {
+                ++mismatches;
+                std::cout << "image rule " << id << " order " << o.id << ": "
+                          << codegen_rules::texts[id] << "\n";
+            }
+        }
+        matches += expected.size();
+        mismatches += image.match(env) == expected ? 0 : 1;
+    }
+    std::cout << "image " << compiled.size() << " rules: " << matches
+              << " matches"
+              << (mismatches == 0 && matches > 0 ? "" : "  FAILED") << "\n";
+}
+
+void test_source()
+{
+    rule_codegen<lexem_type> gen;
+    gen.add(parse("name = \"a\\\"b\" and size in 1..3"), "");
+    std::cout << "codegen: " << gen.expression(0) << "\n";
+    auto quoted = rule_codegen<lexem_type>::quote("a\"b\n?");
+    std::cout << "codegen quote: " << quoted
+              << (quoted == "\"a\\042b\\012\\077\"" ? "" : "  FAILED") << "\n";
+}
+
+/// rules cut short by the parser are refused, not dereferenced
+void test_incomplete()
+{
+    rule_codegen<lexem_type> gen;
+    std::size_t refused = 0;
+    for (auto text : { "a =", "a and", "-" }) {
+        try {
+            gen.add(parse(text), text);
+        } catch (const std::runtime_error&) {
+            ++refused;
+        }
+    }
+    std::cout << "codegen incomplete: " << refused << " refused"
+              << (refused == 3 && gen.size() == 0 ? "" : "  FAILED") << "\n";
+}
+
+void run()
+{
+    test_differential();
+    test_image();
+    test_source();
+    test_incomplete();
+}
+
+}
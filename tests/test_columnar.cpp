@@ -0,0 +1,203 @@
+
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "erules/columnar.h"
+#include "erules/environment.h"
+#include "erules/executor.h"
+#include "erules/objects.h"
+#include "erules/rule_lexem.h"
+#include "erules/rule_lexer.h"
+#include "erules/rule_matrix.h"
+#include "erules/rule_parser.h"
+
+using namespace erules;
+using namespace erules::objects;
+
+namespace test_columnar {
+
+using mlexer = filters::lexer<char>;
+using lexem_type = typename mlexer::lexem_type;
+using mparser = rule_parser<lexem_type>;
+using mcompiler = batch_compiler<lexem_type>;
+using batch_type = typename mcompiler::batch_type;
+using rule_batch_type = typename mcompiler::rule_type;
+using environment_type = slot_environment<char>;
+
+typename mcompiler::node_type::uptr parse(const std::string& input)
+{
+    mlexer lex;
+    mparser pars(lex.read_all(input));
+    return pars.parse();
+}
+
+struct columns {
+    std::vector<std::int64_t> id;
+    std::vector<std::int64_t> quantity;
+    /// near the ends of int64, for the overflows
+    std::vector<std::int64_t> big;
+    std::vector<double> amount;
+    std::unique_ptr<bool[]> paid;
+    std::vector<std::uint32_t> offsets;
+    std::string countries;
+};
+
+columns make_columns(std::size_t rows)
+{
+    using limits = std::numeric_limits<std::int64_t>;
+    const char* names[] = { "US", "CA", "DE", "FR", "JP", "" };
+    columns res;
+    res.paid.reset(new bool[rows]);
+    res.offsets.push_back(0);
+    for (std::size_t i = 0; i < rows; ++i) {
+        res.id.push_back(static_cast<std::int64_t>(i));
+        res.quantity.push_back(static_cast<std::int64_t>(i % 7) - 2);
+        auto near = static_cast<std::int64_t>(i % 3);
+        res.big.push_back(i % 2 ? limits::max() - near : limits::min() + near);
+        res.amount.push_back(static_cast<double>(i % 500) * 1.5);
+        res.paid[i] = (i % 3 != 0);
+        res.countries += names[i % 6];
+        res.offsets.push_back(static_cast<std::uint32_t>(res.countries.size()));
+    }
+    return res;
+}
+
+/// the rule compiled as usual, record by record
+rule_bitset expected(mcompiler& comp, const std::string& rule,
+                     const columns& cols, std::size_t rows)
+{
+    auto compiled = comp.rule_compiler().compile(parse(rule));
+    rule_bitset res(rows);
+    for (std::size_t i = 0; i < rows; ++i) {
+        environment_type env(comp.symbols());
+        env.store("id", std::make_unique<number>(cols.id[i]));
+        env.store("quantity", std::make_unique<number>(cols.quantity[i]));
+        env.store("big", std::make_unique<number>(cols.big[i]));
+        env.store("amount", std::make_unique<floating>(cols.amount[i]));
+        env.store("paid", std::make_unique<boolean>(cols.paid[i]));
+        env.store("country",
+                  std::make_unique<string<char>>(cols.countries.substr(
+                      cols.offsets[i], cols.offsets[i + 1] - cols.offsets[i])));
+        if (compiled.match(env)) {
+            res.set(i);
+        }
+    }
+    return res;
+}
+
+void test_select()
+{
+    const std::size_t rows = 1000;
+    auto cols = make_columns(rows);
+    mcompiler comp;
+    batch_type batch(comp.symbols(), rows);
+    batch.add_integers("id", cols.id.data())
+        .add_integers("quantity", cols.quantity.data())
+        .add_integers("big", cols.big.data())
+        .add_floats("amount", cols.amount.data())
+        .add_booleans("paid", cols.paid.get())
+        .add_strings("country", cols.offsets.data(), cols.countries.data());
+
+    const char* rules[] = {
+        "amount > 300",
+        "(amount * quantity) >= 1000 and paid = true",
+        "country = \"DE\" or country = \"\" or (id % 100) < 3",
+        "not (id < 500) and amount <= id",
+        "-quantity > 1 or (id / 250) = 3",
+        "(id / quantity) > 100",
+        "country in (\"US\", \"FR\") and amount in 10..20",
+        "paid and country startswith \"J\"",
+        "quantity < (amount - 740.0) or missing > 1",
+        "country < \"DE\" and paid <> false and 3 > quantity",
+        "id < 20 and (id / quantity) > 1 and -(amount * 2) < -10",
+        "id > 30 or not (country <> \"US\") or missing = 1",
+        "(big / -1) = big or (big % -1) <> 0",
+        "(big + 1) < big or (big - 1) > big",
+        "(big * 2) > 0 and -big < 0",
+        "(big / quantity) < 0 and (big % quantity) = 0",
+    };
+    for (auto rule : rules) {
+        auto found = comp.compile(parse(rule)).select(batch);
+        auto title = std::string(rule);
+        std::cout << "batch " << title << ": " << found.count() << " of "
+                  << rows
+                  << (found == expected(comp, rule, cols, rows) ? ""
+                                                                : "  FAILED")
+                  << "\n";
+    }
+
+    /// the rows outside the candidates are never set
+    auto rule = comp.compile(parse("paid = true or (id / quantity) > 100"));
+    rule_bitset candidates(rows);
+    for (std::size_t i = 0; i < rows; i += 40) {
+        candidates.set(i);
+    }
+    rule_bitset found;
+    rule.select(batch, candidates, found);
+    std::cout << "candidates: " << found.count() << " of " << candidates.count()
+              << (found == (rule.select(batch) & candidates) ? "" : "  FAILED")
+              << "\n";
+}
+
+/// every tile shape gives the same matrix; timings are in erules_bench
+void test_matrix()
+{
+    const std::size_t rows = 2000;
+    auto cols = make_columns(rows);
+    rule_matrix<lexem_type> matrix;
+    batch_type batch(matrix.symbols(), rows);
+    batch.add_integers("id", cols.id.data())
+        .add_integers("quantity", cols.quantity.data())
+        .add_floats("amount", cols.amount.data())
+        .add_booleans("paid", cols.paid.get())
+        .add_strings("country", cols.offsets.data(), cols.countries.data());
+
+    std::vector<rule_batch_type> single;
+    for (int i = 0; i < 64; ++i) {
+        auto rule = "amount > " + std::to_string(i * 7) + " and quantity < "
+            + std::to_string(i % 5) + " or (id % " + std::to_string(i + 2)
+            + ") = 0 and paid";
+        matrix.add(parse(rule));
+        single.emplace_back(matrix.rule_compiler().compile(parse(rule)));
+    }
+    match_matrix expected(rows, single.size());
+    for (std::size_t id = 0; id < single.size(); ++id) {
+        single[id].select(batch).for_each(
+            [&expected, id](std::size_t row) { expected.set(row, id); });
+    }
+
+    using tile = rule_matrix<lexem_type>::tile;
+    std::pair<const char*, tile> shapes[] = {
+        { "tiled", tile {} },
+        { "rule-major", tile { rows, 1 } },
+        { "record-major", tile { 1, single.size() } },
+    };
+    match_matrix tiled;
+    matrix.match(batch, tiled, shapes[0].second);
+    for (auto& shape : shapes) {
+        match_matrix found;
+        matrix.match(batch, found, shape.second);
+        std::cout << "matrix " << shape.first << ": " << found.count()
+                  << " matches"
+                  << (found == expected && found == tiled ? "" : "  FAILED")
+                  << "\n";
+    }
+
+    executor pool(3);
+    matrix.set_tile(tile { 300, 20 });
+    match_matrix found;
+    matrix.match(batch, found, pool);
+    std::cout << "matrix on 3 threads: " << found.count() << " matches"
+              << (found == expected ? "" : "  FAILED") << "\n";
+}
+
+void run()
+{
+    test_select();
+    test_matrix();
+}
+
+}
@@ -0,0 +1,547 @@
+
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "erules/ast_factory.h"
+#include "erules/compiler.h"
+#include "erules/environment.h"
+#include "erules/objects.h"
+#include "erules/executor.h"
+#include "erules/record.h"
+#include "erules/rule_cache.h"
+#include "erules/rule_lexem.h"
+#include "erules/rule_lexer.h"
+#include "erules/rule_parser.h"
+
+using namespace erules;
+using namespace erules::objects;
+
+namespace test_compiler {
+
+using mlexer = filters::lexer<char>;
+using lexem_type = typename mlexer::lexem_type;
+using mparser = rule_parser<lexem_type>;
+using mcompiler = compiler<lexem_type>;
+using environment_type = slot_environment<char>;
+
+mcompiler::rule_type compile(mcompiler& comp, const std::string& input)
+{
+    mlexer lex;
+    mparser pars(lex.read_all(input));
+    return comp.compile(pars.parse());
+}
+
+void check(mcompiler& comp, const std::string& input,
+           const environment_type& env, bool expected)
+{
+    auto result = compile(comp, input).match(env);
+    auto title = input.size() > 60 ? input.substr(0, 57) + "..." : input;
+    std::cout << title << " => " << std::boolalpha << result
+              << (result == expected ? "" : "  FAILED") << "\n";
+}
+
+void test_ranges()
+{
+    mcompiler comp;
+    environment_type env(comp.symbols());
+    env.store("a", std::make_unique<number>(9000));
+    env.store("b", std::make_unique<number>(1000));
+    env.store("f", std::make_unique<floating>(2.5));
+    env.store("lo", std::make_unique<number>(2));
+
+    check(comp, "a in 100..9000", env, true);
+    check(comp, "a in 100...9000", env, false);
+    check(comp, "b in 0...1000", env, false);
+    check(comp, "b in 0..1000", env, true);
+    check(comp, "f in 1..3", env, true);
+    check(comp, "f in 2.5...3", env, true);
+    check(comp, "a in 1.5..9000.5", env, true);
+    check(comp, "a in 100..9000 and b in 0...1000 and true or false", env,
+          false);
+    check(comp, "f in lo..3", env, true);
+    check(comp, "f in lo...2.5", env, false);
+    check(comp, "a in 1..10 or a in 20..30 or a in 8000..9500", env, true);
+    check(comp, "b in 1...1000 or b in 2000..3000 or b in 999.5...1000",
+          env, false);
+    check(comp, "f in (1..2, 2.5...3)", env, true);
+    check(comp, "a in (1..5, 7, 100...9000)", env, false);
+
+    interval<number> hours(9, 17, true);
+    auto copy = hours.clone();
+    std::cout << "9...17 contains 16.5: " << std::boolalpha
+              << base::cast<interval<number>>(copy.get())->contains(16.5)
+              << "\n";
+    check(comp, "b in (1, 10, 1000)", env, true);
+    check(comp, "not (b in (1, 10))", env, true);
+
+    env.store("hours", std::make_unique<interval<number>>(9, 17, true));
+    env.store("ratio", std::make_unique<interval<floating>>(0.5, 2.5));
+    check(comp, "f in hours", env, false);
+    check(comp, "lo in ratio and f in ratio", env, true);
+    check(comp, "b in (1, hours) or a in ratio", env, false);
+    env.store("f", std::make_unique<floating>(16.5));
+    check(comp, "f in hours and not (f in ratio)", env, true);
+    auto bounds = base::cast<interval<number>>(copy.get());
+    std::cout << "bounds of 9...17: " << bounds->left_copy()->value() << " "
+              << bounds->right_copy()->value()
+              << (bounds->left_copy()->value() == 9
+                          && bounds->right_copy()->value() == 17
+                      ? ""
+                      : "  FAILED")
+              << "\n";
+}
+
+void test_lists()
+{
+    mcompiler comp;
+    environment_type env(comp.symbols());
+    env.store("n", std::make_unique<number>(250));
+    env.store("f", std::make_unique<floating>(3.0));
+    env.store("s", std::make_unique<string<char>>("deny_42"));
+    env.store("other", std::make_unique<number>(7));
+
+    std::string numbers = "1";
+    std::string strings = "\"deny_0\"";
+    for (int i = 1; i < 500; ++i) {
+        numbers += ", " + std::to_string(i * 10);
+        strings += ", \"deny_" + std::to_string(i) + "\"";
+    }
+    check(comp, "n in (" + numbers + ")", env, true);
+    check(comp, "n in (" + numbers + ", 5000)", env, true);
+    check(comp, "other in (" + numbers + ")", env, false);
+    check(comp, "s in (" + strings + ")", env, true);
+    check(comp, "s in (\"a\", \"b\")", env, false);
+    check(comp, "f in (1, 2, 3)", env, true);
+    check(comp, "n in (1.5, 250.0)", env, true);
+    check(comp, "n in (true, \"x\", other, 250)", env, true);
+    check(comp, "other in (1, 2, other)", env, true);
+
+    std::vector<base::uptr> ids;
+    std::vector<base::uptr> names;
+    std::vector<base::uptr> mixed;
+    for (int i = 0; i < 100; ++i) {
+        ids.emplace_back(std::make_unique<number>(i * 5));
+        names.emplace_back(std::make_unique<string<char>>(
+            "deny_" + std::to_string(i)));
+    }
+    mixed.emplace_back(std::make_unique<number>(7));
+    mixed.emplace_back(std::make_unique<string<char>>("deny_42"));
+    env.store("ids", make_array(std::move(ids)));
+    env.store("names", make_array(std::move(names)));
+    env.store("mixed", make_array(std::move(mixed)));
+    check(comp, "n in ids", env, true);
+    check(comp, "other in ids", env, false);
+    check(comp, "s in names", env, true);
+    check(comp, "s in mixed and other in mixed", env, true);
+    check(comp, "n in mixed", env, false);
+}
+
+void test_slots()
+{
+    mcompiler comp;
+    auto rule = compile(comp, "price * count + 1");
+    auto check_rule = compile(comp, "count > limit and name = \"apple\"");
+
+    /// slots in the order of first use
+    const char* names[] = { "price", "count", "limit", "name" };
+    bool ok = comp.symbols()->size() == 4;
+    std::cout << "slots:";
+    for (std::size_t i = 0; i < comp.symbols()->size(); ++i) {
+        std::cout << " " << comp.symbols()->name(i) << "=" << i;
+        ok = ok && i < 4 && comp.symbols()->name(i) == names[i];
+    }
+    std::cout << (ok ? "" : "  FAILED") << "\n";
+
+    number price(10);
+    number count(4);
+    number limit(3);
+    string<char> name("apple");
+
+    environment_type env(comp.symbols());
+    env.set("price", &price);
+    env.set("count", &count);
+    env.set("limit", &limit);
+    env.set("name", &name);
+
+    mcompiler::context_type ctx(env);
+    auto result = rule.evaluate(ctx);
+    ok = result.kind == mcompiler::scalar_type::kind_type::INTEGER
+        && result.integer == 41;
+    std::cout << "price * count + 1 => " << result.integer
+              << (ok ? "" : "  FAILED") << "\n";
+    auto plural = compile(comp, "name + \"s\"");
+    auto word = plural.evaluate(ctx).string;
+    std::cout << "name + \"s\" => " << word
+              << (word == "apples" ? "" : "  FAILED") << "\n";
+    ctx.reset();
+    for (int i = 0; i < 1000; ++i) {
+        plural.evaluate(ctx);
+        ctx.reset();
+    }
+    /// strings longer than the small string buffer are in the arena too
+    auto repeated = compile(comp, "3 * (name + \"-\") * count");
+    auto long_word = repeated.evaluate(ctx).string;
+    ok = long_word.size() == 72 && long_word.substr(0, 12) == "apple-apple-"
+        && ctx.storage().owns(long_word.data());
+    std::cout << "3 * (name + \"-\") * count => " << long_word.size()
+              << " characters" << (ok ? "" : "  FAILED") << "\n";
+    ctx.reset();
+    for (int i = 0; i < 1000; ++i) {
+        repeated.evaluate(ctx);
+        ctx.reset();
+    }
+    /// reset() rewinds the arena, it does not grow
+    auto blocks = ctx.storage().blocks();
+    std::cout << "arena blocks after 1000 evaluations: " << blocks
+              << (blocks == 1 ? "" : "  FAILED") << "\n";
+
+    /// a context that goes away with temporaries in its arena
+    for (int i = 0; i < 3; ++i) {
+        mcompiler::context_type scratch(env);
+        auto value = plural.evaluate(scratch).string;
+        std::cout << "unreset context: " << value
+                  << (value == "apples" ? "" : "  FAILED") << "\n";
+    }
+    auto owned = plural.evaluate(env);
+    auto text = base::is<string<char>>(owned.get())
+        ? base::cast<string<char>>(owned.get())->value()
+        : std::string();
+    std::cout << "temporary context: " << text
+              << (text == "apples" ? "" : "  FAILED") << "\n";
+
+    /// an arena object deleted with no scope open leaves the memory to
+    /// its arena, a heap object deleted inside a scope goes to the heap
+    arena scratch_arena;
+    base::uptr inside;
+    {
+        arena::scope scope(scratch_arena);
+        inside = std::make_unique<number>(7);
+    }
+    ok = scratch_arena.owns(inside.get());
+    inside.reset();
+    auto outside = std::make_unique<number>(8);
+    {
+        arena::scope scope(scratch_arena);
+        ok = ok && !scratch_arena.owns(outside.get());
+        outside.reset();
+    }
+    scratch_arena.reset();
+    std::cout << "arena ownership" << (ok ? "" : "  FAILED") << "\n";
+    auto before = check_rule.match(ctx);
+    std::cout << "count > limit and name = \"apple\" => " << std::boolalpha
+              << before << (before ? "" : "  FAILED") << "\n";
+    count.set_value(2);
+    auto after = check_rule.match(ctx);
+    std::cout << "count > limit and name = \"apple\" => " << std::boolalpha
+              << after << (after ? "  FAILED" : "") << "\n";
+}
+
+/// integer arithmetic wraps around, INT64_MIN / -1 does not trap
+void test_integers()
+{
+    mcompiler comp;
+    environment_type env(comp.symbols());
+    env.store("min", std::make_unique<number>(
+                         std::numeric_limits<std::int64_t>::min()));
+    env.store("max", std::make_unique<number>(
+                         std::numeric_limits<std::int64_t>::max()));
+    env.store("m", std::make_unique<number>(-1));
+    check(comp, "(min / m) = min", env, true);
+    check(comp, "(min % m) = 0", env, true);
+    check(comp, "(min / -1) = min and (min % -1) = 0", env, true);
+    check(comp, "(max + 1) = min and (min - 1) = max", env, true);
+    check(comp, "(max * 2) = -2 and (min * m) = min", env, true);
+    check(comp, "(-min) = min", env, true);
+    check(comp, "(9223372036854775807 + 1) = min", env, true);
+    check(comp, "(min / 0) = min or (min % 0) = 0", env, false);
+
+    /// literals beyond int64 are floating values, they do not wrap
+    check(comp, "9223372036854775808 > 0 and max <= 9223372036854775808",
+          env, true);
+    check(comp, "18446744073709551617 > max", env, true);
+    check(comp, "-18446744073709551617 < min", env, true);
+    check(comp, "min = -9223372036854775808", env, true);
+    check(comp, "9223372036854775808 = 9223372036854775808.0", env, true);
+}
+
+void test_constants()
+{
+    mcompiler comp;
+    environment_type env(comp.symbols());
+    env.store("country", std::make_unique<string<char>>("DE"));
+    env.store("amount", std::make_unique<number>(250));
+
+    auto first = compile(comp, "country in (\"DE\", \"FR\") and amount > 100");
+    auto second = compile(comp, "country = \"FR\" or amount in 100..1000");
+    std::cout << "shared constants: " << comp.constants()->size() << " "
+              << std::boolalpha
+              << (first.constants() == second.constants()) << "\n";
+    std::cout << "first => " << first.match(env) << ", second => "
+              << second.match(env) << "\n";
+
+    env.store("path", std::make_unique<string<char>>("/api/v2/users"));
+    check(comp, "path startswith \"/api/\"", env, true);
+    check(comp, "path startswith \"/api/v1\"", env, false);
+    check(comp, "path startswith country", env, false);
+    check(comp, "\"/api/v2/users/1\" startswith path", env, true);
+    check(comp, "amount startswith \"2\"", env, false);
+}
+
+void test_adaptive()
+{
+    mcompiler comp;
+    environment_type env(comp.symbols());
+    number a(5);
+    number b(0);
+    env.set("a", &a);
+    env.set("b", &b);
+
+    auto rule = compile(comp, "a > 0 and a < 100 and b = 1");
+    mcompiler::context_type ctx(env);
+    for (int i = 0; i < 20000; ++i) {
+        b.set_value(i % 50 == 0 ? 1 : 0);
+        rule.match(ctx);
+    }
+    auto order = rule.chains().front()->order();
+    std::cout << "adaptive order:";
+    for (auto pos : order) {
+        std::cout << " " << pos;
+    }
+    std::cout << (order.front() == 2 ? "" : "  FAILED") << "\n";
+
+    std::stringstream stats;
+    rule.save_statistics(stats);
+    auto restored = compile(comp, "a > 0 and a < 100 and b = 1");
+    restored.load_statistics(stats);
+    std::cout << "restored order first: "
+              << restored.chains().front()->order().front() << "\n";
+
+    /// a root that is not logical compiles its chains once
+    auto value = compile(comp, "a * (a > 0 and a < 100 and b = 1)");
+    std::cout << "value rule chains: " << value.chains().size()
+              << (value.chains().size() == 1 ? "" : "  FAILED") << "\n";
+}
+
+struct order {
+    std::int64_t id;
+    double amount;
+    bool paid;
+    std::string country;
+    int quantity;
+};
+
+void test_records()
+{
+    mcompiler comp;
+    auto binding = std::make_shared<record_binding<order>>(comp.symbols());
+    binding->add("id", &order::id)
+        .add("amount", &order::amount)
+        .add("paid", &order::paid)
+        .add("country", &order::country)
+        .add("quantity", &order::quantity)
+        .add("rank", record_binding<order>::kind_type::INTEGER,
+             [](const order& o) {
+                 return record_binding<order>::scalar_type::make_integer(
+                     o.id * 2);
+             });
+
+    auto rule = compile(comp,
+                        "country in (\"US\", \"CA\") and amount > 100 "
+                        "and paid = true and id in 1..1000 and rank <= 2000");
+    auto total = compile(comp, "amount * quantity");
+
+    std::vector<order> orders = {
+        { 1, 150.0, true, "US", 2 },
+        { 2, 50.0, true, "US", 1 },
+        { 3, 500.5, true, "DE", 3 },
+        { 4000, 900.0, true, "CA", 1 },
+        { 5, 101.0, false, "CA", 4 },
+        { 6, 250.0, true, "CA", 5 },
+    };
+
+    struct expectation {
+        bool match;
+        double total;
+    };
+    expectation expected[] = {
+        { true, 300.0 },  { false, 50.0 },  { false, 1501.5 },
+        { false, 900.0 }, { false, 404.0 }, { true, 1250.0 },
+    };
+
+    record_environment<order> env(binding);
+    mcompiler::context_type ctx(env);
+    auto country = comp.symbols()->find("country");
+    for (std::size_t i = 0; i < orders.size(); ++i) {
+        auto& o = orders[i];
+        env.bind(o);
+        auto matched = rule.match(ctx);
+        auto value = total.evaluate(ctx).floating;
+        /// the context boxes the field of the bound record
+        auto boxed = ctx.get(country);
+        auto ok = matched == expected[i].match && value == expected[i].total
+            && base::is<string<char>>(boxed)
+            && base::cast<string<char>>(boxed)->value() == o.country;
+        ctx.reset();
+        std::cout << "order " << o.id << ": " << std::boolalpha << matched
+                  << " total: " << value << (ok ? "" : "  FAILED") << "\n";
+    }
+
+    /// unsigned 64 bit values beyond INT64_MAX stay positive
+    struct counter {
+        std::uint64_t hits;
+        unsigned long long bytes;
+    };
+    mcompiler counters;
+    auto counter_binding
+        = std::make_shared<record_binding<counter>>(counters.symbols());
+    counter_binding->add("hits", &counter::hits)
+        .add("bytes", &counter::bytes);
+    auto positive = compile(counters, "hits > 0 and bytes > 0");
+    auto exact = compile(counters, "hits = 9223372036854775807");
+    record_environment<counter> counter_env(counter_binding);
+    counter c1 { 18446744073709551615ull, 9223372036854775808ull };
+    counter c2 { 9223372036854775807ull, 1 };
+    counter_env.bind(c1);
+    bool ok = positive.match(counter_env) && !exact.match(counter_env);
+    counter_env.bind(c2);
+    ok = ok && positive.match(counter_env) && exact.match(counter_env);
+    std::cout << "unsigned 64 bit fields" << (ok ? "" : "  FAILED") << "\n";
+}
+
+/// equal rules are one object, equal subtrees are stored once and the
+/// expanded trees compile as the parsed ones
+void test_interning()
+{
+    mcompiler comp;
+    ast_factory<lexem_type> factory;
+    environment_type env(comp.symbols());
+    env.store("country", std::make_unique<string<char>>("US"));
+    env.store("amount", std::make_unique<number>(1500));
+
+    const char* inputs[] = {
+        "country = \"US\" and amount > 1000",
+        "country = \"US\"  and  amount > 1000",
+        "country = \"US\" and amount > 2000",
+        "not (country = \"US\") or amount > 1000",
+    };
+    std::vector<ast_factory<lexem_type>::handle> rules;
+    bool ok = true;
+    for (auto input : inputs) {
+        mlexer lex;
+        mparser pars(lex.read_all(input));
+        rules.emplace_back(pars.parse(factory));
+        auto expanded = factory.expand(rules.back());
+        ok = ok && compile(comp, input).match(env)
+            == comp.compile(expanded).match(env);
+    }
+    ok = ok && rules[0] == rules[1] && rules[0] != rules[2]
+        && rules[0]->left() == rules[2]->left()
+        && rules[3]->right() == rules[0]->right();
+    auto distinct = factory.size();
+    rules.clear();
+    std::cout << "interning: " << factory.requests() << " nodes, "
+              << distinct << " distinct"
+              << (ok && distinct == 12 && factory.size() == 0 ? ""
+                                                              : "  FAILED")
+              << "\n";
+}
+
+/// spacing variants hit the same rule, quoted text does not change,
+/// the least recently used rule is evicted
+void test_cache()
+{
+    rule_cache<char> cache(2);
+    environment_type env(cache.symbols());
+    env.store("name", std::make_unique<string<char>>("a  b"));
+    env.store("amount", std::make_unique<number>(10));
+
+    auto first = cache.get("name = \"a  b\" and amount>5");
+    bool ok = first->match(env)
+        && cache.get("  name=\"a  b\"  and amount >  5 ") == first
+        && !cache.get("name = \"a b\" and amount > 5")->match(env)
+        && cache.get("amount < 5 or name startswith \"a\"", true)->match(env);
+    auto evicted = cache.stats().evictions;
+    ok = ok && cache.get("name = \"a  b\" and amount > 5") != first
+        && evicted == 1;
+
+    executor pool(4);
+    std::vector<const rule_cache<char>::rule_type*> found(64);
+    pool.parallel_for(found.size(), [&](std::size_t i, std::size_t) {
+        found[i] = cache.get(i % 2 ? "amount > 5" : "amount  >  5").get();
+    });
+    for (auto rule : found) {
+        ok = ok && rule == found.front();
+    }
+
+    /// the literals of evicted rules go with them
+    std::weak_ptr<const rule_cache<char>::rule_type::constant_pool_type>
+        oldest = cache.get("amount > 0 and name = \"n0\"")->constants();
+    std::size_t largest = 0;
+    for (int i = 1; i < 1000; ++i) {
+        auto n = std::to_string(i);
+        auto rule = cache.get("amount > " + n + " and name = \"n" + n + "\"");
+        largest = std::max(largest, rule->constants()->size());
+    }
+    ok = ok && oldest.expired() && largest == 2
+        && cache.symbols()->size() == 2;
+
+    /// environments are built on the table while rules with new
+    /// identifiers are compiled into it
+    pool.parallel_for(200, [&](std::size_t i, std::size_t) {
+        auto n = std::to_string(i / 2);
+        if (i % 2) {
+            cache.get("field" + n + " > 1");
+        } else {
+            environment_type local(cache.symbols());
+            local.store("field" + n, std::make_unique<number>(2));
+            local.store("amount", std::make_unique<number>(1));
+        }
+    });
+    auto symbols = cache.symbols();
+    ok = ok && symbols->size() == 102;
+    for (std::size_t i = 0; ok && i < symbols->size(); ++i) {
+        ok = symbols->find(symbols->name(i)) == i;
+    }
+
+    auto stats = cache.stats();
+    std::cout << "cache: " << stats.hits << " hits, " << stats.misses
+              << " misses, " << stats.evictions << " evictions, "
+              << stats.size << " rules" << (ok ? "" : "  FAILED") << "\n";
+}
+
+/// rules with trailing lexems are refused and never cached
+void test_cache_trailing()
+{
+    rule_cache<char> cache(2);
+    std::size_t refused = 0;
+    for (auto text : { "a = 1 b", "(a = 1" }) {
+        try {
+            cache.get(text);
+        } catch (const std::runtime_error&) {
+            ++refused;
+        }
+    }
+    auto size = cache.stats().size;
+    std::cout << "cache trailing: " << refused << " refused, " << size
+              << " rules" << (refused == 2 && size == 0 ? "" : "  FAILED")
+              << "\n";
+}
+
+void run()
+{
+    test_ranges();
+    test_lists();
+    test_slots();
+    test_integers();
+    test_constants();
+    test_adaptive();
+    test_records();
+    test_interning();
+    test_cache();
+    test_cache_trailing();
+}
+}
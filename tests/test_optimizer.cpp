@@ -0,0 +1,74 @@
+
+#include <iostream>
+#include <vector>
+
+#include "erules/objects.h"
+#include "erules/optimizer.h"
+#include "erules/rule_lexem.h"
+#include "erules/rule_lexer.h"
+#include "erules/rule_parser.h"
+
+using namespace erules;
+using namespace erules::objects;
+
+namespace test_optimizer {
+
+using mlexer = filters::lexer<char>;
+using lexem_type = typename mlexer::lexem_type;
+using mparser = rule_parser<lexem_type>;
+using node_type = ast::node<lexem_type>;
+
+std::string to_string(const node_type* node)
+{
+    if (!node) {
+        return "<null>";
+    }
+    if (base::is<ast::binary_operation<lexem_type>>(node)) {
+        auto bin = base::cast<ast::binary_operation<lexem_type>>(node);
+        return '(' + to_string(bin->left().get()) + ' '
+            + bin->lexem().raw_value() + ' ' + to_string(bin->right().get())
+            + ')';
+    } else if (base::is<ast::prefix_operation<lexem_type>>(node)) {
+        auto pref = base::cast<ast::prefix_operation<lexem_type>>(node);
+        return '(' + pref->lexem().raw_value() + ' '
+            + to_string(pref->value().get()) + ')';
+    }
+    return node->lexem().raw_value();
+}
+
+void check(const std::string& input, const std::string& expected)
+{
+    mlexer lex;
+    mparser pars(lex.read_all(input));
+    auto tree = pars.parse();
+    optimizer<lexem_type> opt;
+    auto result = to_string(opt.optimize(tree).get());
+    std::cout << input << " => " << result
+              << (result == expected ? "" : "  FAILED, expected: " + expected)
+              << "\n";
+}
+
+void run()
+{
+    check("1024 * 1024", "1048576");
+    check("\"a\" + \"b\"", "\"ab\"");
+    check("\"ab\" * 3", "\"ababab\"");
+    check("1.5 * 2", "3.0");
+    check("not false", "true");
+    check("not not (x = 1)", "(x = 1)");
+    check("-5 - 3", "-8");
+    check("(x > 1) and true", "(x > 1)");
+    check("true and not x", "(not x)");
+    check("x and false", "false");
+    check("x or true", "true");
+    check("false or (x startswith \"a\")", "(x startswith \"a\")");
+    /// the neutral constant stays when the other side may be no boolean
+    check("not not x", "(not (not x))");
+    check("x and true", "(x and true)");
+    check("false or (x + 1)", "(false or (x + 1))");
+    check("a = 1 and (b = 2 or 1 = 1)", "(a = 1)");
+    check("x in (1 + 1)..(10 * 10)", "(x in (2 .. 100))");
+    check("10 / 0", "(10 / 0)");
+    check("x + 1 * 2", "(x + 2)");
+}
+}
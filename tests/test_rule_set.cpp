@@ -0,0 +1,642 @@
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "erules/bitset.h"
+#include "erules/environment.h"
+#include "erules/executor.h"
+#include "erules/objects.h"
+#include "erules/rule_image.h"
+#include "erules/rule_lexem.h"
+#include "erules/rule_lexer.h"
+#include "erules/rule_loader.h"
+#include "erules/rule_parser.h"
+#include "erules/rule_set.h"
+
+using namespace erules;
+using namespace erules::objects;
+
+namespace test_rule_set {
+
+using mlexer = filters::lexer<char>;
+using lexem_type = typename mlexer::lexem_type;
+using mparser = rule_parser<lexem_type>;
+using mrule_set = rule_set<lexem_type>;
+using environment_type = slot_environment<char>;
+
+typename mrule_set::node_type::uptr parse(const std::string& input)
+{
+    mlexer lex;
+    mparser pars(lex.read_all(input));
+    return pars.parse();
+}
+
+/// every rule of the set, one by one
+std::vector<std::size_t> brute_force(mrule_set& set,
+                                     const std::vector<std::string>& rules,
+                                     const environment_type& env)
+{
+    std::vector<std::size_t> res;
+    for (std::size_t i = 0; i < rules.size(); ++i) {
+        if (set.rule_compiler().compile(parse(rules[i])).match(env)) {
+            res.emplace_back(i);
+        }
+    }
+    return res;
+}
+
+void check(mrule_set& set, const std::vector<std::string>& rules,
+           const environment_type& env, const std::string& title)
+{
+    auto found = set.match(env);
+    auto expected = brute_force(set, rules, env);
+    std::cout << title << ": " << found.size() << " of " << set.size()
+              << " rules match" << (found == expected ? "" : "  FAILED")
+              << "\n";
+}
+
+void test_equality()
+{
+    mrule_set set;
+    std::vector<std::string> rules;
+    const char* countries[] = { "US", "CA", "DE", "FR", "JP" };
+    for (int i = 0; i < 2000; ++i) {
+        rules.emplace_back("country = \"" + std::string(countries[i % 5])
+                           + "\" and type = " + std::to_string(i % 7)
+                           + " and amount > " + std::to_string(i));
+    }
+    rules.emplace_back("amount > 100 or paid");
+    rules.emplace_back("paid = true and 3 = type");
+    rules.emplace_back("amount = 250.0");
+    rules.emplace_back("big = 9007199254740993");
+    rules.emplace_back("big = 9007199254740993 and type = 3");
+    rules.emplace_back("big = 9007199254740992");
+    for (auto& rule : rules) {
+        set.add(parse(rule));
+    }
+    set.build();
+
+    environment_type env(set.symbols());
+    env.store("country", std::make_unique<string<char>>("DE"));
+    env.store("type", std::make_unique<number>(3));
+    env.store("amount", std::make_unique<number>(250));
+    env.store("paid", std::make_unique<boolean>(true));
+    check(set, rules, env, "DE, type 3, amount 250");
+
+    env.store("country", std::make_unique<string<char>>("JP"));
+    env.store("amount", std::make_unique<floating>(1999.5));
+    check(set, rules, env, "JP, type 3, amount 1999.5");
+
+    /// beyond 2^53 a floating value equals every integer literal that
+    /// rounds to it, as in the compiled comparison
+    env.store("big", std::make_unique<floating>(9007199254740992.0));
+    check(set, rules, env, "big 2^53 as floating");
+    env.store("big", std::make_unique<number>(9007199254740993));
+    check(set, rules, env, "big 2^53 + 1");
+}
+
+void test_ranges()
+{
+    mrule_set set;
+    std::vector<std::string> rules;
+    for (int i = 0; i < 3000; ++i) {
+        auto low = std::to_string(i * 10);
+        auto high = std::to_string(i * 10 + 25);
+        switch (i % 4) {
+        case 0:
+            rules.emplace_back("amount in " + low + ".." + high);
+            break;
+        case 1:
+            rules.emplace_back("amount >= " + low + " and amount < " + high);
+            break;
+        case 2:
+            rules.emplace_back(high + " > amount and amount in " + low
+                               + "...1e9 and kind = \"b\"");
+            break;
+        default:
+            rules.emplace_back("amount > " + low + ".5");
+            break;
+        }
+    }
+    rules.emplace_back("big > 9007199254740000");
+    rules.emplace_back("big < 1e300");
+    for (auto& rule : rules) {
+        set.add(parse(rule));
+    }
+    set.build();
+
+    environment_type env(set.symbols());
+    env.store("kind", std::make_unique<string<char>>("b"));
+    env.store("big", std::make_unique<number>(9223372036854775000));
+    for (auto amount : { 0.0, 25.0, 12345.0, 12345.5, 29990.5 }) {
+        env.store("amount", std::make_unique<floating>(amount));
+        check(set, rules, env, "amount " + std::to_string(amount));
+    }
+    env.store("amount", std::make_unique<number>(20000));
+    check(set, rules, env, "amount 20000");
+}
+
+void test_prefixes()
+{
+    mrule_set set;
+    std::vector<std::string> rules;
+    const char* roots[] = { "/api", "/static", "/admin", "/api/v1", "" };
+    for (int i = 0; i < 2000; ++i) {
+        auto path
+            = std::string(roots[i % 5]) + "/" + std::to_string(i / 5 % 40);
+        rules.emplace_back("path startswith \"" + path + "\" and method = \""
+                           + (i % 3 ? "GET" : "POST") + "\"");
+    }
+    rules.emplace_back("path startswith \"\"");
+    rules.emplace_back("path startswith \"/api/\" or path = \"/\"");
+    rules.emplace_back("path startswith \"/api/1\" and path startswith \"/a\"");
+    for (auto& rule : rules) {
+        set.add(parse(rule));
+    }
+    set.build();
+
+    environment_type env(set.symbols());
+    env.store("method", std::make_unique<string<char>>("GET"));
+    for (auto path : { "/api/12/items", "/api/v1/3", "/admin", "/x", "" }) {
+        env.store("path", std::make_unique<string<char>>(path));
+        check(set, rules, env, std::string("path '") + path + "'");
+    }
+    env.store("path", std::make_unique<number>(12));
+    check(set, rules, env, "path 12");
+}
+
+/// combined bitsets agree with the same set operations on id lists
+void test_bitsets()
+{
+    mrule_set set;
+    std::vector<std::string> rules;
+    for (int i = 0; i < 1000; ++i) {
+        rules.emplace_back("amount > " + std::to_string(i * 3)
+                           + " and kind = " + std::to_string(i % 4));
+    }
+    for (auto& rule : rules) {
+        set.add(parse(rule));
+    }
+    set.build();
+
+    environment_type env(set.symbols());
+    env.store("amount", std::make_unique<number>(1500));
+    env.store("kind", std::make_unique<number>(1));
+    rule_bitset first;
+    set.match(env, first);
+    auto first_ids = set.match(env);
+    env.store("amount", std::make_unique<number>(2400));
+    rule_bitset second;
+    set.match(env, second);
+    auto second_ids = set.match(env);
+
+    std::vector<std::size_t> expected;
+    std::set_intersection(first_ids.begin(), first_ids.end(),
+                          second_ids.begin(), second_ids.end(),
+                          std::back_inserter(expected));
+    std::vector<std::size_t> found;
+    (first & second).append_to(found);
+    auto ok = (found == expected);
+
+    expected.clear();
+    found.clear();
+    std::set_difference(second_ids.begin(), second_ids.end(),
+                        first_ids.begin(), first_ids.end(),
+                        std::back_inserter(expected));
+    auto diff = second;
+    diff.and_not(first);
+    diff.append_to(found);
+    ok = ok && (found == expected) && ((first | second) == second);
+
+    std::cout << "bitsets: " << first.count() << " and " << second.count()
+              << " of " << first.size() << " rules, "
+              << diff.count() << " only in the second"
+              << (ok ? "" : "  FAILED") << "\n";
+}
+
+/// many records over a pool, against one record at a time; timings are
+/// in erules_bench
+void test_parallel()
+{
+    mrule_set set;
+    for (int i = 0; i < 300; ++i) {
+        set.add(parse("type = " + std::to_string(i % 7) + " and amount > "
+                      + std::to_string(i) + " or name = \"n"
+                      + std::to_string(i % 50) + "\""));
+    }
+    set.build();
+
+    std::vector<std::unique_ptr<environment_type>> envs;
+    std::vector<const mrule_set::environment_type*> records;
+    for (int i = 0; i < 600; ++i) {
+        envs.emplace_back(std::make_unique<environment_type>(set.symbols()));
+        envs.back()->store("type", std::make_unique<number>(i % 9));
+        envs.back()->store("amount", std::make_unique<number>(i % 1100));
+        envs.back()->store("name", std::make_unique<string<char>>(
+                                       "n" + std::to_string(i % 70)));
+        records.emplace_back(envs.back().get());
+    }
+    std::vector<std::vector<std::size_t>> expected;
+    for (auto record : records) {
+        expected.emplace_back(set.match(*record));
+    }
+    for (std::size_t threads : { 1, 4 }) {
+        executor pool(threads);
+        std::vector<std::vector<std::size_t>> found;
+        set.match(pool, records, found);
+        std::cout << "parallel, " << threads << " threads: " << records.size()
+                  << " records" << (found == expected ? "" : "  FAILED")
+                  << "\n";
+    }
+}
+
+/// few records against many rules: the rules of each record are
+/// shared out over the threads
+void test_sharded()
+{
+    mrule_set set;
+    for (int i = 0; i < 2400; ++i) {
+        auto n = std::to_string(i);
+        if (i % 3) {
+            set.add(parse("type = " + std::to_string(i % 7)
+                          + " and (amount % " + std::to_string(i % 13 + 2)
+                          + ") = 0"));
+        } else {
+            set.add(parse("amount > " + n + " or name = \"n"
+                          + std::to_string(i % 50) + "\""));
+        }
+    }
+    set.build();
+
+    std::vector<std::unique_ptr<environment_type>> envs;
+    std::vector<const mrule_set::environment_type*> records;
+    std::vector<std::vector<std::size_t>> expected;
+    for (int i = 0; i < 3; ++i) {
+        envs.emplace_back(std::make_unique<environment_type>(set.symbols()));
+        envs.back()->store("type", std::make_unique<number>(i + 2));
+        envs.back()->store("amount", std::make_unique<number>(i * 420));
+        envs.back()->store("name", std::make_unique<string<char>>(
+                                       "n" + std::to_string(i * 7)));
+        records.emplace_back(envs.back().get());
+        expected.emplace_back(set.match(*records.back()));
+    }
+    executor pool(4);
+    std::vector<std::vector<std::size_t>> found;
+    set.match(pool, records, found);
+    bool ok = found == expected;
+    mrule_set::shard_state shard;
+    rule_bitset bits;
+    std::size_t matches = 0;
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        set.match(pool, *records[i], shard, bits, 16);
+        std::vector<std::size_t> ids;
+        bits.append_to(ids);
+        matches += ids.size();
+        ok = ok && ids == expected[i];
+    }
+    std::cout << "sharded, 4 threads: " << set.size() << " rules, "
+              << matches << " matches"
+              << (ok && matches > 0 ? "" : "  FAILED") << "\n";
+}
+
+/// repeated residual predicates are shared; one context over many
+/// records must not see the results of the previous record
+void test_sharing()
+{
+    mrule_set set;
+    std::vector<std::string> rules;
+    for (int i = 0; i < 60; ++i) {
+        rules.emplace_back("(amount % 7) = " + std::to_string(i % 3)
+                           + " and (name <> \"n1\" or (amount % 5) > "
+                           + std::to_string(i % 4) + ")");
+        set.add(parse(rules.back()));
+    }
+    set.build();
+    auto& sharing = set.sharing();
+
+    bool ok = sharing.distinct() < sharing.occurrences()
+        && sharing.shared() > 0;
+    environment_type env(set.symbols());
+    mrule_set::context_type ctx(env);
+    mrule_set::match_state state;
+    for (int i = 0; i < 40; ++i) {
+        env.store("amount", std::make_unique<number>(i * 3));
+        env.store("name", std::make_unique<string<char>>(
+                              "n" + std::to_string(i % 3)));
+        std::vector<std::size_t> found;
+        set.match(ctx, state, found);
+        ok = ok && found == brute_force(set, rules, env);
+    }
+    std::cout << "sharing: " << sharing.occurrences() << " predicates, "
+              << sharing.distinct() << " distinct, ratio "
+              << sharing.ratio() << (ok ? "" : "  FAILED") << "\n";
+}
+
+/// a mapped image matches like the rule set it was written from;
+/// a damaged image is refused
+void test_image()
+{
+    mrule_set set;
+    rule_image_writer<lexem_type> writer(set.symbols());
+    std::vector<std::string> rules;
+    const char* countries[] = { "US", "CA", "DE" };
+    for (int i = 0; i < 300; ++i) {
+        auto n = std::to_string(i);
+        switch (i % 6) {
+        case 0:
+            rules.emplace_back("country = \"" + std::string(countries[i % 3])
+                               + "\" and type = " + std::to_string(i % 7)
+                               + " and amount > " + n);
+            break;
+        case 1:
+            rules.emplace_back("amount in " + n + "..." + std::to_string(i + 40)
+                               + " or name startswith \"n" + n + "\"");
+            break;
+        case 2:
+            rules.emplace_back("type in (1, 3, " + std::to_string(i % 9)
+                               + ".0, 20..30) and not paid");
+            break;
+        case 3:
+            rules.emplace_back("(amount * 2 - type) >= " + n
+                               + " and name <> \"n1\" or missing = 1");
+            break;
+        case 4:
+            rules.emplace_back("amount = " + std::to_string(i % 50)
+                               + ".0 and paid = true and amount in type..100");
+            break;
+        default:
+            rules.emplace_back("-amount < " + n + " and country in (\"US\", "
+                               "name) and (amount % 7) <> " + n);
+            break;
+        }
+    }
+    rules.emplace_back("amount in (window, 999) and type in window");
+    for (auto& rule : rules) {
+        set.add(parse(rule));
+        writer.add(parse(rule));
+    }
+    set.build();
+
+    auto path = std::string("erules_test_image.bin");
+    {
+        std::ofstream out(path, std::ios::binary);
+        writer.save(out);
+    }
+    mapped_file file(path);
+    rule_image<char> image(file.data(), file.size());
+    bool ok = image.size() == rules.size();
+    auto symbols = image.make_symbols();
+    for (std::size_t i = 0; i < image.symbol_count(); ++i) {
+        ok = ok && set.symbols()->find(symbols->name(i)) == i;
+    }
+
+    environment_type env(set.symbols());
+    env.store("window", std::make_unique<interval<floating>>(2.0, 90.5));
+    std::size_t matches = 0;
+    for (int i = 0; i < 200; ++i) {
+        env.store("country", std::make_unique<string<char>>(countries[i % 3]));
+        env.store("type", std::make_unique<number>(i % 11));
+        if (i % 4) {
+            env.store("amount", std::make_unique<number>(i * 3 % 320));
+        } else {
+            env.store("amount", std::make_unique<floating>(i % 50));
+        }
+        env.store("name", std::make_unique<string<char>>(
+                              "n" + std::to_string(i % 60)));
+        env.store("paid", std::make_unique<boolean>(i % 3 == 0));
+        auto found = image.match(env);
+        matches += found.size();
+        ok = ok && found == set.match(env);
+    }
+
+    /// the first node cannot have operands before it
+    auto words = writer.serialize();
+    auto base = reinterpret_cast<char*>(words.data());
+    auto head = reinterpret_cast<const image_format::header*>(base);
+    reinterpret_cast<image_format::node*>(base + head->nodes.offset)->kind
+        = image_format::node_kind::BINARY;
+    bool refused = false;
+    try {
+        rule_image<char> damaged(words.data(), words.size() * 8);
+    } catch (const std::runtime_error&) {
+        refused = true;
+    }
+    std::cout << "image: " << image.size() << " rules in " << file.size()
+              << " bytes, " << matches << " matches"
+              << (ok && refused ? "" : "  FAILED") << "\n";
+    std::remove(path.c_str());
+}
+
+/// the image indexes the literals rule_set indexes: beyond 2^53 an
+/// equality stays with the residual and matches as compiled
+void test_image_big_keys()
+{
+    mrule_set set;
+    rule_image_writer<lexem_type> writer(set.symbols());
+    std::vector<std::string> rules = {
+        "big = 9007199254740993",
+        "big = 9007199254740993 and type = 3",
+        "big = 9007199254740992",
+        "9007199254740992.0 = big",
+        "big = -9007199254740993",
+        "big = 9007199254740991",
+    };
+    for (auto& rule : rules) {
+        set.add(parse(rule));
+        writer.add(parse(rule));
+    }
+    set.build();
+    auto words = writer.serialize();
+    rule_image<char> image(words.data(), words.size() * 8);
+
+    environment_type env(set.symbols());
+    env.store("type", std::make_unique<number>(3));
+    bool ok = true;
+    std::size_t matches = 0;
+    auto differ = [&](const std::string& title) {
+        auto found = image.match(env);
+        auto expected = brute_force(set, rules, env);
+        matches += found.size();
+        if (found != expected || set.match(env) != expected) {
+            std::cout << "  image differs for " << title << "\n";
+            ok = false;
+        }
+    };
+    env.store("big", std::make_unique<floating>(9007199254740992.0));
+    differ("2^53 as floating");
+    env.store("big", std::make_unique<number>(9007199254740992));
+    differ("2^53");
+    env.store("big", std::make_unique<number>(9007199254740993));
+    differ("2^53 + 1");
+    env.store("big", std::make_unique<floating>(-9007199254740992.0));
+    differ("-2^53 as floating");
+    env.store("big", std::make_unique<number>(9007199254740991));
+    differ("2^53 - 1");
+    std::cout << "image at 2^53: " << matches << " matches"
+              << (ok && matches > 0 ? "" : "  FAILED") << "\n";
+}
+
+/// a rule whose residual does not compile leaves the indexes as they
+/// were: the next rule takes its id and nothing matches for the failed one
+void test_failed_add()
+{
+    using binary_node = ast::binary_operation<lexem_type>;
+    using postfix_node = ast::postfix_operation<lexem_type>;
+    mrule_set set;
+    auto bad = parse("country = \"US\" and amount > 5 and name startswith "
+                     "\"a\" and x");
+    auto root = const_cast<binary_node*>(
+        base::cast<binary_node>(bad.get()));
+    auto lexem = root->right()->lexem();
+    root->right(std::make_unique<postfix_node>(lexem, parse("x")));
+    bool refused = false;
+    try {
+        set.add(bad);
+    } catch (const std::exception&) {
+        refused = true;
+    }
+    std::vector<std::string> rules { "paid = true" };
+    auto id = set.add(parse(rules.back()));
+    set.build();
+
+    environment_type env(set.symbols());
+    env.store("country", std::make_unique<string<char>>("US"));
+    env.store("amount", std::make_unique<number>(10));
+    env.store("name", std::make_unique<string<char>>("abc"));
+    env.store("paid", std::make_unique<boolean>(false));
+    auto found = set.match(env);
+    bool ok = refused && id == 0 && set.size() == 1 && found.empty()
+        && found == brute_force(set, rules, env);
+    env.store("paid", std::make_unique<boolean>(true));
+    found = set.match(env);
+    ok = ok && found == std::vector<std::size_t> { 0 };
+    std::cout << "failed add: " << (refused ? "refused" : "accepted")
+              << ", next id " << id << (ok ? "" : "  FAILED") << "\n";
+}
+
+/// rules added after build() join the indexed ones on the next build();
+/// the ranges of the first build still match
+void test_rebuild()
+{
+    mrule_set set;
+    std::vector<std::string> rules { "x in 1..10", "x >= 3 and x < 7",
+                                     "y = 2" };
+    for (auto& rule : rules) {
+        set.add(parse(rule));
+    }
+    set.build();
+    rules.emplace_back("x > 100");
+    rules.emplace_back("x in 4...6 and y = 2");
+    set.add(parse(rules[3]));
+    set.add(parse(rules[4]));
+    set.build();
+
+    environment_type env(set.symbols());
+    env.store("y", std::make_unique<number>(2));
+    bool ok = true;
+    for (auto x : { 5, 200 }) {
+        env.store("x", std::make_unique<number>(x));
+        auto found = set.match(env);
+        ok = ok && found == brute_force(set, rules, env);
+    }
+    env.store("x", std::make_unique<number>(5));
+    ok = ok && set.match(env) == std::vector<std::size_t> { 0, 1, 2, 4 };
+    std::cout << "rebuild: " << set.size() << " rules"
+              << (ok ? "" : "  FAILED") << "\n";
+}
+
+/// a file of rules separated by ';' loads as the rules one by one; the
+/// broken ones are reported and skipped
+void test_loader()
+{
+    using loader_type = rule_loader<lexem_type>;
+    std::vector<std::string> rules;
+    std::string text;
+    std::vector<std::size_t> broken;
+    const char* bad[] = {
+        "amount >",
+        "amount @ 3",
+        "(type = 1 or amount = 2",
+        "type = 1)",
+        "type = = 1",
+    };
+    for (int i = 0; i < 3000; ++i) {
+        if (i % 500 == 7) {
+            broken.emplace_back(i);
+            text += bad[broken.size() % 5];
+            text += ";\n";
+            continue;
+        }
+        auto n = std::to_string(i);
+        rules.emplace_back("type = " + std::to_string(i % 7)
+                           + " and (amount > " + n + " or name = \"n;"
+                           + std::to_string(i % 40) + "\")");
+        text += rules.back() + (i % 3 ? ";\n" : "  ;  ");
+    }
+    text += "\n;;\n";
+
+    mrule_set expected;
+    for (auto& rule : rules) {
+        expected.add(parse(rule));
+    }
+    expected.build();
+
+    auto path = std::string("erules_test_rules.txt");
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << text;
+    }
+    executor pool(4);
+    mrule_set set;
+    auto report = loader_type(256).load_file(path, set, pool);
+    std::remove(path.c_str());
+
+    bool ok = set.size() == rules.size()
+        && report.ids.size() == rules.size() + broken.size()
+        && report.errors.size() == broken.size();
+    for (std::size_t i = 0; ok && i < broken.size(); ++i) {
+        auto& error = report.errors[i];
+        ok = error.rule == broken[i] && !error.message.empty()
+            && report.ids[broken[i]] == loader_type::npos;
+    }
+    environment_type env(set.symbols());
+    std::size_t matches = 0;
+    for (int i = 0; ok && i < 100; ++i) {
+        env.store("type", std::make_unique<number>(i % 9));
+        env.store("amount", std::make_unique<number>(i * 37));
+        env.store("name", std::make_unique<string<char>>(
+                              "n;" + std::to_string(i % 50)));
+        auto found = set.match(env);
+        matches += found.size();
+        ok = found == expected.match(env);
+    }
+    std::cout << "loader: " << report.loaded() << " rules, "
+              << report.errors.size() << " errors, " << matches
+              << " matches" << (ok ? "" : "  FAILED") << "\n";
+    for (auto& error : report.errors) {
+        std::cout << "  rule " << error.rule << " at " << error.line << ":"
+                  << error.column << ": " << error.message << "\n";
+    }
+}
+
+void run()
+{
+    test_equality();
+    test_ranges();
+    test_prefixes();
+    test_bitsets();
+    test_parallel();
+    test_sharded();
+    test_sharing();
+    test_image();
+    test_image_big_keys();
+    test_failed_add();
+    test_rebuild();
+    test_loader();
+}
+
+}
@@ -0,0 +1,201 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "erules/columnar.h"
+#include "erules/environment.h"
+#include "erules/executor.h"
+#include "erules/objects.h"
+#include "erules/rule_lexer.h"
+#include "erules/rule_matrix.h"
+#include "erules/rule_parser.h"
+#include "erules/rule_set.h"
+
+namespace {
+
+using lexer_type = erules::filters::lexer<char>;
+using lexem_type = typename lexer_type::lexem_type;
+using parser_type = erules::rule_parser<lexem_type>;
+using matrix_type = erules::rule_matrix<lexem_type>;
+using rule_set_type = erules::rule_set<lexem_type>;
+using environment_type = erules::slot_environment<char>;
+using batch_type = typename matrix_type::batch_type;
+using clock_type = std::chrono::steady_clock;
+
+typename matrix_type::node_type::uptr parse(const std::string& input)
+{
+    lexer_type lex;
+    parser_type pars(lex.read_all(input));
+    return pars.parse();
+}
+
+/// milliseconds per call of call, the best of runs
+template <typename CallT>
+double best_of(std::size_t runs, CallT&& call)
+{
+    double best = 0;
+    for (std::size_t i = 0; i < runs; ++i) {
+        auto start = clock_type::now();
+        call();
+        std::chrono::duration<double, std::milli> spent = clock_type::now()
+            - start;
+        if (i == 0 || spent.count() < best) {
+            best = spent.count();
+        }
+    }
+    return best;
+}
+
+/// the rule matrix of the columnar test, by tile shape. with
+/// arithmetic the kernels bound the time; comparisons alone leave it to
+/// the memory traffic, which tiling cuts once a batch outgrows the L2
+void bench_matrix(std::size_t rows, std::size_t runs, bool arithmetic)
+{
+    const char* names[] = { "US", "CA", "DE", "FR", "JP", "" };
+    std::vector<std::int64_t> id;
+    std::vector<std::int64_t> quantity;
+    std::vector<double> amount;
+    std::unique_ptr<bool[]> paid(new bool[rows]);
+    std::vector<std::uint32_t> offsets { 0 };
+    std::string countries;
+    for (std::size_t i = 0; i < rows; ++i) {
+        id.push_back(static_cast<std::int64_t>(i));
+        quantity.push_back(static_cast<std::int64_t>(i % 7) - 2);
+        amount.push_back(static_cast<double>(i % 500) * 1.5);
+        paid[i] = (i % 3 != 0);
+        countries += names[i % 6];
+        offsets.push_back(static_cast<std::uint32_t>(countries.size()));
+    }
+
+    matrix_type matrix;
+    batch_type batch(matrix.symbols(), rows);
+    batch.add_integers("id", id.data())
+        .add_integers("quantity", quantity.data())
+        .add_floats("amount", amount.data())
+        .add_booleans("paid", paid.get())
+        .add_strings("country", offsets.data(), countries.data());
+    const std::size_t rules = 64;
+    for (std::size_t i = 0; i < rules; ++i) {
+        auto last = arithmetic
+            ? "(id % " + std::to_string(i + 2) + ") = 0"
+            : "id > " + std::to_string(i * rows / rules);
+        matrix.add(parse("amount > " + std::to_string(i * 7)
+                         + " and quantity < " + std::to_string(i % 5)
+                         + " or " + last + " and paid"));
+    }
+
+    using tile = matrix_type::tile;
+    std::pair<const char*, tile> shapes[] = {
+        { "tiled", tile {} },
+        { "rule-major", tile { rows, 1 } },
+        { "record-major", tile { 1, rules } },
+    };
+    auto kind = arithmetic ? "arithmetic" : "comparisons";
+    for (auto& shape : shapes) {
+        if (!arithmetic && shape.second.records == 1) {
+            continue;
+        }
+        erules::match_matrix found;
+        auto spent = best_of(
+            runs, [&]() { matrix.match(batch, found, shape.second); });
+        std::cout << "matrix " << shape.first << ", " << kind << ": "
+                  << rows << " x " << rules << ", " << found.count()
+                  << " matches, " << spent << "ms\n";
+    }
+    if (!arithmetic) {
+        return;
+    }
+    erules::executor pool(4);
+    erules::match_matrix found;
+    auto spent = best_of(runs, [&]() { matrix.match(batch, found, pool); });
+    std::cout << "matrix tiled on 4 threads: " << spent << "ms\n";
+}
+
+/// records of the parallel rule set test, by thread count
+void bench_parallel(std::size_t records, std::size_t runs)
+{
+    using namespace erules::objects;
+    rule_set_type set;
+    for (int i = 0; i < 300; ++i) {
+        set.add(parse("type = " + std::to_string(i % 7) + " and amount > "
+                      + std::to_string(i) + " or name = \"n"
+                      + std::to_string(i % 50) + "\""));
+    }
+    set.build();
+
+    std::vector<std::unique_ptr<environment_type>> envs;
+    std::vector<const rule_set_type::environment_type*> views;
+    for (std::size_t i = 0; i < records; ++i) {
+        auto n = static_cast<std::int64_t>(i);
+        envs.emplace_back(std::make_unique<environment_type>(set.symbols()));
+        envs.back()->store("type", std::make_unique<number>(n % 9));
+        envs.back()->store("amount", std::make_unique<number>(n % 1100));
+        envs.back()->store("name", std::make_unique<string<char>>(
+                                       "n" + std::to_string(n % 70)));
+        views.emplace_back(envs.back().get());
+    }
+    for (std::size_t threads : { 1, 4 }) {
+        erules::executor pool(threads);
+        std::vector<std::vector<std::size_t>> found;
+        auto spent
+            = best_of(runs, [&]() { set.match(pool, views, found); });
+        std::cout << "rule set on " << threads << " threads: " << records
+                  << " records, " << spent << "ms\n";
+    }
+}
+
+/// a few records against many rules, which the pool shares out by rule
+void bench_sharded(std::size_t runs)
+{
+    using namespace erules::objects;
+    rule_set_type set;
+    for (int i = 0; i < 20000; ++i) {
+        set.add(parse("(amount % " + std::to_string(i % 13 + 2)
+                      + ") = 0 or name = \"n" + std::to_string(i % 50)
+                      + "\""));
+    }
+    set.build();
+
+    std::vector<std::unique_ptr<environment_type>> envs;
+    std::vector<const rule_set_type::environment_type*> views;
+    for (std::int64_t i = 0; i < 4; ++i) {
+        envs.emplace_back(std::make_unique<environment_type>(set.symbols()));
+        envs.back()->store("amount", std::make_unique<number>(i * 420 + 1));
+        envs.back()->store("name", std::make_unique<string<char>>(
+                                       "n" + std::to_string(i)));
+        views.emplace_back(envs.back().get());
+    }
+    for (std::size_t threads : { 1, 4 }) {
+        erules::executor pool(threads);
+        std::vector<std::vector<std::size_t>> found;
+        auto spent
+            = best_of(runs, [&]() { set.match(pool, views, found); });
+        std::cout << "rule set on " << threads << " threads: "
+                  << views.size() << " records, " << set.size()
+                  << " rules, " << spent << "ms\n";
+    }
+}
+
+}
+
+/// erules_bench [rows] [runs]
+/// timings of the matching paths; the unit tests only check results
+int main(int argc, char* argv[])
+{
+    std::size_t rows = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+    std::size_t runs = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 3;
+    if (rows == 0 || runs == 0) {
+        std::cerr << "usage: erules_bench [rows] [runs]\n";
+        return 2;
+    }
+    bench_matrix(rows, runs, true);
+    bench_matrix(rows * 10, runs, false);
+    bench_parallel(rows, runs);
+    bench_sharded(runs);
+    return 0;
+}
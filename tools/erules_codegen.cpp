@@ -0,0 +1,73 @@
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "erules/codegen.h"
+#include "erules/rule_lexer.h"
+#include "erules/rule_parser.h"
+
+/// erules_codegen <rules> <header> [namespace]
+/// one rule per line of the rules file; empty lines and lines starting
+/// with '#' are skipped
+int main(int argc, char* argv[])
+{
+    using lexer_type = erules::filters::lexer<char>;
+    using lexem_type = typename lexer_type::lexem_type;
+    using parser_type = erules::rule_parser<lexem_type>;
+
+    if (argc < 3) {
+        std::cerr << "usage: erules_codegen <rules> <header> [namespace]\n";
+        return 2;
+    }
+    std::string space = argc > 3 ? argv[3] : "rules";
+    std::ifstream in(argv[1]);
+    if (!in) {
+        std::cerr << "erules_codegen: can not open " << argv[1] << "\n";
+        return 1;
+    }
+
+    erules::rule_codegen<lexem_type> gen;
+    std::string line;
+    std::size_t number = 0;
+    bool failed = false;
+    while (std::getline(in, line)) {
+        ++number;
+        auto first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+        auto last = line.find_last_not_of(" \t\r");
+        auto text = line.substr(first, last - first + 1);
+        try {
+            lexer_type lex;
+            parser_type pars(lex.read_all(text));
+            auto tree = pars.parse();
+            if (!pars.complete()) {
+                throw std::runtime_error(
+                    "erules_codegen: unexpected lexem after the rule");
+            }
+            gen.add(tree, text);
+        } catch (const std::exception& ex) {
+            std::cerr << argv[1] << ":" << number << ": " << ex.what()
+                      << "\n";
+            failed = true;
+        }
+    }
+    if (failed) {
+        return 1;
+    }
+
+    std::string source(argv[1]);
+    source = source.substr(source.find_last_of("/\\") + 1);
+    std::ostringstream header;
+    gen.write(header, space, source);
+    std::ofstream out(argv[2], std::ios::binary);
+    if (!(out << header.str())) {
+        std::cerr << "erules_codegen: can not write " << argv[2] << "\n";
+        return 1;
+    }
+    return 0;
+}